@@ -0,0 +1,362 @@
+// Benchmark for libriff
+//
+// Generates a synthetic RIFF corpus, then times traversal, validation, counting and payload reads on every backend.
+//
+// Usage: riff_bench [-d DIR] [-s SCALE] [-k] [--no-bw64]
+//   -d DIR      directory for the generated corpus (default: current directory)
+//   -s SCALE    multiplies the chunk counts/sizes of the corpus (default: 1)
+//   -k          keep the generated files
+//   --no-bw64   skip the >4 GiB sparse BW64 file
+//
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "riff.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BENCH_FD 1
+#endif
+
+
+
+
+//*** corpus generator ***
+
+
+// Minimal RIFF writer: list sizes are patched when the list is closed, payloads can be left sparse
+struct Generator {
+    std::FILE * f = nullptr;
+    std::vector<std::pair<long, const char *>> lists;   // start positions and IDs of open lists
+
+    bool open (const std::string & path) {
+        f = std::fopen(path.c_str(), "wb");
+        return f != nullptr;
+    }
+
+    void writeHeader (const char * id, uint32_t size) {
+        uint8_t buf[8];
+        memcpy(buf, id, 4);
+        for (int i = 0; i < 4; i++) buf[4+i] = (size >> (8*i)) & 0xFF;
+        std::fwrite(buf, 1, 8, f);
+    }
+
+    void beginList (const char * id, const char * type) {
+        lists.push_back({std::ftell(f), id});
+        writeHeader(id, 0);
+        std::fwrite(type, 1, 4, f);
+    }
+
+    void endList () {
+        long start = lists.back().first;
+        const char * id = lists.back().second;
+        lists.pop_back();
+        long end = std::ftell(f);
+        std::fseek(f, start, SEEK_SET);
+        writeHeader(id, (uint32_t)(end - start - RIFF_CHUNK_DATA_OFFSET));
+        std::fseek(f, end, SEEK_SET);
+    }
+
+    void chunk (const char * id, const void * data, uint32_t size) {
+        writeHeader(id, size);
+        std::fwrite(data, 1, size, f);
+        if (size & 1) std::fputc(0, f);
+    }
+
+    // Payload is a hole in the file (reads back as zeros)
+    void sparseChunk (const char * id, uint32_t size) {
+        writeHeader(id, size);
+        std::fseek(f, (long)size + (size & 1), SEEK_CUR);
+    }
+
+    void close () {
+        // Make sure a trailing hole is part of the file
+        long end = std::ftell(f);
+        std::fseek(f, 0, SEEK_END);
+        if (std::ftell(f) < end) {
+            std::fseek(f, end - 1, SEEK_SET);
+            std::fputc(0, f);
+        }
+        std::fclose(f);
+        f = nullptr;
+    }
+};
+
+// Deep LIST nesting, one small chunk per level
+void genDeep (const std::string & path, int depth) {
+    Generator g;
+    if (!g.open(path)) return;
+    const char data[16] = "deep nesting...";
+    g.beginList("RIFF", "DEEP");
+    for (int i = 0; i < depth; i++) {
+        g.chunk("data", data, sizeof(data));
+        g.beginList("LIST", "deep");
+    }
+    g.chunk("data", data, sizeof(data));
+    for (int i = 0; i < depth; i++) g.endList();
+    g.endList();
+    g.close();
+}
+
+// Lots of tiny chunks on a single level
+void genTiny (const std::string & path, int count) {
+    Generator g;
+    if (!g.open(path)) return;
+    g.beginList("RIFF", "TINY");
+    for (int i = 0; i < count; i++) g.chunk("tiny", &i, 4);
+    g.endList();
+    g.close();
+}
+
+// Few huge chunks
+void genHuge (const std::string & path, int count, uint32_t size) {
+    Generator g;
+    if (!g.open(path)) return;
+    g.beginList("RIFF", "HUGE");
+    for (int i = 0; i < count; i++) g.sparseChunk("huge", size);
+    g.endList();
+    g.close();
+}
+
+// >4 GiB BW64 file, real size in the ds64 chunk
+void genBW64 (const std::string & path, int count, uint32_t size) {
+    Generator g;
+    if (!g.open(path)) return;
+    uint64_t riffSize = 4 + 8 + 28 + (uint64_t)count * (8 + size + (size & 1));
+    g.writeHeader("BW64", 0xFFFFFFFF);
+    std::fwrite("WAVE", 1, 4, g.f);
+    uint8_t ds64[28] = {0};
+    for (int i = 0; i < 8; i++) ds64[i] = (riffSize >> (8*i)) & 0xFF;
+    g.chunk("ds64", ds64, sizeof(ds64));
+    for (int i = 0; i < count; i++) g.sparseChunk("data", size);
+    g.close();
+}
+
+
+
+
+//*** benchmarked operations ***
+
+
+inline bool isList (const char * id) {
+    return !memcmp(id, "LIST", 4) || !memcmp(id, "RIFF", 4) || !memcmp(id, "BW64", 4);
+}
+
+// Non-recursive walk over all chunks, optionally reading all payload data
+// Returns the amount of visited chunks, or -1 on error
+int64_t walk (RIFF::RIFFFile & rf, bool readPayload, uint64_t & bytes) {
+    static std::vector<uint8_t> buf(1 << 16);
+    int64_t count = 0;
+    int r = rf.rewind();
+    if (r >= RIFF_ERROR_CRITICAL) return -1;
+    while (true) {
+        count++;
+        if (isList(rf().c_id)) {
+            if (rf.seekLevelSub() == RIFF_ERROR_NONE) continue;
+        } else if (readPayload) {
+            size_t n;
+            while ((n = rf.readInChunk(buf.data(), buf.size())) != 0) bytes += n;
+        }
+        // Seek to the next chunk, go up a level for every finished list
+        while ((r = rf.seekNextChunk()) != RIFF_ERROR_NONE) {
+            if (r >= RIFF_ERROR_CRITICAL) return -1;
+            if (rf().ls_level == 0) return count;
+            rf.levelParent();
+        }
+    }
+}
+
+enum Op {TRAVERSE, VALIDATE, COUNT, PAYLOAD, TREE, HASH, OP_COUNT};
+const char * opNames[OP_COUNT] = {"traverse", "validate", "count", "payload", "tree", "hash"};
+
+// Run one operation, returns the time in seconds or a negative value on error
+double runOp (RIFF::RIFFFile & rf, int op, int64_t & items, uint64_t & bytes) {
+    auto start = std::chrono::steady_clock::now();
+    items = 0; bytes = 0;
+    switch (op) {
+        case TRAVERSE:
+            items = walk(rf, false, bytes);
+            break;
+        case VALIDATE:
+            items = rf.fileValidate() == RIFF_ERROR_NONE ? 1 : -1;
+            break;
+        case COUNT:
+            rf.rewind();
+            items = rf.amountOfChunksInLevel();
+            break;
+        case PAYLOAD:
+            items = walk(rf, true, bytes);
+            break;
+        case TREE: {
+            riff_tree tree = {};
+            items = rf.parseTree(tree) == RIFF_ERROR_NONE ? tree.count - 1 : -1;
+            riff_treeFree(&tree);
+            break;
+        }
+        case HASH: {
+            riff_tree tree = {};
+            items = rf.parseTree(tree) == RIFF_ERROR_NONE && !rf.hashTree(tree, RIFF_HASH_XXH64, 4).empty() ? tree.count - 1 : -1;
+            riff_treeFree(&tree);
+            break;
+        }
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    return items < 0 ? -1 : t.count();
+}
+
+
+
+
+//*** backends ***
+
+
+struct Backend {
+    const char * name;
+    // Opens the file into rf, returns RIFF error code; state holds whatever the backend needs to keep alive
+    int (*open) (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *& state);
+    void (*close) (void * state);
+};
+
+int openCFILE (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *& state) {
+    std::FILE * f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr) return RIFF_ERROR_ACCESS;
+    state = f;
+    return rf.openCFILE(*f, size);
+}
+void closeCFILE (void * state) {std::fclose((std::FILE *)state);}
+
+int openFstream (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *& state) {
+    auto stream = new std::fstream(path, std::ios_base::in|std::ios_base::binary);
+    state = stream;
+    if (!stream->is_open()) return RIFF_ERROR_ACCESS;
+    return rf.openFstream(*stream, size);
+}
+void closeFstream (void * state) {delete (std::fstream *)state;}
+
+const size_t memoryLimit = (size_t)1 << 30;    // don't load bigger files into memory
+int openMemory (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *& state) {
+    if (size > memoryLimit) return RIFF_ERROR_ACCESS;
+    std::FILE * f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr) return RIFF_ERROR_ACCESS;
+    auto mem = new std::vector<uint8_t>(size);
+    state = mem;
+    size_t n = std::fread(mem->data(), 1, size, f);
+    std::fclose(f);
+    if (n != size) return RIFF_ERROR_ACCESS;
+    return rf.openMemory(mem->data(), size);
+}
+void closeMemory (void * state) {delete (std::vector<uint8_t> *)state;}
+
+#if BENCH_FD
+int openFd (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *& state) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return RIFF_ERROR_ACCESS;
+    state = new int(fd);
+    return rf.openFd(fd, size);
+}
+void closeFd (void * state) {::close(*(int *)state); delete (int *)state;}
+
+int openMmap (RIFF::RIFFFile & rf, const std::string & path, size_t size, void *&) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return RIFF_ERROR_ACCESS;
+    int r = rf.openMmap(fd, size);
+    ::close(fd);    // the mapping stays until the handle is freed
+    return r;
+}
+void closeMmap (void *) {}
+#endif
+
+const Backend backends[] = {
+    {"FILE",    openCFILE,   closeCFILE},
+    {"fstream", openFstream, closeFstream},
+    {"memory",  openMemory,  closeMemory},
+#if BENCH_FD
+    {"fd",      openFd,      closeFd},
+    {"mmap",    openMmap,    closeMmap},
+#endif
+};
+
+
+
+
+int main (int argc, char * argv[]) {
+    std::string dir = ".";
+    double scale = 1;
+    bool keep = false, bw64 = true;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i+1 < argc) dir = argv[++i];
+        else if (!strcmp(argv[i], "-s") && i+1 < argc) scale = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-k")) keep = true;
+        else if (!strcmp(argv[i], "--no-bw64")) bw64 = false;
+        else {
+            std::printf("Usage: %s [-d DIR] [-s SCALE] [-k] [--no-bw64]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    struct Corpus {const char * name; std::string path;};
+    std::vector<Corpus> corpus = {
+        {"deep", dir + "/bench_deep.riff"},
+        {"tiny", dir + "/bench_tiny.riff"},
+        {"huge", dir + "/bench_huge.riff"},
+    };
+    std::printf("Generating corpus in %s ...\n", dir.c_str());
+    genDeep(corpus[0].path, (int)(2000 * scale));
+    genTiny(corpus[1].path, (int)(1000000 * scale));
+    genHuge(corpus[2].path, 4, (uint32_t)(128 * 1024 * 1024 * (scale < 8 ? scale : 8)));
+    if (bw64) {
+        corpus.push_back({"bw64", dir + "/bench_bw64.riff"});
+        genBW64(corpus[3].path, 2, 0xC0000000);    // 2 x 3 GiB
+    }
+
+    std::printf("%-6s %-8s %-9s %10s %10s %10s %8s %8s %8s\n", "corpus", "backend", "op", "time [ms]", "chunks", "MB/s", "reads", "seeks", "back");
+    for (auto & c : corpus) {
+        std::FILE * f = std::fopen(c.path.c_str(), "rb");
+        if (f == nullptr) {
+            std::printf("%-6s: failed to generate %s\n", c.name, c.path.c_str());
+            continue;
+        }
+        std::fseek(f, 0, SEEK_END);
+        size_t size = std::ftell(f);
+        std::fclose(f);
+
+        for (auto & b : backends) {
+            for (int op = 0; op < OP_COUNT; op++) {
+                RIFF::RIFFFile rf;
+                void * state = nullptr;
+                int r = b.open(rf, c.path, size, state);
+                if (r >= RIFF_ERROR_CRITICAL) {
+                    std::printf("%-6s %-8s %-9s %10s\n", c.name, b.name, opNames[op], "skipped");
+                    if (state) b.close(state);
+                    break;
+                }
+                rf.ioStatsReset();
+                int64_t items; uint64_t bytes;
+                double t = runOp(rf, op, items, bytes);
+                auto & io = rf.ioStats();
+                if (t < 0)
+                    std::printf("%-6s %-8s %-9s %10s %10s\n", c.name, b.name, opNames[op], "error", rf.latestErrorToString().c_str());
+                else
+                    std::printf("%-6s %-8s %-9s %10.2f %10lld %10.1f %8zu %8zu %8zu\n", c.name, b.name, opNames[op], t * 1000,
+                        op == VALIDATE ? 0LL : (long long)items, t > 0 ? io.bytes_read / t / 1e6 : 0.0, io.reads, io.seeks, io.seeks_backward);
+                rf.close();
+                b.close(state);
+            }
+        }
+    }
+
+    if (!keep)
+        for (auto & c : corpus) std::remove(c.path.c_str());
+
+    return 0;
+}
@@ -93,9 +93,9 @@ void test(FILE *f){
 	//allocate initialized handle struct
 	riff_handle *rh = riff_handleAllocate();
 	
-	//after allocation rh->fp_fprintf == fprintf
-	//you can change the rh->fp_fprintf function pointer here for error output
-	//rh->fp_fprint = NULL;  //set to NULL to disable any error printing
+	//after allocation rh->fp_printf == NULL, diagnostics are only recorded in rh->diag
+	//you can set the rh->fp_printf function pointer here for error output
+	rh->fp_printf = riff_printf;  //print every diagnostic to stderr as it occurs
 	
 	//open file, use build in input wrappers for file
 	//open RIFF file via file handle -> reads RIFF header and first chunk header
@@ -56,11 +56,18 @@
  * ```c
  * errCode = riff_seekNextChunk(rh);
  * ```
- * Seeking to a previous chunk is impossible without making additional data structures, as the chunks only specify their own size, so the best you can do is seek to the start of the chunk and then seek forward:
+ * The chunks only specify their own size, so there is no way to step back from a chunk by itself. You can seek to the start of the level and then seek forward:
  * ```c
  * errCode = riff_seekLevelStart(rh);
  * while (whatever || errCode == RIFF_ERROR_EOCL) {errCode = riff_seekNextChunk(rh);};  // check for end of chunk list
  * ```
+ * `riff_seekPrevChunk()` and `riff_seekChunkIndex()` do that for you. If you step backwards a lot, enable breadcrumbs: every level then remembers the positions of the chunks walked so far and both functions jump straight to them:
+ * ```c
+ * riff_setBreadcrumbs(rh, 1);
+ * // ... walk forward with riff_seekNextChunk() ...
+ * errCode = riff_seekPrevChunk(rh);     // RIFF_ERROR_EOCL at the first chunk of the level
+ * errCode = riff_seekChunkIndex(rh, 3); // fourth chunk of the level
+ * ```
  * You probably noticed me constantly getting some `errCode` and wondered why that is done. Well, RIFF has a pretty robust error-reporting system:
  * ```c
  * if (errCode) {
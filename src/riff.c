@@ -1,6 +1,7 @@
 // take care: whenever we call rh->fp_read() or rh->fp_seek()
 //   we must adjust rh->c_pos and rh->pos
 //   => to simplify user wrappers we update the positions outside
+//   always call them via riff_ioRead() and riff_ioSeek() to keep the I/O statistics
 
 
 #include <stdlib.h>
@@ -8,11 +9,14 @@
 #include <string.h>
 
 #include <stdarg.h> //function with variable number of arguments
+#include <time.h>
 
 #include "riff.h"
+#include "riff_internal.h"
 
 
 #define RIFF_LEVEL_ALLOC 16  //number of stack elements allocated per step lock more when needing to enlarge (step)
+#define RIFF_CRUMBS_ALLOC 64  //initial amount of breadcrumbs per level, doubled when needed
 
 #define checkValidRiffHandle(rh) if (rh == NULL) return RIFF_ERROR_INVALID_HANDLE
 
@@ -37,20 +41,60 @@ static const char *riff_es[] = {
 	"File access failed",
 	//8
 	"Invalid riff_handle",
+	//9
+	"Memory allocation failed",
 	
 	
-	//9
+	//10
 	//all other
 	"Unknown RIFF error"  
 };
 
+// Table to translate diagnostic kinds to strings, corresponds to RIFF_DIAG_... macros
+static const char *riff_ds[] = {
+	//0
+	"No diagnostic",
+	//1
+	"I/O function pointer not set",
+	//2
+	"Failed to read RIFF header",
+	//3
+	"Invalid RIFF header",
+	//4
+	"ds64 chunk too small to contain any meaningful information",
+	//5
+	"RIFF header chunk size doesn't match file size",
+	//6
+	"Failed to read chunk header",
+	//7
+	"Invalid chunk ID (FOURCC)",
+	//8
+	"Chunk size exceeds list size, at least one size value must be corrupt",
+	//9
+	"Chunk size exceeds file size, at least one size value must be corrupt",
+	//10
+	"Excess bytes at end of chunk list",
+	//11
+	"Only RIFF, LIST or BW64 chunks can contain subchunks",
+	//12
+	"Chunk too small to contain sub level chunks",
+	//13
+	"Invalid chunk type ID (FOURCC)",
+	//14
+	"Failed to read chunk data",
+	
+	//15
+	//all other
+	"Unknown diagnostic"
+};
+
 
 
 
 //*** default access FP setup ***
 
 /*****************************************************************************/
-//default print function
+//description: see header file
 int riff_printf(const char *format, ... ){
 	va_list args;
 	va_start(args, format);
@@ -74,16 +118,39 @@ size_t seek_file(riff_handle *rh, size_t pos){
 	return pos;
 }
 
+#if defined(__unix__) || defined(__APPLE__)
+/*****************************************************************************/
+size_t readAt_file(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	return riff_readAtFd(fileno((FILE*)(rh->fh)), ptr, size, pos);
+}
+
+/*****************************************************************************/
+int fd_file(riff_handle *rh){
+	return fileno((FILE*)(rh->fh));
+}
+
+/*****************************************************************************/
+int advise_file(riff_handle *rh, int advice, size_t pos, size_t size){
+	return riff_adviseFd(fileno((FILE*)(rh->fh)), advice, pos, size);
+}
+#endif
+
 /*****************************************************************************/
 //description: see header file
 int riff_open_file(riff_handle *rh, FILE *f, size_t size){
 	checkValidRiffHandle(rh);
+	riff_handleClose(rh);
 	rh->fh = f;
 	rh->size = size;
 	rh->pos_start = ftell(f); //current file offset of stream considered as start of RIFF file
 	
 	rh->fp_read = &read_file;
 	rh->fp_seek = &seek_file;
+#if defined(__unix__) || defined(__APPLE__)
+	rh->fp_fd = &fd_file;
+	rh->fp_advise = &advise_file;
+	rh->fp_readAt = &readAt_file;
+#endif
 	
 	return riff_readHeader(rh);
 }
@@ -95,6 +162,11 @@ int riff_open_file(riff_handle *rh, FILE *f, size_t size){
 
 /*****************************************************************************/
 size_t read_mem(riff_handle *rh, void *ptr, size_t size){
+	//corrupt sizes may point beyond the end
+	if(rh->pos >= rh->size)
+		return 0;
+	if(size > rh->size - rh->pos)
+		size = rh->size - rh->pos;
 	memcpy(ptr, ((uint8_t*)rh->fh+rh->pos), size);
 	return size;
 }
@@ -104,10 +176,28 @@ size_t seek_mem(riff_handle *rh, size_t pos){
 	return pos; //instant in memory
 }
 
+/*****************************************************************************/
+size_t readAt_mem(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	if(pos >= rh->size)
+		return 0;
+	if(size > rh->size - pos)
+		size = rh->size - pos;
+	memcpy(ptr, (const uint8_t*)rh->fh + pos, size);
+	return size;
+}
+
+/*****************************************************************************/
+const void *map_mem(riff_handle *rh, size_t pos, size_t size){
+	if(pos + size > rh->size)
+		return NULL;
+	return (const uint8_t*)rh->fh + pos;
+}
+
 /*****************************************************************************/
 //description: see header file
 int riff_open_mem(riff_handle *rh, const void *ptr, size_t size){
 	checkValidRiffHandle(rh);
+	riff_handleClose(rh);
 	
 	rh->fh = (void *)ptr;
 	rh->size = size;
@@ -115,6 +205,8 @@ int riff_open_mem(riff_handle *rh, const void *ptr, size_t size){
 	
 	rh->fp_read = &read_mem;
 	rh->fp_seek = &seek_mem;
+	rh->fp_map = &map_mem;
+	rh->fp_readAt = &readAt_mem;
 	
 	return riff_readHeader(rh);
 }
@@ -125,11 +217,106 @@ int riff_open_mem(riff_handle *rh, const void *ptr, size_t size){
 
 
 
+/*****************************************************************************/
+//record diagnostic, only format text if the user asked for printing
+//returns the error code, so error paths can "return riff_report(...)"
+int riff_report(riff_handle *rh, int code, int kind, size_t pos, const char *id, size_t expected, size_t actual){
+	struct riff_diag *d = &rh->diag;
+	d->code = code;
+	d->kind = kind;
+	d->pos = pos;
+	if(id != NULL)
+		memcpy(d->c_id, id, 4);
+	else
+		memset(d->c_id, 0, 4);
+	d->c_id[4] = 0;
+	d->expected = expected;
+	d->actual = actual;
+	
+	if(rh->diag_ring != NULL)
+		rh->diag_ring[rh->diag_count % rh->diag_ring_size] = *d;
+	rh->diag_count++;
+	
+	if(rh->fp_printf){
+		char buf[256];
+		riff_diagToString(d, buf, sizeof(buf));
+		rh->fp_printf("%s\n", buf);
+	}
+	return code;
+}
+
+
+/*****************************************************************************/
+//read via FP and update I/O statistics
+//payload: 0 if header bytes are read, 1 if chunk data is read
+size_t riff_ioRead(riff_handle *rh, void *ptr, size_t size, int payload){
+	struct riff_ioStats *io = &rh->io;
+	size_t n;
+	if(rh->fp_clock){
+		uint64_t t = rh->fp_clock();
+		n = rh->fp_read(rh, ptr, size);
+		io->time_read += rh->fp_clock() - t;
+	}
+	else
+		n = rh->fp_read(rh, ptr, size);
+	
+	io->reads++;
+	io->bytes_read += n;
+	if(payload)
+		io->bytes_payload += n;
+	else
+		io->bytes_header += n;
+	io->pos += n;
+	
+	//stream window: prefetch ahead, drop behind
+	if(rh->access_mode == RIFF_ACCESS_STREAM  &&  payload  &&  rh->fp_advise != NULL){
+		if(io->pos < rh->access_pos  ||  io->pos >= rh->access_pos + RIFF_ADVISE_WINDOW){
+			if(io->pos > rh->access_pos)
+				rh->fp_advise(rh, RIFF_ADVISE_DONTNEED, rh->access_pos, io->pos - rh->access_pos);
+			rh->fp_advise(rh, RIFF_ADVISE_WILLNEED, io->pos, RIFF_ADVISE_WINDOW);
+			rh->access_pos = io->pos;
+		}
+	}
+	return n;
+}
+
+
+/*****************************************************************************/
+//seek via FP and update I/O statistics
+size_t riff_ioSeek(riff_handle *rh, size_t pos){
+	struct riff_ioStats *io = &rh->io;
+	size_t r;
+	if(rh->fp_clock){
+		uint64_t t = rh->fp_clock();
+		r = rh->fp_seek(rh, pos);
+		io->time_seek += rh->fp_clock() - t;
+	}
+	else
+		r = rh->fp_seek(rh, pos);
+	
+	io->seeks++;
+	if(pos < io->pos)
+		io->seeks_backward++;
+	io->pos = pos;
+	return r;
+}
+
+
 /*****************************************************************************/
 //pass pointer to 32 bit LE value and convert, return in native byte order
 uint32_t convUInt32LE(const void *p){
 	const uint8_t *c = (const uint8_t*)p;
-	return c[0] | (c[1] << 8) | (c[2] << 16) | (c[3] << 24);
+	return c[0] | (c[1] << 8) | (c[2] << 16) | ((uint32_t)c[3] << 24);
+}
+
+
+/*****************************************************************************/
+//description: see riff_internal.h
+int riff_fourccValid(const void *id){
+	uint32_t v;
+	memcpy(&v, id, 4); //byte order doesn't matter, all bytes are tested alike
+	//high bit of a byte is set by the subtraction if it is < 0x20, by the addition if it is > 0x7e
+	return (((v - 0x20202020u) & ~v) | ((v + 0x01010101u) | v)) & 0x80808080u ? 0 : 1;
 }
 
 
@@ -137,7 +324,7 @@ uint32_t convUInt32LE(const void *p){
 //read 32 bit LE from file via FP and return as native
 uint32_t readUInt32LE(riff_handle *rh){
 	char buf[4] = "";	// Init to 0
-	rh->fp_read(rh, buf, 4);
+	riff_ioRead(rh, buf, 4, 0);
 	rh->pos += 4;
 	rh->c_pos += 4;
 	return convUInt32LE(buf);
@@ -152,13 +339,18 @@ int riff_readChunkHeader(riff_handle *rh){
 
 	char buf[8];
 	
-	int n = rh->fp_read(rh, buf, 8);
-	
-	if(n != 8){
-		if(rh->fp_printf)
-			rh->fp_printf("Failed to read header, %d of %d bytes read!\n", n, 8);
-		return RIFF_ERROR_EOF; //return error code
-	}
+	size_t n = riff_ioRead(rh, buf, 8, 0);
+	return riff_parseChunkHeader(rh, buf, n);
+}
+
+
+/*****************************************************************************/
+//set up current chunk from header bytes read at rh->pos
+//n: amount of bytes read
+//return error code
+int riff_parseChunkHeader(riff_handle *rh, const char *buf, size_t n){
+	if(n != 8)
+		return riff_report(rh, RIFF_ERROR_EOF, RIFF_DIAG_CHUNK_HEADER_SHORT, rh->pos, NULL, 8, n);
 	
 	rh->c_pos_start = rh->pos;
 	rh->pos += n;
@@ -170,14 +362,8 @@ int riff_readChunkHeader(riff_handle *rh){
 	
 	
 	//verify valid chunk ID, must contain only printable ASCII chars
-	int i;
-	for(i = 0; i < 4; i++) {
-		if(rh->c_id[i] < 0x20  ||  rh->c_id[i] > 0x7e) {
-			if(rh->fp_printf)
-				rh->fp_printf("Invalid chunk ID (FOURCC) of chunk at file pos %d: 0x%02x,0x%02x,0x%02x,0x%02x\n", rh->c_pos_start, rh->c_id[0], rh->c_id[1], rh->c_id[2], rh->c_id[3]);
-			return RIFF_ERROR_ILLID;
-		}
-	}
+	if(!riff_fourccValid(rh->c_id))
+		return riff_report(rh, RIFF_ERROR_ILLID, RIFF_DIAG_CHUNK_ID, rh->c_pos_start, rh->c_id, 0, 0);
 	
 	
 	//check if chunk fits into current list level and file, value could be corrupt
@@ -192,23 +378,86 @@ int riff_readChunkHeader(riff_handle *rh){
 		listend = rh->pos_start + RIFF_CHUNK_DATA_OFFSET + rh->h_size;
 	
 	if(cposend > listend){
-		if(rh->fp_printf)
-			rh->fp_printf("Chunk size exceeds list size! At least one size value must be corrupt!");
 		//chunk data must be considered as cut off, better skip this chunk
-		return RIFF_ERROR_ICSIZE;
+		return riff_report(rh, RIFF_ERROR_ICSIZE, RIFF_DIAG_CHUNK_EXCEEDS_LIST, rh->c_pos_start, rh->c_id, listend, cposend);
 	}
 	
 	//check chunk size against file size
 	if((rh->size > 0)  &&  (cposend > rh->size)){
-		if(rh->fp_printf)
-			rh->fp_printf("Chunk size exceeds file size! At least one size value must be corrupt!");
-		return RIFF_ERROR_EOF; //Or better RIFF_ERROR_ICSIZE?
+		return riff_report(rh, RIFF_ERROR_EOF, RIFF_DIAG_CHUNK_EXCEEDS_FILE, rh->c_pos_start, rh->c_id, rh->size, cposend); //Or better RIFF_ERROR_ICSIZE?
 	}
 	
 	return RIFF_ERROR_NONE;
 }
 
 
+/*****************************************************************************/
+//forget the metadata of a level
+void level_reset(struct riff_levelStackE *ls){
+	ls->child_count = 0;
+	ls->validated = 0;
+	ls->visit_pos = 0;
+	ls->visit_index = 0;
+	ls->crumbs_count = 0;
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+void riff_levelFreeCrumbs(riff_handle *rh){
+	size_t i;
+	free(rh->ls_root.crumbs);
+	rh->ls_root.crumbs = NULL;
+	rh->ls_root.crumbs_count = rh->ls_root.crumbs_size = 0;
+	for(i = 0; i < rh->ls_size; i++){
+		free(rh->ls[i].crumbs);
+		rh->ls[i].crumbs = NULL;
+		rh->ls[i].crumbs_count = rh->ls[i].crumbs_size = 0;
+	}
+}
+
+/*****************************************************************************/
+//append the position of the next chunk of the level to the breadcrumbs, nothing is recorded if allocation fails
+void level_crumb(struct riff_levelStackE *ls, size_t pos){
+	if(ls->crumbs_count >= ls->crumbs_size){
+		int32_t size_new = ls->crumbs_size > 0 ? ls->crumbs_size * 2 : RIFF_CRUMBS_ALLOC;
+		size_t *cnew = realloc(ls->crumbs, size_new * sizeof(size_t));
+		if(cnew == NULL)
+			return;
+		ls->crumbs = cnew;
+		ls->crumbs_size = size_new;
+	}
+	ls->crumbs[ls->crumbs_count++] = pos;
+}
+
+/*****************************************************************************/
+//stack entry of the current level, the header chunk at level 0
+struct riff_levelStackE *level_current(riff_handle *rh){
+	if(rh->ls_level > 0)
+		return rh->ls + (rh->ls_level - 1);
+	return &rh->ls_root;
+}
+
+/*****************************************************************************/
+//the first chunk of the current level was read
+void level_first(riff_handle *rh){
+	struct riff_levelStackE *ls = level_current(rh);
+	if(ls->visit_pos == 0){
+		ls->visit_pos = rh->c_pos_start;
+		ls->visit_index = 0;
+	}
+	if(rh->breadcrumbs  &&  ls->crumbs_count == 0)
+		level_crumb(ls, rh->c_pos_start);
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+void riff_levelForget(riff_handle *rh){
+	size_t i;
+	level_reset(&rh->ls_root);
+	for(i = 0; i < rh->ls_size; i++)
+		level_reset(rh->ls + i);
+}
+
 /*****************************************************************************/
 //pop from level stack
 //when returning we are positioned inside the parent chunk ()
@@ -252,6 +501,9 @@ void stack_push(riff_handle *rh, const char *type){
 	}
 	
 	struct riff_levelStackE *ls = rh->ls + rh->ls_level;
+	//metadata stays valid if the same list is entered again
+	if(ls->c_pos_start != rh->c_pos_start  ||  ls->c_size != rh->c_size)
+		level_reset(ls);
 	ls->c_pos_start = rh->c_pos_start;
 	memcpy(ls->c_id, rh->c_id, 4);
 	ls->c_size = rh->c_size;
@@ -267,11 +519,8 @@ void stack_push(riff_handle *rh, const char *type){
 /*****************************************************************************/
 //description: see header file
 riff_handle *riff_handleAllocate(){
-	riff_handle *rh = calloc(1, sizeof(riff_handle));
-	if(rh != NULL){
-		rh->fp_printf = riff_printf;
-	}
-	return rh;
+	//fp_printf stays NULL, diagnostics are only recorded
+	return calloc(1, sizeof(riff_handle));
 }
 
 /*****************************************************************************/
@@ -280,13 +529,36 @@ riff_handle *riff_handleAllocate(){
 void riff_handleFree(riff_handle *rh){
 	if(rh == NULL)
 		return;
-	//free stack
+	//stop prefetch thread, release source resources of the open function
+	riff_handleClose(rh);
+	//free breadcrumbs and stack
+	riff_levelFreeCrumbs(rh);
 	if(rh->ls != NULL)
 		free(rh->ls);
+	//free diagnostic ring
+	if(rh->diag_ring != NULL)
+		free(rh->diag_ring);
 	//free struct
 	free(rh);
 }
 
+/*****************************************************************************/
+//description: see header file
+void riff_handleClose(riff_handle *rh){
+	if(rh == NULL)
+		return;
+	riff_prefetchStop(rh);
+	if(rh->fp_close != NULL)
+		rh->fp_close(rh);
+	//callbacks of the previous open function must not be used with the next source
+	rh->fp_map = NULL;
+	rh->fp_fd = NULL;
+	rh->fp_advise = NULL;
+	rh->fp_readAt = NULL;
+	rh->fp_close = NULL;
+	rh->fp_dup = NULL;
+}
+
 /*****************************************************************************/
 //description: see header file
 //shall be called only once by the open-function
@@ -295,35 +567,29 @@ int riff_readHeader(riff_handle *rh){
 
 	char buf[RIFF_HEADER_SIZE];
 	
-	if(rh->fp_read == NULL) {
-		if(rh->fp_printf)
-			rh->fp_printf("I/O function pointer not set\n"); //fatal user error
-		return RIFF_ERROR_INVALID_HANDLE;
-	}
+	if(rh->fp_read == NULL)
+		return riff_report(rh, RIFF_ERROR_INVALID_HANDLE, RIFF_DIAG_NO_IO, rh->pos, NULL, 0, 0); //fatal user error
 	
-	size_t n = rh->fp_read(rh, buf, RIFF_HEADER_SIZE);
+	size_t n = riff_ioRead(rh, buf, RIFF_HEADER_SIZE, 0);
 	rh->pos += n;
 	
-	if(n != RIFF_HEADER_SIZE){
-		if(rh->fp_printf)
-			rh->fp_printf("Read error, failed to read RIFF header\n");
-		//printf("%d", n);
-		return RIFF_ERROR_EOF; //return error code
-	}
+	if(n != RIFF_HEADER_SIZE)
+		return riff_report(rh, RIFF_ERROR_EOF, RIFF_DIAG_HEADER_SHORT, rh->pos_start, NULL, RIFF_HEADER_SIZE, n);
 	memcpy(rh->h_id, buf, 4);
 	rh->h_size = convUInt32LE(buf + 4);
 	memcpy(rh->h_type, buf + 8, 4);
 
 
-	if(memcmp(rh->h_id, "RIFF", 4) != 0 && memcmp(rh->h_id, "BW64", 4) != 0) {
-		if(rh->fp_printf)
-			rh->fp_printf("Invalid RIFF header\n");
-		return RIFF_ERROR_ILLID;
-	}
+	if(memcmp(rh->h_id, "RIFF", 4) != 0 && memcmp(rh->h_id, "BW64", 4) != 0)
+		return riff_report(rh, RIFF_ERROR_ILLID, RIFF_DIAG_HEADER_ID, rh->pos_start, rh->h_id, 0, 0);
+
+	//level metadata of a previously opened file is stale
+	riff_levelForget(rh);
 
 	int r = riff_readChunkHeader(rh);
 	if(r != RIFF_ERROR_NONE)
 		return r;
+	level_first(rh);
 
 	if (rh->h_size == 0xFFFFFFFF && !memcmp(rh->c_id, "ds64", 4)) {
 		// It's a 64-bit sized file
@@ -332,26 +598,24 @@ int riff_readHeader(riff_handle *rh){
 		
 		// Buffer already used, so it can be reused
 		size_t r_ = riff_readInChunk(rh, buf, 8);
-		if (r_ != 8) {
-			if (rh->fp_printf) {
-				rh->fp_printf("ds64 chunk too small to contain any meaningful information.\n");
-			}
-			return RIFF_ERROR_ICSIZE;
-		}
+		if (r_ != 8)
+			return riff_report(rh, RIFF_ERROR_ICSIZE, RIFF_DIAG_DS64_SHORT, rh->c_pos_start, rh->c_id, 8, r_);
 		rh->h_size = ((size_t)convUInt32LE(buf+4) << 32) | convUInt32LE(buf);
 	}
+	rh->ls_root.c_pos_start = rh->pos_start;
+	memcpy(rh->ls_root.c_id, rh->h_id, 4);
+	rh->ls_root.c_size = rh->h_size;
+	memcpy(rh->ls_root.c_type, rh->h_type, 4);
 	
 	//compare with given file size
 	if(rh->size != 0){
 		if(rh->size != rh->h_size + RIFF_CHUNK_DATA_OFFSET){
-			if(rh->fp_printf)
-				rh->fp_printf("RIFF header chunk size %d doesn't match file size %d!\n", rh->h_size + RIFF_CHUNK_DATA_OFFSET, rh->size);
 			if(rh->size >= rh->h_size + RIFF_CHUNK_DATA_OFFSET)
-				return RIFF_ERROR_EXDAT;
+				return riff_report(rh, RIFF_ERROR_EXDAT, RIFF_DIAG_SIZE_MISMATCH, rh->pos_start, rh->h_id, rh->h_size + RIFF_CHUNK_DATA_OFFSET, rh->size);
 			else
 				//end isn't reached yet and you can parse further
 				//but file seems to be cut off or given file size (via open-function) was too small -> we are not allowed to read beyond
-				return RIFF_ERROR_EOF;
+				return riff_report(rh, RIFF_ERROR_EOF, RIFF_DIAG_SIZE_MISMATCH, rh->pos_start, rh->h_id, rh->h_size + RIFF_CHUNK_DATA_OFFSET, rh->size);
 		}
 	}
 
@@ -369,13 +633,27 @@ int riff_readHeader(riff_handle *rh){
 /*****************************************************************************/
 //read to memory block, returns number of successfully read bytes
 //keep track of position, do not read beyond end of chunk, pad byte is not read
-size_t riff_readInChunk(riff_handle *rh, void *to, size_t size){
+size_t readInChunk(riff_handle *rh, void *to, size_t size){
 	size_t left = rh->c_size - rh->c_pos;
 	if(left < size)
 		size = left;
-	size_t n = rh->fp_read(rh, to, size);
+	//data read ahead by the prefetch thread
+	size_t m = rh->prefetch != NULL ? riff_prefetchRead(rh, to, size) : 0;
+	if(m == size)
+		return m;
+	size_t n = riff_ioRead(rh, (uint8_t*)to + m, size - m, 1);
 	rh->pos += n;
 	rh->c_pos += n;
+	return m + n;
+}
+
+size_t riff_readInChunk(riff_handle *rh, void *to, size_t size){
+	if(rh->fp_trace == NULL)
+		return readInChunk(rh, to, size);
+	
+	rh->fp_trace(rh, RIFF_TRACE_READ_IN_CHUNK, RIFF_TRACE_BEGIN, 0);
+	size_t n = readInChunk(rh, to, size);
+	rh->fp_trace(rh, RIFF_TRACE_READ_IN_CHUNK, RIFF_TRACE_END, n);
 	return n;
 }
 
@@ -391,47 +669,160 @@ int riff_seekInChunk(riff_handle *rh, size_t c_pos){
 	}
 	rh->pos = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET + c_pos;
 	rh->c_pos = c_pos;
-	size_t r = rh->fp_seek(rh, rh->pos); //seek never fails, but pos might be invalid to read from
+	riff_ioSeek(rh, rh->pos); //seek never fails, but pos might be invalid to read from
 	return RIFF_ERROR_NONE;
 }
 
 
 /*****************************************************************************/
-//description: see header file
-int riff_seekNextChunk(riff_handle *rh){
-	checkValidRiffHandle(rh);
-
+int seekNextChunk(riff_handle *rh){
 	size_t posnew = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET + rh->c_size + rh->pad; //expected pos of following chunk
+	struct riff_levelStackE *ls = level_current(rh);
 	
 	size_t listend;
-	if(rh->ls_level > 0){
-		struct riff_levelStackE *ls = rh->ls + (rh->ls_level - 1);
+	if(rh->ls_level > 0)
 		listend = ls->c_pos_start + RIFF_CHUNK_DATA_OFFSET + ls->c_size; //end of current list level without pad byte
-	}
 	else
 		listend = rh->pos_start + RIFF_CHUNK_DATA_OFFSET + rh->h_size; //at level 0
 	
+	//the walk from the first chunk of the level continues
+	int visit = ls->visit_pos != 0  &&  ls->visit_pos == rh->c_pos_start;
+	int crumb = rh->breadcrumbs  &&  ls->crumbs_count > 0  &&  ls->crumbs[ls->crumbs_count - 1] == rh->c_pos_start;
+	
 	//printf("listend %d  posnew %d\n", listend, posnew);  //debug
 	
 	//if no more chunks in the current sub list level
 	if(listend < posnew + RIFF_CHUNK_DATA_OFFSET){
 		//there shouldn't be any pad bytes at the list end, since the containing chunks should be padded to even number of bytes already
 		//we consider excess bytes as non critical file structure error
-		if(listend > posnew){
-			if(rh->fp_printf)
-				rh->fp_printf("%d excess bytes at pos %d at end of chunk list!\n", listend - posnew, posnew);
-			return RIFF_ERROR_EXDAT;
-		}
+		if(listend > posnew)
+			return riff_report(rh, RIFF_ERROR_EXDAT, RIFF_DIAG_EXCESS_BYTES, posnew, NULL, 0, listend - posnew);
+		if(visit)
+			ls->child_count = ls->visit_index + 1;
 		return RIFF_ERROR_EOCL;
 	}
 	
 	rh->pos = posnew;
 	rh->c_pos = 0; 
-	rh->fp_seek(rh, posnew);
+	int r;
+	if(rh->prefetch != NULL)
+		r = riff_prefetchNext(rh, posnew, listend);
+	else {
+		riff_ioSeek(rh, posnew);
+		r = riff_readChunkHeader(rh);
+	}
+	if(r == RIFF_ERROR_NONE  &&  visit){
+		ls->visit_pos = posnew;
+		ls->visit_index++;
+	}
+	if(r == RIFF_ERROR_NONE  &&  crumb)
+		level_crumb(ls, posnew);
+	return r;
+}
+
+//description: see header file
+int riff_seekNextChunk(riff_handle *rh){
+	checkValidRiffHandle(rh);
 	
+	if(rh->fp_trace == NULL)
+		return seekNextChunk(rh);
+	
+	rh->fp_trace(rh, RIFF_TRACE_SEEK_NEXT_CHUNK, RIFF_TRACE_BEGIN, 0);
+	int r = seekNextChunk(rh);
+	rh->fp_trace(rh, RIFF_TRACE_SEEK_NEXT_CHUNK, RIFF_TRACE_END, r);
+	return r;
+}
+
+
+/*****************************************************************************/
+//seek to the chunk header at pos, which is known to be in the current level
+int level_seekPos(riff_handle *rh, size_t pos){
+	rh->pos = pos;
+	rh->c_pos = 0;
+	riff_ioSeek(rh, pos);
 	return riff_readChunkHeader(rh);
 }
 
+/*****************************************************************************/
+//seek to the closest known chunk of the current level before pos with an index of at most i (breadcrumb, furthest visited chunk or first chunk)
+//index: set to the index of the chunk in the level
+int level_seekBefore(riff_handle *rh, size_t pos, int32_t i, int32_t *index){
+	struct riff_levelStackE *ls = level_current(rh);
+	int32_t lo = 0, hi = ls->crumbs_count;
+	//last breadcrumb before pos
+	while(lo < hi){
+		int32_t mid = lo + (hi - lo) / 2;
+		if(ls->crumbs[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(lo > i)
+		lo = i + 1;
+	if(ls->visit_pos != 0  &&  ls->visit_pos < pos  &&  ls->visit_index <= i  &&  ls->visit_index >= lo){
+		*index = ls->visit_index;
+		return level_seekPos(rh, ls->visit_pos);
+	}
+	if(lo > 0){
+		*index = lo - 1;
+		return level_seekPos(rh, ls->crumbs[lo - 1]);
+	}
+	*index = 0;
+	return riff_seekLevelStart(rh);
+}
+
+//description: see header file
+int riff_seekPrevChunk(riff_handle *rh){
+	checkValidRiffHandle(rh);
+
+	struct riff_levelStackE *ls = level_current(rh);
+	size_t target = rh->c_pos_start;
+	size_t first = (rh->ls_level > 0 ? ls->c_pos_start : rh->pos_start) + RIFF_CHUNK_DATA_OFFSET + 4;
+	if(target <= first)
+		return RIFF_ERROR_EOCL;
+
+	//walk forward until the next chunk is the current one
+	int32_t index;
+	int r = level_seekBefore(rh, target, INT32_MAX, &index);
+	while(r == RIFF_ERROR_NONE  &&  rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET + rh->c_size + rh->pad < target)
+		r = riff_seekNextChunk(rh);
+	return r;
+}
+
+//description: see header file
+int riff_seekChunkIndex(riff_handle *rh, int32_t i){
+	checkValidRiffHandle(rh);
+
+	struct riff_levelStackE *ls = level_current(rh);
+	if(i < 0)
+		return RIFF_ERROR_EOCL;
+	if(i < ls->crumbs_count)
+		return level_seekPos(rh, ls->crumbs[i]);
+	//known to be beyond the end, go to the last chunk
+	if(ls->child_count > 0  &&  i >= ls->child_count){
+		int r = riff_seekChunkIndex(rh, ls->child_count - 1);
+		return r != RIFF_ERROR_NONE ? r : RIFF_ERROR_EOCL;
+	}
+
+	int32_t index;
+	int r = level_seekBefore(rh, SIZE_MAX, i, &index);
+	while(r == RIFF_ERROR_NONE  &&  index < i){
+		r = riff_seekNextChunk(rh);
+		index++;
+	}
+	return r;
+}
+
+//description: see header file
+int riff_setBreadcrumbs(riff_handle *rh, int enable){
+	checkValidRiffHandle(rh);
+
+	rh->breadcrumbs = enable != 0;
+	if(!rh->breadcrumbs)
+		riff_levelFreeCrumbs(rh);
+	return RIFF_ERROR_NONE;
+}
+
 
 /*****************************************************************************/
 int riff_seekChunkStart(struct riff_handle *rh){
@@ -440,7 +831,7 @@ int riff_seekChunkStart(struct riff_handle *rh){
 	//seek data offset 0 in current chunk
 	rh->pos = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET;
 	rh->c_pos = 0;
-	rh->fp_seek(rh, rh->pos);
+	riff_ioSeek(rh, rh->pos);
 	return RIFF_ERROR_NONE;
 }
 
@@ -468,10 +859,12 @@ int riff_seekLevelStart(struct riff_handle *rh){
 		
 	rh->pos += RIFF_CHUNK_DATA_OFFSET + 4; //pos after type ID of chunk list
 	rh->c_pos = 0;
-	rh->fp_seek(rh, rh->pos);
+	riff_ioSeek(rh, rh->pos);
 
 	//read first chunk header, so we have the right values
 	int r = riff_readChunkHeader(rh);
+	if(r == RIFF_ERROR_NONE)
+		level_first(rh);
 	
 	//check possible?
 	return r;
@@ -479,49 +872,50 @@ int riff_seekLevelStart(struct riff_handle *rh){
 
 
 /*****************************************************************************/
-//description: see header file
-int riff_seekLevelSub(riff_handle *rh){
-	checkValidRiffHandle(rh);
-
+int seekLevelSub(riff_handle *rh){
 	//according to "https://en.wikipedia.org/wiki/Resource_Interchange_File_Format" only RIFF and LIST chunk IDs can contain subchunks
-	if(memcmp(rh->c_id, "LIST", 4) != 0  && memcmp(rh->c_id, "RIFF", 4) != 0 && memcmp(rh->c_id, "BW64", 4) != 0){
-		if(rh->fp_printf)
-			rh->fp_printf("%s() failed for chunk ID \"%s\", only RIFF or LIST chunk can contain subchunks", __func__, rh->c_id);
-		return RIFF_ERROR_ILLID;
-	}
+	if(memcmp(rh->c_id, "LIST", 4) != 0  && memcmp(rh->c_id, "RIFF", 4) != 0 && memcmp(rh->c_id, "BW64", 4) != 0)
+		return riff_report(rh, RIFF_ERROR_ILLID, RIFF_DIAG_NOT_LIST, rh->c_pos_start, rh->c_id, 0, 0);
 	
 	//check size of parent chunk data, must be at least 4 for type ID (is empty list allowed?)
-	if(rh->c_size < 4){
-		if(rh->fp_printf)
-			rh->fp_printf("Chunk too small to contain sub level chunks\n");
-		return RIFF_ERROR_ICSIZE;
-	}
+	if(rh->c_size < 4)
+		return riff_report(rh, RIFF_ERROR_ICSIZE, RIFF_DIAG_LIST_TOO_SMALL, rh->c_pos_start, rh->c_id, 4, rh->c_size);
 	
 	//seek to chunk start if not there, required to read type ID
 	if(rh->c_pos > 0) {
-		rh->fp_seek(rh, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET);
+		riff_ioSeek(rh, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET);
 		rh->pos = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET;
 		rh->c_pos = 0;
 	}
 	//read type ID
 	char type[5] = "";	// Init to 0
-	rh->fp_read(rh, type, 4);
+	riff_ioRead(rh, type, 4, 0);
 	rh->pos += 4;
 	//verify type ID
-	int i;
-	for(i = 0; i < 4; i++) {
-		if(type[i] < 0x20  ||  type[i] > 0x7e) {
-			if(rh->fp_printf)
-				rh->fp_printf("Invalid chunk type ID (FOURCC) of chunk at file pos %d: 0x%02x,0x%02x,0x%02x,0x%02x\n", rh->c_pos_start, type[0], type[1], type[2], type[3]);
-			return RIFF_ERROR_ILLID;
-		}
-	}
+	if(!riff_fourccValid(type))
+		return riff_report(rh, RIFF_ERROR_ILLID, RIFF_DIAG_LIST_TYPE, rh->c_pos_start, type, 0, 0);
 	
 	//add parent chunk data to stack
 	//push
 	stack_push(rh, type);
 	
-	return riff_readChunkHeader(rh);
+	int r = riff_readChunkHeader(rh);
+	if(r == RIFF_ERROR_NONE)
+		level_first(rh);
+	return r;
+}
+
+//description: see header file
+int riff_seekLevelSub(riff_handle *rh){
+	checkValidRiffHandle(rh);
+	
+	if(rh->fp_trace == NULL)
+		return seekLevelSub(rh);
+	
+	rh->fp_trace(rh, RIFF_TRACE_SEEK_LEVEL_SUB, RIFF_TRACE_BEGIN, 0);
+	int r = seekLevelSub(rh);
+	rh->fp_trace(rh, RIFF_TRACE_SEEK_LEVEL_SUB, RIFF_TRACE_END, r);
+	return r;
 }
 
 
@@ -555,13 +949,26 @@ int riff_seekLevelParentNext(struct riff_handle *rh){
 }
 
 
+/*****************************************************************************/
+//seek to the furthest chunk reached from the first chunk of the current level, or to the first chunk
+int level_seekVisited(riff_handle *rh){
+	struct riff_levelStackE *ls = level_current(rh);
+	if(ls->visit_pos == 0)
+		return riff_seekLevelStart(rh);
+	return level_seekPos(rh, ls->visit_pos);
+}
+
 /*****************************************************************************/
 int riff_levelValidate(struct riff_handle *rh){
 	checkValidRiffHandle(rh);
 
+	struct riff_levelStackE *ls = level_current(rh);
+	if(ls->validated)
+		return RIFF_ERROR_NONE;
+
 	int r;
-	//seek to start of current list
-	if((r = riff_seekLevelStart(rh)) != RIFF_ERROR_NONE)
+	//continue behind the chunks already passed, else seek to start of current list
+	if((r = level_seekVisited(rh)) != RIFF_ERROR_NONE)
 		return r;
 	
 	//seek all chunks of current list level
@@ -574,6 +981,7 @@ int riff_levelValidate(struct riff_handle *rh){
 			return r;
 		}
 	}
+	ls->validated = 1;
 	return RIFF_ERROR_NONE;
 }
 
@@ -583,19 +991,21 @@ int riff_levelValidate(struct riff_handle *rh){
 int riff_recursiveLevelValidate(struct riff_handle *rh){
 	int r;
 	while (1) {
-		r = riff_seekNextChunk(rh);
-		if (r != RIFF_ERROR_NONE) {
-			if (r == RIFF_ERROR_EOCL) {
-				// End of chunk list, time to come back
-				return riff_levelParent(rh);
-			} else return r; // Otherwise, some shit occured
-		}
+		// The current chunk is checked first, so the first chunk of a level is not skipped
 		if (!(memcmp(rh->c_id, "LIST", 4) != 0 && memcmp(rh->c_id, "RIFF", 4) != 0 && memcmp(rh->c_id, "BW64", 4) != 0)) { // If the chunk can contain subchunks
 			r = riff_seekLevelSub(rh);
 			if (r != RIFF_ERROR_NONE) return r;
 			r = riff_recursiveLevelValidate(rh);
 			if (r != RIFF_ERROR_NONE) return r;
 		}
+		r = riff_seekNextChunk(rh);
+		if (r != RIFF_ERROR_NONE) {
+			if (r == RIFF_ERROR_EOCL) {
+				// End of chunk list, time to come back (unless we're at the file level already)
+				if (rh->ls_level == 0) return RIFF_ERROR_NONE;
+				return riff_levelParent(rh);
+			} else return r; // Otherwise, some shit occured
+		}
 	}
 	return RIFF_ERROR_NONE;
 }
@@ -616,15 +1026,17 @@ int riff_fileValidate(struct riff_handle *rh){
 int32_t riff_amountOfChunksInLevel(struct riff_handle *rh){
 	checkValidRiffHandle(rh);
 
-	int32_t counter = 0;
+	struct riff_levelStackE *ls = level_current(rh);
+	if(ls->child_count > 0)
+		return ls->child_count;
+
 	int r;
-	//seek to start of current list
-	if((r = riff_seekLevelStart(rh)) != RIFF_ERROR_NONE)
+	//continue behind the chunks already counted, else seek to start of current list
+	if((r = level_seekVisited(rh)) != RIFF_ERROR_NONE)
 		return -1;
 	
-	//seek all chunks of current list level
+	//seek all chunks of current list level, the count is set at the end of the list
 	while(1){
-		counter++;
 		r = riff_seekNextChunk(rh);
 		if(r != RIFF_ERROR_NONE){
 			if(r == RIFF_ERROR_EOCL)  //just end of list
@@ -633,7 +1045,7 @@ int32_t riff_amountOfChunksInLevel(struct riff_handle *rh){
 			return -1;
 		}
 	}
-	return counter;
+	return ls->child_count;
 }
 
 /*****************************************************************************/
@@ -666,6 +1078,495 @@ const char *riff_errorToString(int e){
 	//map error to error string
 	//Make sure mapping is correct!
 	if (e >= 0 && e <= RIFF_ERROR_MAX) return riff_es[e];
-	else return riff_es[9];
+	else return riff_es[RIFF_ERROR_MAX + 1];
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_diagRingAllocate(riff_handle *rh, size_t size){
+	checkValidRiffHandle(rh);
+	
+	if(rh->diag_ring != NULL)
+		free(rh->diag_ring);
+	rh->diag_ring = NULL;
+	rh->diag_ring_size = 0;
+	rh->diag_count = 0;
+	
+	if(size == 0)
+		return RIFF_ERROR_NONE;
+	
+	rh->diag_ring = calloc(size, sizeof(struct riff_diag));
+	if(rh->diag_ring == NULL)
+		return RIFF_ERROR_MEMORY;
+	rh->diag_ring_size = size;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+const struct riff_diag *riff_diagGet(const riff_handle *rh, size_t age){
+	if(rh == NULL  ||  age >= rh->diag_count)
+		return NULL;
+	if(age == 0)
+		return &rh->diag;
+	if(rh->diag_ring == NULL  ||  age >= rh->diag_ring_size)
+		return NULL;
+	return rh->diag_ring + (rh->diag_count - 1 - age) % rh->diag_ring_size;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_diagClear(riff_handle *rh){
+	if(rh == NULL)
+		return;
+	memset(&rh->diag, 0, sizeof(struct riff_diag));
+	rh->diag_count = 0;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_diagToString(const struct riff_diag *d, char *buf, size_t size){
+	const char *msg = (d->kind >= 0 && d->kind <= RIFF_DIAG_MAX) ? riff_ds[d->kind] : riff_ds[RIFF_DIAG_MAX + 1];
+	int n = snprintf(buf, size, "%s (%s) at pos %zu", msg, riff_errorToString(d->code), d->pos);
+	
+	//append ID, as text if printable, otherwise as raw bytes
+	if(d->c_id[0] || d->c_id[1] || d->c_id[2] || d->c_id[3]){
+		size_t o = (n > 0 && (size_t)n < size) ? (size_t)n : size;
+		int i, printable = 1;
+		for(i = 0; i < 4; i++)
+			if(d->c_id[i] < 0x20  ||  d->c_id[i] > 0x7e)
+				printable = 0;
+		if(printable)
+			n += snprintf(buf + o, size - o, ", ID \"%.4s\"", d->c_id);
+		else
+			n += snprintf(buf + o, size - o, ", ID 0x%02x,0x%02x,0x%02x,0x%02x", (uint8_t)d->c_id[0], (uint8_t)d->c_id[1], (uint8_t)d->c_id[2], (uint8_t)d->c_id[3]);
+	}
+	
+	if(d->expected || d->actual){
+		size_t o = (n > 0 && (size_t)n < size) ? (size_t)n : size;
+		n += snprintf(buf + o, size - o, ", expected %zu, actual %zu", d->expected, d->actual);
+	}
+	return n;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_ioStatsReset(riff_handle *rh){
+	if(rh == NULL)
+		return;
+	size_t pos = rh->io.pos; //keep tracking the stream position
+	memset(&rh->io, 0, sizeof(struct riff_ioStats));
+	rh->io.pos = pos;
+}
+
+/*****************************************************************************/
+//description: see header file
+uint64_t riff_clockNs(void){
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+	//no monotonic clock available, fall back to processor time
+	return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_setAccessMode(riff_handle *rh, int mode){
+	checkValidRiffHandle(rh);
+	if(mode < RIFF_ACCESS_NORMAL  ||  mode > RIFF_ACCESS_STREAM)
+		return RIFF_ERROR_INVALID_HANDLE;
+	
+	rh->access_mode = mode;
+	rh->access_pos = rh->pos;
+	if(rh->fp_advise == NULL)
+		return RIFF_ERROR_NONE;
+	
+	static const int advice[] = {RIFF_ADVISE_NORMAL, RIFF_ADVISE_RANDOM, RIFF_ADVISE_SEQUENTIAL};
+	rh->fp_advise(rh, advice[mode], rh->pos_start, 0);
+	if(mode == RIFF_ACCESS_STREAM)
+		rh->fp_advise(rh, RIFF_ADVISE_WILLNEED, rh->pos, RIFF_ADVISE_WINDOW);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//append node to tree, link it to its parent and previous sibling
+//returns index of the new node or RIFF_TREE_NONE if allocation failed
+int32_t tree_add(struct riff_tree *tree, int32_t parent, int32_t prev){
+	if(tree->count >= tree->capacity){
+		int32_t capnew = tree->capacity * 2; //double size
+		if(capnew == 0)
+			capnew = 64;
+		struct riff_treeNode *nodesnew = realloc(tree->nodes, capnew * sizeof(struct riff_treeNode));
+		if(nodesnew == NULL)
+			return RIFF_TREE_NONE;
+		tree->nodes = nodesnew;
+		tree->capacity = capnew;
+	}
+	
+	int32_t n = tree->count++;
+	struct riff_treeNode *node = tree->nodes + n;
+	memset(node, 0, sizeof(struct riff_treeNode));
+	node->parent = parent;
+	node->first_child = RIFF_TREE_NONE;
+	node->next_sibling = RIFF_TREE_NONE;
+	if(parent != RIFF_TREE_NONE){
+		node->depth = tree->nodes[parent].depth + 1;
+		if(prev != RIFF_TREE_NONE)
+			tree->nodes[prev].next_sibling = n;
+		else
+			tree->nodes[parent].first_child = n;
+	}
+	return n;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_parseTree(riff_handle *rh, struct riff_tree *tree){
+	checkValidRiffHandle(rh);
+	if(tree == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	
+	tree->count = 0;
+	int r = riff_rewind(rh);
+	if(r >= RIFF_ERROR_CRITICAL)
+		return r;
+	
+	//in memory, scan the headers directly
+	//anything irregular is left to the walk below, so diagnostics are the same in both cases
+	const void *map = NULL;
+	if(r == RIFF_ERROR_NONE  &&  rh->fp_map != NULL  &&  rh->fp_trace == NULL)
+		map = rh->fp_map(rh, rh->pos_start, RIFF_CHUNK_DATA_OFFSET + rh->h_size);
+	if(map != NULL){
+		int32_t count;
+		r = riff_scanBuffer(map, RIFF_CHUNK_DATA_OFFSET + rh->h_size, tree->nodes, tree->capacity, &count);
+		if(r == RIFF_ERROR_NONE  &&  count > tree->capacity){
+			struct riff_treeNode *nodesnew = realloc(tree->nodes, count * sizeof(struct riff_treeNode));
+			if(nodesnew == NULL)
+				return RIFF_ERROR_MEMORY;
+			tree->nodes = nodesnew;
+			tree->capacity = count;
+			r = riff_scanBuffer(map, RIFF_CHUNK_DATA_OFFSET + rh->h_size, tree->nodes, tree->capacity, &count);
+		}
+		if(r == RIFF_ERROR_NONE){
+			int32_t i;
+			for(i = 0; i < count; i++)
+				tree->nodes[i].c_pos_start += rh->pos_start;
+			tree->count = count;
+			return RIFF_ERROR_NONE;
+		}
+		tree->count = 0;
+	}
+	
+	//RIFF header node
+	if(tree_add(tree, RIFF_TREE_NONE, RIFF_TREE_NONE) == RIFF_TREE_NONE)
+		return RIFF_ERROR_MEMORY;
+	struct riff_treeNode *node = tree->nodes;
+	node->c_pos_start = rh->pos_start;
+	node->c_size = rh->h_size;
+	memcpy(node->c_id, rh->h_id, 4);
+	memcpy(node->c_type, rh->h_type, 4);
+	
+	int32_t parent = 0;              //node of the current list level
+	int32_t prev = RIFF_TREE_NONE;   //previous node in the current list level
+	
+	while(1){
+		int32_t n = tree_add(tree, parent, prev);
+		if(n == RIFF_TREE_NONE)
+			return RIFF_ERROR_MEMORY;
+		node = tree->nodes + n;
+		node->c_pos_start = rh->c_pos_start;
+		node->c_size = rh->c_size;
+		memcpy(node->c_id, rh->c_id, 4);
+		prev = n;
+		
+		//descend into lists
+		if(memcmp(rh->c_id, "LIST", 4) == 0  ||  memcmp(rh->c_id, "RIFF", 4) == 0  ||  memcmp(rh->c_id, "BW64", 4) == 0){
+			int level = rh->ls_level;
+			r = riff_seekLevelSub(rh);
+			if(rh->ls_level > level) //type ID was read
+				memcpy(node->c_type, rh->ls[level].c_type, 4);
+			if(r == RIFF_ERROR_NONE){
+				parent = n;
+				prev = RIFF_TREE_NONE;
+				continue;
+			}
+			//an empty list has no first chunk to read, anything else is an error
+			if(rh->ls_level == level  ||  rh->ls[level].c_size > 4)
+				return r;
+			riff_levelParent(rh);
+		}
+		
+		//seek to the next chunk, go up a level for every finished list
+		while((r = riff_seekNextChunk(rh)) != RIFF_ERROR_NONE){
+			if(r >= RIFF_ERROR_CRITICAL)
+				return r;
+			if(rh->ls_level == 0)
+				return RIFF_ERROR_NONE;
+			riff_levelParent(rh);
+			prev = parent;
+			parent = tree->nodes[parent].parent;
+		}
+	}
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_treeFree(struct riff_tree *tree){
+	if(tree == NULL)
+		return;
+	if(tree->nodes != NULL)
+		free(tree->nodes);
+	tree->nodes = NULL;
+	tree->count = 0;
+	tree->capacity = 0;
+}
+
+/*****************************************************************************/
+//description: see header file
+int32_t riff_treeFind(const struct riff_tree *tree, int32_t root, int32_t from, const char *id){
+	if(tree == NULL  ||  root < 0  ||  root >= tree->count  ||  from < root)
+		return RIFF_TREE_NONE;
+	
+	//subtree of root is contiguous and ends at the first node that is not deeper than root
+	int32_t depth = tree->nodes[root].depth;
+	int32_t i;
+	for(i = from + 1; i < tree->count  &&  tree->nodes[i].depth > depth; i++){
+		const struct riff_treeNode *node = tree->nodes + i;
+		if(memcmp(node->c_id, id, 4) == 0  ||  memcmp(node->c_type, id, 4) == 0)
+			return i;
+	}
+	return RIFF_TREE_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_seekTreeNode(riff_handle *rh, const struct riff_tree *tree, int32_t node){
+	checkValidRiffHandle(rh);
+	if(tree == NULL  ||  node < 0  ||  node >= tree->count)
+		return RIFF_ERROR_INVALID_HANDLE;
+	
+	int r = riff_rewind(rh);
+	if(r >= RIFF_ERROR_CRITICAL  ||  node == 0)
+		return r;
+	
+	//enter the parent lists top down, starting at depth 1
+	int32_t depth = tree->nodes[node].depth;
+	int32_t d;
+	for(d = 1; d <= depth; d++){
+		int32_t n = node;
+		while(tree->nodes[n].depth > d)
+			n = tree->nodes[n].parent;
+		
+		rh->pos = tree->nodes[n].c_pos_start;
+		rh->c_pos = 0;
+		riff_ioSeek(rh, rh->pos);
+		if((r = riff_readChunkHeader(rh)) != RIFF_ERROR_NONE)
+			return r;
+		if(d < depth  &&  (r = riff_seekLevelSub(rh)) != RIFF_ERROR_NONE)
+			return r;
+	}
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//parse ID of a path step into 4 space padded chars, returns end of ID or NULL on syntax error
+const char *path_parseID(const char *str, char *id){
+	size_t len = strcspn(str, ":[/");
+	if(len == 0  ||  len > 4)
+		return NULL;
+	memset(id, ' ', 4);
+	memcpy(id, str, len);
+	id[4] = 0;
+	if(len == 1  &&  str[0] == '*')
+		id[1] = 0; //wildcard
+	return str + len;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_pathCompile(struct riff_path *path, const char *str){
+	if(path == NULL  ||  str == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	memset(path, 0, sizeof(struct riff_path));
+	
+	if(*str == '/')
+		str++;
+	
+	//every '/' separates 2 steps
+	int32_t count = 1;
+	const char *c;
+	for(c = str; *c; c++)
+		if(*c == '/')
+			count++;
+	
+	path->steps = calloc(count, sizeof(struct riff_pathStep));
+	if(path->steps == NULL)
+		return RIFF_ERROR_MEMORY;
+	path->count = count;
+	
+	int32_t i;
+	for(i = 0; i < count; i++){
+		struct riff_pathStep *st = path->steps + i;
+		st->index = -1;
+		if((str = path_parseID(str, st->c_id)) == NULL)
+			break;
+		if(*str == ':'){
+			if((str = path_parseID(str + 1, st->c_type)) == NULL)
+				break;
+		}
+		if(*str == '['){
+			char *end;
+			long index = strtol(str + 1, &end, 10);
+			if(end == str + 1  ||  *end != ']'  ||  index < 0)
+				break;
+			st->index = (int32_t)index;
+			str = end + 1;
+		}
+		if(*str != (i + 1 < count ? '/' : 0))
+			break;
+		str++;
+	}
+	if(i < count){
+		riff_pathFree(path);
+		return RIFF_ERROR_ILLID;
+	}
+	
+	path->header = memcmp(path->steps[0].c_id, "RIFF", 4) == 0  ||  memcmp(path->steps[0].c_id, "BW64", 4) == 0;
+	return RIFF_ERROR_NONE;
 }
 
+/*****************************************************************************/
+//description: see header file
+void riff_pathFree(struct riff_path *path){
+	if(path == NULL)
+		return;
+	if(path->steps != NULL)
+		free(path->steps);
+	memset(path, 0, sizeof(struct riff_path));
+}
+
+/*****************************************************************************/
+//match ID of path step, wildcard or ID
+int path_matchID(const char *pattern, const char *id){
+	return (pattern[0] == '*'  &&  pattern[1] == 0)  ||  memcmp(pattern, id, 4) == 0;
+}
+
+/*****************************************************************************/
+//visit matches of path step s in the current list level, the handle is at the first chunk of the level
+//returns when the level is done (same level as on entry) or when stopped (level of the match)
+int path_level(riff_handle *rh, const struct riff_path *path, int32_t s, int (*cb)(riff_handle *rh, void *user), void *user, int *stop){
+	const struct riff_pathStep *st = path->steps + s;
+	int32_t nmatch = 0;
+	int r;
+	
+	while(1){
+		if(path_matchID(st->c_id, rh->c_id)){
+			int list = memcmp(rh->c_id, "LIST", 4) == 0  ||  memcmp(rh->c_id, "RIFF", 4) == 0  ||  memcmp(rh->c_id, "BW64", 4) == 0;
+			int entered = 0;
+			int match = 1;
+			
+			//only the type ID at the start of the list data is read, lists of other types are not entered
+			if(st->c_type[0]){
+				char type[4];
+				match = list  &&  rh->c_size >= 4  &&  riff_seekInChunk(rh, 0) == RIFF_ERROR_NONE
+					&&  riff_readInChunk(rh, type, 4) == 4  &&  path_matchID(st->c_type, type);
+			}
+			
+			if(match){
+				if(st->index < 0  ||  nmatch == st->index){
+					if(s + 1 == path->count){
+						riff_seekChunkStart(rh);
+						if(cb(rh, user)){
+							*stop = 1;
+							return RIFF_ERROR_NONE;
+						}
+					}
+					else if(list){
+						int level = rh->ls_level;
+						r = riff_seekLevelSub(rh);
+						entered = rh->ls_level > level; //also for an empty list
+						if(r == RIFF_ERROR_NONE){
+							r = path_level(rh, path, s + 1, cb, user, stop);
+							if(r >= RIFF_ERROR_CRITICAL  ||  *stop)
+								return r;
+						}
+					}
+				}
+				nmatch++;
+			}
+			if(entered)
+				riff_levelParent(rh);
+			
+			//selected chunk was visited, prune its siblings
+			if(st->index >= 0  &&  nmatch > st->index)
+				return RIFF_ERROR_NONE;
+		}
+		
+		r = riff_seekNextChunk(rh);
+		if(r != RIFF_ERROR_NONE)
+			return r >= RIFF_ERROR_CRITICAL ? r : RIFF_ERROR_NONE;
+	}
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_pathForEach(riff_handle *rh, const struct riff_path *path, int (*cb)(riff_handle *rh, void *user), void *user){
+	checkValidRiffHandle(rh);
+	if(path == NULL  ||  path->count == 0  ||  cb == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	
+	int r = riff_rewind(rh);
+	if(r >= RIFF_ERROR_CRITICAL)
+		return r;
+	
+	int32_t s = 0;
+	if(path->header){
+		const struct riff_pathStep *st = path->steps;
+		if(!path_matchID(st->c_id, rh->h_id)  ||  (st->c_type[0]  &&  !path_matchID(st->c_type, rh->h_type))  ||  st->index > 0)
+			return RIFF_ERROR_NONE;
+		s++;
+		//path only consists of the header, matches first chunk
+		if(s == path->count){
+			cb(rh, user);
+			return RIFF_ERROR_NONE;
+		}
+	}
+	
+	int stop = 0;
+	return path_level(rh, path, s, cb, user, &stop);
+}
+
+/*****************************************************************************/
+//path callback stopping at the first match
+int path_first(riff_handle *rh, void *user){
+	(void)rh;
+	*(int *)user = 1;
+	return 1;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_seekPathCompiled(riff_handle *rh, const struct riff_path *path){
+	int found = 0;
+	int r = riff_pathForEach(rh, path, path_first, &found);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	return found ? RIFF_ERROR_NONE : RIFF_ERROR_EOCL;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_seekPath(riff_handle *rh, const char *str){
+	checkValidRiffHandle(rh);
+	
+	struct riff_path path;
+	int r = riff_pathCompile(&path, str);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	r = riff_seekPathCompiled(rh, &path);
+	riff_pathFree(&path);
+	return r;
+}
@@ -20,10 +20,28 @@ void * try_calloc(size_t nmemb, size_t size, const char * const objName) {
     return ptr;
 }
 
+// breadcrumbs are not copied, the copy records its own as it walks
+void drop_crumbs(riff_handle *rh) {
+    rh->ls_root.crumbs = nullptr;
+    rh->ls_root.crumbs_count = rh->ls_root.crumbs_size = 0;
+    for (size_t i = 0; rh->ls != nullptr && i < rh->ls_size; i++) {
+        rh->ls[i].crumbs = nullptr;
+        rh->ls[i].crumbs_count = rh->ls[i].crumbs_size = 0;
+    }
+}
+
+// a copy takes its own reference on a source released by fp_close, or is refused
+bool share_source(riff_handle *rh) {
+    if (rh->fp_close == nullptr) return true;
+    if (rh->fp_dup != nullptr && rh->fp_dup(rh) == RIFF_ERROR_NONE) return true;
+    fprintf(stderr, "Could not share the source of the riff_handle, aborting copy of RIFFFile\n");
+    return false;
+}
+
 RIFFFile::RIFFFile() {
     rh = riff_handleAllocate();
-    #if !RIFF_CXX_PRINT_ERRORS
-        rh->fp_printf = NULL;
+    #if RIFF_CXX_PRINT_ERRORS
+        rh->fp_printf = riff_printf;
     #endif
 }
 
@@ -35,12 +53,24 @@ RIFFFile & RIFFFile::operator = (const RIFFFile &rhs) {
     // Copy the riff_handle
     auto newrh = (riff_handle *)try_calloc(1, sizeof(riff_handle), "riff_handle, aborting copy assignment of RIFFFile");
     if (newrh == nullptr) return *this;
-    memcpy(rh, rhs.rh, sizeof(riff_handle));
+    memcpy(newrh, rhs.rh, sizeof(riff_handle));
+    newrh->prefetch = nullptr;  // the prefetch thread belongs to the original handle
+    if (!share_source(newrh)) {
+        free(newrh);
+        return *this;
+    }
 
     if (newrh->ls) {
-        newrh->ls = (struct riff_levelStackE *)try_calloc(rh->ls_size, sizeof(struct riff_levelStackE), "riff level stack, aborting copy assignment of RIFFFile");
+        newrh->ls = (struct riff_levelStackE *)try_calloc(newrh->ls_size, sizeof(struct riff_levelStackE), "riff level stack, aborting copy assignment of RIFFFile");
         if (newrh->ls == nullptr) return *this;
-        memcpy(newrh->ls, rhs.rh->ls, rh->ls_size * sizeof(struct riff_levelStackE));
+        memcpy(newrh->ls, rhs.rh->ls, newrh->ls_size * sizeof(struct riff_levelStackE));
+    }
+    drop_crumbs(newrh);
+
+    if (newrh->diag_ring) {
+        newrh->diag_ring = (struct riff_diag *)try_calloc(newrh->diag_ring_size, sizeof(struct riff_diag), "riff diagnostic ring, aborting copy assignment of RIFFFile");
+        if (newrh->diag_ring == nullptr) return *this;
+        memcpy(newrh->diag_ring, rhs.rh->diag_ring, newrh->diag_ring_size * sizeof(struct riff_diag));
     }
 
     if (rh) die();
@@ -48,6 +78,7 @@ RIFFFile & RIFFFile::operator = (const RIFFFile &rhs) {
     // Copy the data
     memcpy(this, &rhs, sizeof(RIFFFile));
     rh = newrh;
+    type |= MANUAL;  // the file is closed by the original
 
     return *this;
 }
@@ -56,17 +87,31 @@ RIFFFile & RIFFFile::operator = (const RIFFFile &rhs) {
 RIFFFile::RIFFFile(const RIFFFile &rhs) {
     // Copy the data
     memcpy(this, &rhs, sizeof(RIFFFile));
+    type |= MANUAL;  // the file is closed by the original
 
     // Copy the riff_handle
     rh = (riff_handle *)try_calloc(1, sizeof(riff_handle), "riff_handle, aborting copy assignment of RIFFFile");
     if (rh == nullptr) return;
     memcpy(rh, rhs.rh, sizeof(riff_handle));
+    rh->prefetch = nullptr;  // the prefetch thread belongs to the original handle
+    if (!share_source(rh)) {
+        free(rh);
+        rh = nullptr;
+        return;
+    }
 
     if (rh->ls) {
         rh->ls = (struct riff_levelStackE *)try_calloc(rh->ls_size, sizeof(struct riff_levelStackE), "riff level stack, aborting copy assignment of RIFFFile");
         if (rh->ls == nullptr) return;
         memcpy(rh->ls, rhs.rh->ls, rh->ls_size * sizeof(struct riff_levelStackE));
     }
+    drop_crumbs(rh);
+
+    if (rh->diag_ring) {
+        rh->diag_ring = (struct riff_diag *)try_calloc(rh->diag_ring_size, sizeof(struct riff_diag), "riff diagnostic ring, aborting copy construction of RIFFFile");
+        if (rh->diag_ring == nullptr) return;
+        memcpy(rh->diag_ring, rhs.rh->diag_ring, rh->diag_ring_size * sizeof(struct riff_diag));
+    }
 }
 
 // move assignment
@@ -96,8 +141,8 @@ RIFFFile::~RIFFFile() {
 }
 
 void RIFFFile::die() {
-    riff_handleFree(rh);
     close();
+    riff_handleFree(rh);
 }
 
 void RIFFFile::reset() {
@@ -144,6 +189,22 @@ int RIFFFile::openMemory (const void * __mem_ptr, size_t __size) {
 
 #pragma endregion 
 
+#pragma region openFd
+
+int RIFFFile::openFd (int __fd, size_t __size) {
+    file = nullptr;
+    type = FD|MANUAL;
+    return riff_open_fd(rh, __fd, __size);
+}
+
+int RIFFFile::openMmap (int __fd, size_t __size) {
+    file = nullptr;
+    type = FD|MANUAL;
+    return riff_open_mmap(rh, __fd, __size);
+}
+
+#pragma endregion
+
 #pragma region fstreamHandling
 
 size_t read_fstream(riff_handle *rh, void *ptr, size_t size){
@@ -212,6 +273,7 @@ int RIFFFile::openFstreamCommon(size_t __size){
     // My own open function lmfao
     if(rh == NULL)
 		return RIFF_ERROR_INVALID_HANDLE;
+	riff_handleClose(rh);
 	rh->fh = file;
 	rh->size = __size;
 	rh->pos_start = stream->tellg(); //current file offset of stream considered as start of RIFF file
@@ -225,13 +287,13 @@ int RIFFFile::openFstreamCommon(size_t __size){
 #pragma endregion
 
 void RIFFFile::close () {
+    riff_handleClose(rh); // releases a mapping of openMmap()
     if (!(type & MANUAL)) { // Must be automatically allocated to close
         if (type == C_FILE) {
-            std::fclose((std::FILE *)file);
-            free (file);
+            std::fclose((std::FILE *)file); // also frees the FILE
         } else if (type == FSTREAM) {
             ((std::fstream *)file)->close();
-            free (file);
+            delete (std::fstream *)file; // allocated by setAutomaticFstream()
         }
     }
     type = CLOSED;
@@ -252,7 +314,42 @@ std::string RIFFFile::latestErrorToString () {
     #undef posStrSize
 }
 
+std::string RIFFFile::diagToString (size_t age) {
+    auto d = riff_diagGet(rh, age);
+    if (d == nullptr) return "";
+
+    int len = riff_diagToString(d, nullptr, 0);
+    std::string outString(len, '\0');
+    riff_diagToString(d, &outString[0], len + 1);
+    return outString;
+}
+
+int RIFFFile::pathForEach (const riff_path & path, const std::function<bool ()> & visitor) {
+    auto cb = [](riff_handle *, void * user) -> int {
+        return (*(const std::function<bool ()> *)user)() ? 1 : 0;
+    };
+    return __latestError = riff_pathForEach(rh, &path, cb, (void *)&visitor);
+}
+
+std::vector<uint64_t> RIFFFile::hashTree (const riff_tree & tree, int algo, int threads) {
+    auto hashes = std::vector<uint64_t>(tree.count);
+    __latestError = riff_hashTree(rh, &tree, algo, threads, hashes.data());
+    if (__latestError) hashes.clear();
+    return hashes;
+}
+
+int RIFFFile::diff (RIFFFile & other, const std::function<bool (int, const riff_treeNode *, const riff_treeNode *)> & visitor, int flags) {
+    auto cb = [](int event, const riff_treeNode * a, const riff_treeNode * b, void * user) -> int {
+        return (*(const std::function<bool (int, const riff_treeNode *, const riff_treeNode *)> *)user)(event, a, b) ? 1 : 0;
+    };
+    return __latestError = riff_diff(rh, other.rh, flags, cb, (void *)&visitor);
+}
+
 std::vector<uint8_t> RIFFFile::readChunkData() {
+    if (rh->cache) {
+        ChunkView view = readChunkView();
+        return std::vector<uint8_t>(view.data(), view.data() + view.size());
+    }
     __latestError = seekChunkStart(); 
     if (__latestError || rh->c_size == 0) {
         return std::vector<uint8_t>(0);
@@ -271,6 +368,209 @@ std::vector<uint8_t> RIFFFile::readChunkData() {
     return outVec;
 }
 
+ChunkView RIFFFile::readChunkView() {
+    const riff_chunkView * view = nullptr;
+    __latestError = riff_readChunkView(rh, &view);
+    return ChunkView(__latestError == RIFF_ERROR_NONE ? view : nullptr);
+}
+
+#pragma region schema
+
+const char * Schema::kindToString (int kind) {
+    static const char * names[] = {
+        "No violation",
+        "Form type does not match",
+        "Unexpected chunk",
+        "Chunk out of order",
+        "Chunk appears too often",
+        "Required chunk missing",
+        "Chunk too small"
+    };
+    return (kind >= NONE && kind <= TOO_SMALL) ? names[kind] : "Unknown violation";
+}
+
+// report a violation, returns the RIFF error code for it
+static int schemaViolation (Schema::Violation & violation, int kind, size_t pos, const char * id, const Schema::Rule * rule) {
+    violation.kind = kind;
+    violation.pos = pos;
+    std::memcpy(violation.id, id, 4);
+    violation.id[4] = 0;
+    violation.rule = rule;
+    return kind == Schema::TOO_SMALL ? RIFF_ERROR_ICSIZE : RIFF_ERROR_ILLID;
+}
+
+int RIFFFile::validateSchema (const Schema::Rule & schema, Schema::Violation * violation) {
+    Schema::Violation local;
+    Schema::Violation & v = violation ? *violation : local;
+    v = Schema::Violation();
+
+    if (rewind() >= RIFF_ERROR_CRITICAL) return __latestError;
+    if (schema.type && std::memcmp(rh->h_type, schema.type, 4))
+        return __latestError = schemaViolation(v, Schema::FORM, rh->pos_start, rh->h_id, &schema);
+    if (rh->h_size < schema.minSize)
+        return __latestError = schemaViolation(v, Schema::TOO_SMALL, rh->pos_start, rh->h_id, &schema);
+    return __latestError = validateLevel(schema, rh->h_size <= 4, v);
+}
+
+// check the current level against the children of rule, the handle is at the first chunk of the level
+int RIFFFile::validateLevel (const Schema::Rule & rule, bool empty, Schema::Violation & v) {
+    std::vector<unsigned> counts(rule.count, 0);
+    size_t level_pos = rh->ls_level > 0 ? rh->ls[rh->ls_level - 1].c_pos_start : rh->pos_start;
+    size_t cur = 0;  // current rule of ORDERED lists
+    int r = RIFF_ERROR_NONE;
+
+    while (!empty) {
+        size_t pos = rh->c_pos_start, size = rh->c_size;
+        char id[5] = {0}, type[5] = {0};
+        std::memcpy(id, rh->c_id, 4);
+
+        // enter lists to read their type
+        bool entered = false, sub_empty = false;
+        if ((!std::memcmp(id, "LIST", 4) || !std::memcmp(id, "RIFF", 4) || !std::memcmp(id, "BW64", 4)) && size >= 4) {
+            int level = rh->ls_level;
+            r = seekLevelSub();
+            if (rh->ls_level == level) return r;
+            std::memcpy(type, rh->ls[level].c_type, 4);
+            entered = true;
+            if (r != RIFF_ERROR_NONE) {
+                if (size > 4) return r;  // an empty list has no first chunk, anything else is an error
+                sub_empty = true;
+            }
+        }
+
+        size_t k;
+        for (k = 0; k < rule.count; k++) {
+            const Schema::Rule & c = rule.children[k];
+            if (!std::memcmp(c.id, id, 4) && (!c.type || !std::memcmp(c.type, type, 4)))
+                break;
+        }
+
+        if (k == rule.count) {
+            if (rule.flags & Schema::STRICT) return schemaViolation(v, Schema::UNEXPECTED, pos, id, nullptr);
+        } else {
+            const Schema::Rule & c = rule.children[k];
+            if (rule.flags & Schema::ORDERED) {
+                if (k < cur) return schemaViolation(v, Schema::ORDER, pos, id, &c);
+                for (; cur < k; cur++)
+                    if (counts[cur] < rule.children[cur].min)
+                        return schemaViolation(v, Schema::MISSING, level_pos, rule.children[cur].id, rule.children + cur);
+            }
+            if (++counts[k] > c.max && c.max != Schema::UNBOUNDED) return schemaViolation(v, Schema::TOO_MANY, pos, id, &c);
+            if (size < c.minSize) return schemaViolation(v, Schema::TOO_SMALL, pos, id, &c);
+            if (entered && c.children && (r = validateLevel(c, sub_empty, v)) != RIFF_ERROR_NONE) return r;
+        }
+        if (entered) levelParent();
+
+        if ((r = seekNextChunk()) != RIFF_ERROR_NONE) {
+            if (r >= RIFF_ERROR_CRITICAL) return r;
+            break;
+        }
+    }
+
+    for (size_t k = 0; k < rule.count; k++)
+        if (counts[k] < rule.children[k].min)
+            return schemaViolation(v, Schema::MISSING, level_pos, rule.children[k].id, rule.children + k);
+    return RIFF_ERROR_NONE;
+}
+
+#pragma endregion
+
+#if RIFF_CXX20_COROUTINES
+
+#pragma region coroutines
+
+ThreadExecutor::ThreadExecutor () : thread(&ThreadExecutor::run, this) {}
+
+ThreadExecutor::~ThreadExecutor () {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    ready.notify_one();
+    thread.join();
+}
+
+bool ThreadExecutor::execute (std::function<void ()> work, std::coroutine_handle<> cont) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.emplace_back(std::move(work), cont);
+    }
+    ready.notify_one();
+    return true;
+}
+
+void ThreadExecutor::run () {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        ready.wait(guard, [this] {return stop || !queue.empty();});
+        if (queue.empty()) break;  // stopped and drained
+        auto job = std::move(queue.front());
+        queue.pop_front();
+        guard.unlock();
+        job.first();
+        job.second.resume();
+        guard.lock();
+    }
+}
+
+AsyncGenerator<riff_treeNode> RIFFFile::walkAsync (Executor & ex) {
+    int r = co_await AsyncOp<int>(ex, [this] {return rewind();});
+    if (r >= RIFF_ERROR_CRITICAL) co_return;
+
+    riff_treeNode node;
+    node.parent = node.first_child = node.next_sibling = RIFF_TREE_NONE;
+    for (;;) {
+        node.c_pos_start = rh->c_pos_start;
+        node.c_size = rh->c_size;
+        std::memcpy(node.c_id, rh->c_id, 5);
+        std::memset(node.c_type, 0, 5);
+        node.depth = rh->ls_level + 1;
+
+        // descend into lists, the type ID is known afterwards
+        bool entered = false;
+        if (!std::memcmp(rh->c_id, "LIST", 4) || !std::memcmp(rh->c_id, "RIFF", 4) || !std::memcmp(rh->c_id, "BW64", 4)) {
+            int level = rh->ls_level;
+            r = co_await seekLevelSubAsync(ex);
+            if (rh->ls_level > level) // type ID was read
+                std::memcpy(node.c_type, rh->ls[level].c_type, 4);
+            if (r == RIFF_ERROR_NONE)
+                entered = true;
+            else if (rh->ls_level == level || rh->ls[level].c_size > 4)
+                co_return;  // an empty list has no first chunk, anything else is an error
+            else
+                levelParent();
+        }
+        co_yield node;
+        if (entered) continue;
+
+        // seek to the next chunk, go up a level for every finished list
+        while ((r = co_await nextChunkAsync(ex)) != RIFF_ERROR_NONE) {
+            if (r >= RIFF_ERROR_CRITICAL || rh->ls_level == 0) co_return;
+            levelParent();
+        }
+    }
+}
+
+#pragma endregion
+
+#endif
+
+BatchScanner::Result BatchScanner::scan (const std::vector<std::string> & paths, const std::function<int (riff_handle *, const riff_batchTask &)> & visitor) {
+    std::vector<const char *> cpaths;
+    cpaths.reserve(paths.size());
+    for (const auto & path : paths) {
+        cpaths.push_back(path.c_str());
+    }
+    auto cb = [](riff_handle * rh, const riff_batchTask * task, void * user) -> int {
+        return (*(const std::function<int (riff_handle *, const riff_batchTask &)> *)user)(rh, *task);
+    };
+    Result result;
+    result.errors.resize(paths.size());
+    std::memset(&result.stats, 0, sizeof(result.stats));
+    result.error = riff_batch(cpaths.data(), cpaths.size(), threads, splitSize, cb, (void *)&visitor, result.errors.data(), &result.stats);
+    return result;
+}
+
 }   // namespace RIFF
 
 #endif  // __RIFF_CPP__
\ No newline at end of file
@@ -136,440 +136,2440 @@ Due to the size fields being 4 bytes, this library may not work for RIFF files l
  */
 #define RIFF_ERROR_INVALID_HANDLE	8
 
+/**
+ * @brief Memory allocation failed.
+ */
+#define RIFF_ERROR_MEMORY	9
+
 ///@}
 
 /**
  * @brief The last RIFF_ERROR code.
  */
-#define RIFF_ERROR_MAX 8
+#define RIFF_ERROR_MAX 9
 
 ///@}
 
 /**
- * @brief Level stack entry struct.
- *
- * Needed to retrace from sublevel (list) chunks.
+ * @defgroup Diagnostics Diagnostic records
  * 
- * (sorta) Contains header info of the parent level.
+ * Every error path stores a structured record in the riff_handle instead of formatting a message.
+ * 
+ * The text is only formatted on demand via riff_diagToString(), or if riff_handle::fp_printf is set.
+ * @{
  */
-struct riff_levelStackE {
+
+/**
+ * @name Diagnostic kinds
+ * 
+ * Stored in riff_diag::kind, tells exactly which check failed.
+ * @{
+ */
+
+/**
+ * @brief No diagnostic.
+ */
+#define RIFF_DIAG_NONE				0
+/**
+ * @brief The I/O function pointers of the riff_handle are not set.
+ */
+#define RIFF_DIAG_NO_IO				1
+/**
+ * @brief The RIFF file header could not be read completely.
+ * 
+ * riff_diag::expected and riff_diag::actual contain the requested and read byte counts.
+ */
+#define RIFF_DIAG_HEADER_SHORT		2
+/**
+ * @brief The RIFF file header ID is neither `"RIFF"` nor `"BW64"`.
+ */
+#define RIFF_DIAG_HEADER_ID			3
+/**
+ * @brief The ds64 chunk is too small to contain the 64-bit file size.
+ * 
+ * riff_diag::expected and riff_diag::actual contain the required and read byte counts.
+ */
+#define RIFF_DIAG_DS64_SHORT		4
+/**
+ * @brief The RIFF header size does not match the size passed to the open function.
+ * 
+ * riff_diag::expected is the size according to the header, riff_diag::actual is the given file size.
+ */
+#define RIFF_DIAG_SIZE_MISMATCH		5
+/**
+ * @brief A chunk header could not be read completely.
+ * 
+ * riff_diag::expected and riff_diag::actual contain the requested and read byte counts.
+ */
+#define RIFF_DIAG_CHUNK_HEADER_SHORT	6
+/**
+ * @brief A chunk ID contains non-printable characters.
+ */
+#define RIFF_DIAG_CHUNK_ID			7
+/**
+ * @brief A chunk exceeds the end of its parent list.
+ * 
+ * riff_diag::expected is the end position of the list, riff_diag::actual is the end position of the chunk.
+ */
+#define RIFF_DIAG_CHUNK_EXCEEDS_LIST	8
+/**
+ * @brief A chunk exceeds the end of the file.
+ * 
+ * riff_diag::expected is the file size, riff_diag::actual is the end position of the chunk.
+ */
+#define RIFF_DIAG_CHUNK_EXCEEDS_FILE	9
+/**
+ * @brief Excess bytes at the end of a chunk list.
+ * 
+ * riff_diag::actual contains the amount of excess bytes.
+ */
+#define RIFF_DIAG_EXCESS_BYTES		10
+/**
+ * @brief Tried to enter a sub level of a chunk that is not RIFF, LIST or BW64.
+ */
+#define RIFF_DIAG_NOT_LIST			11
+/**
+ * @brief A list chunk is too small to contain its type ID.
+ * 
+ * riff_diag::expected is the minimal size, riff_diag::actual is the chunk size.
+ */
+#define RIFF_DIAG_LIST_TOO_SMALL	12
+/**
+ * @brief A list type ID contains non-printable characters.
+ */
+#define RIFF_DIAG_LIST_TYPE			13
+/**
+ * @brief The data of a chunk could not be read completely.
+ * 
+ * riff_diag::expected and riff_diag::actual contain the requested and read byte counts.
+ */
+#define RIFF_DIAG_CHUNK_DATA_SHORT	14
+
+/**
+ * @brief The last RIFF_DIAG kind.
+ */
+#define RIFF_DIAG_MAX 14
+
+///@}
+
+/**
+ * @brief Structured diagnostic record.
+ * 
+ * Filled in by the library whenever an error is detected, costs no formatting.
+ */
+struct riff_diag {
 	/**
-	 * @brief Absolute parent chunk position in file stream.
+	 * @brief RIFF error code returned to the caller.
 	 */
-	size_t c_pos_start;
+	int code;
 	/**
-	 * @brief ID of parent chunk.
-	 *
-	 * The first 4 bytes of RIFF/LIST chunk data.
+	 * @brief RIFF_DIAG kind, tells which check failed.
 	 */
-	char c_id[5];
+	int kind;
 	/**
-	 * @brief Parent chunk size.
-	 *
-	 * Without header (contains value as stored in RIFF file).
+	 * @brief Absolute position in the file stream the problem occured at.
 	 */
-	size_t c_size;
+	size_t pos;
 	/**
-	 * @brief Type ID of parent chunk.
+	 * @brief ID of the offending chunk, if any.
 	 * 
-	 * Should either be RIFF, LIST or BW64.
+	 * Raw bytes as found in the file, contains terminator.
 	 */
-	char c_type[5];
+	char c_id[5];
+	/**
+	 * @brief Expected value, meaning depends on riff_diag::kind.
+	 */
+	size_t expected;
+	/**
+	 * @brief Actual value, meaning depends on riff_diag::kind.
+	 */
+	size_t actual;
 };
 
+///@}
+
 /**
- * @defgroup riff_handle The RIFF handle
+ * @defgroup Instrumentation I/O statistics and tracing
  * @{
  */
+
 /**
- * @brief The RIFF handle.
+ * @brief I/O statistics of a riff_handle.
  * 
- * Members are public and intended for read access (to avoid a plethora of get-functions).
- * 
- * Be careful with the level stack, check riff_handle::ls_size first. 
- *
- * @todo Show the current level's info instead of the header (2.0)
- * @todo Rename riff_handle struct to _riff_handle (2.0)
+ * Updated on every call of riff_handle::fp_read and riff_handle::fp_seek, reset with riff_ioStatsReset().
  */
-typedef struct riff_handle {
+struct riff_ioStats {
 	/**
-	 * @name RIFF file header info.
-	 * 
-	 * Available after the file has been opened.
+	 * @brief Amount of riff_handle::fp_read calls.
 	 */
-	///@{
+	size_t reads;
 	/**
-	 * @brief Header ID, should be `"RIFF"`.
-	 * 
-	 * Contains terminator to be printable.
+	 * @brief Amount of riff_handle::fp_seek calls.
 	 */
-	char h_id[5];
+	size_t seeks;
 	/**
-	 * @brief Size value given in header.
-	 * 
-	 * h_size + 8 equals to the file size.
+	 * @brief Amount of seeks to a position before the current one.
 	 */
-	size_t h_size;
+	size_t seeks_backward;
 	/**
-	 * @brief Type ID of file.
+	 * @brief Total amount of bytes read.
 	 * 
-	 * Should contain 4 ASCII characters.
-	 * 
-	 * Also contains terminator to be printable.
+	 * Equals riff_ioStats::bytes_header + riff_ioStats::bytes_payload.
 	 */
-	char h_type[5];
+	uint64_t bytes_read;
 	/**
-	 * @brief Start position of RIFF file.
+	 * @brief Bytes read as file headers, chunk headers and list type IDs.
 	 */
-	size_t pos_start;
-	///@}
-
+	uint64_t bytes_header;
 	/**
-	 * @brief Total size of RIFF file.
-	 * 
-	 * 0 means unspecified.
+	 * @brief Bytes read from chunk data.
 	 */
-	size_t size;
+	uint64_t bytes_payload;
 	/**
-	 * @brief Current position in data stream.
+	 * @brief Time spent inside riff_handle::fp_read, in riff_handle::fp_clock units.
 	 */
-	size_t pos;
-	
+	uint64_t time_read;
 	/**
-	 * @name Current chunk's data.
+	 * @brief Time spent inside riff_handle::fp_seek, in riff_handle::fp_clock units.
 	 */
-	///@{
+	uint64_t time_seek;
 	/**
-	 * @brief Absolute start position of current chunk.
+	 * @brief Stream position after the latest I/O call.
+	 * 
+	 * Used to detect backward seeks.
+	 */
+	size_t pos;
+};
+
+/**
+ * @name Trace events
+ * 
+ * Passed to riff_handle::fp_trace.
+ * @{
+ */
+
+/**
+ * @brief riff_seekNextChunk() is called.
+ */
+#define RIFF_TRACE_SEEK_NEXT_CHUNK	0
+/**
+ * @brief riff_seekLevelSub() is called.
+ */
+#define RIFF_TRACE_SEEK_LEVEL_SUB	1
+/**
+ * @brief riff_readInChunk() is called.
+ */
+#define RIFF_TRACE_READ_IN_CHUNK	2
+
+/**
+ * @brief The traced function is entered.
+ */
+#define RIFF_TRACE_BEGIN	0
+/**
+ * @brief The traced function returns.
+ */
+#define RIFF_TRACE_END		1
+
+///@}
+
+///@}
+
+/**
+ * @defgroup Tree Chunk tree snapshot
+ * 
+ * The whole chunk hierarchy as one contiguous array, filled by riff_parseTree().
+ * 
+ * Nodes are stored in depth-first order, so the subtree of a node directly follows it.
+ * @{
+ */
+
+/**
+ * @brief Node index meaning "no node".
+ */
+#define RIFF_TREE_NONE	(-1)
+
+/**
+ * @brief Chunk tree node.
+ */
+struct riff_treeNode {
+	/**
+	 * @brief Absolute chunk position in file stream.
 	 */
 	size_t c_pos_start;
 	/**
-	 * @brief Position in current chunk.
-	 * 
-	 * Relative to the start of the chunk's data block.
+	 * @brief Chunk size.
+	 *
+	 * Without header (contains value as stored in RIFF file).
 	 */
-	size_t c_pos;
+	size_t c_size;
 	/**
-	 * @brief ID of current chunk.
+	 * @brief ID of the chunk.
 	 * 
 	 * Contains terminator to be printable.
 	 */
 	char c_id[5];
 	/**
-	 * @brief Size of current chunk.
+	 * @brief Type ID of list chunks.
 	 * 
-	 * Excludes chunk header - same value as stored in RIFF file.
+	 * Empty for chunks without subchunks.
 	 */
-	size_t c_size;
+	char c_type[5];
 	/**
-	 * @brief Pad byte.
+	 * @brief Depth in the tree.
 	 * 
-	 * 1 if c_size is odd, else 0 (indicates unused extra byte at end of chunk).
+	 * 0 for the RIFF header node, 1 for chunks in list level 0, etc.
 	 */
-	uint8_t pad;
-	///@}
-
+	int32_t depth;
 	/**
-	 * @name Level stack data.
+	 * @brief Index of the parent node, RIFF_TREE_NONE for the RIFF header node.
 	 */
-	///@{
+	int32_t parent;
 	/**
-	 * @brief Level stack pointer.
-	 * 
-	 * Resizes dynamically.
-	 * 
-	 * To access the parent chunk data use `ls[ls_level-1]`.
+	 * @brief Index of the first subchunk, RIFF_TREE_NONE if there is none.
 	 */
-	struct riff_levelStackE *ls;
+	int32_t first_child;
 	/**
-	 * @brief Size of stack in entries.
-	 * 
-	 * Stack extends automatically if needed.
+	 * @brief Index of the next chunk in the same level, RIFF_TREE_NONE if there is none.
 	 */
-	size_t ls_size;
+	int32_t next_sibling;
+};
+
+/**
+ * @brief Chunk tree.
+ * 
+ * Zero-initialize before the first use, free with riff_treeFree().
+ */
+struct riff_tree {
 	/**
-	 * @brief Current stack level.
+	 * @brief Node array.
 	 * 
-	 * Starts at 0.
+	 * Node 0 is the RIFF header, its children are the chunks in list level 0.
 	 */
-	int ls_level;
-	///@}
-	
+	struct riff_treeNode *nodes;
 	/**
-	 * @brief Data access handle.
-	 * 
-	 * File handle or memory address.
-	 * 
-	 * Only accessed by user FP functions.
+	 * @brief Amount of nodes.
 	 */
-	void *fh;
-	
-	
-	
+	int32_t count;
 	/**
-	 * @name Internal functions
-	 * 
-	 * Function pointers for e.g. defining your own input methods
+	 * @brief Allocated size of the node array in entries.
 	 */
-	///@{
+	int32_t capacity;
+};
+
+///@}
+
+/**
+ * @defgroup Stats Chunk statistics
+ * 
+ * Per-ID statistics of a whole file, collected in a single pass by riff_collectStats().
+ * @{
+ */
+
+/**
+ * @brief Amount of buckets of the chunk size histograms.
+ * 
+ * Bucket 0 counts empty chunks, bucket n chunks with 2^(n-1) <= size < 2^n.
+ */
+#define RIFF_STATS_BUCKETS	33
+
+/**
+ * @brief Statistics of all chunks with one ID, or all lists with one type.
+ */
+struct riff_statsEntry {
 	/**
-	 * @brief Read bytes.
+	 * @brief Chunk ID, or list type if riff_statsEntry::list is set.
 	 * 
-	 * @note Required for proper operation.
+	 * Contains terminator to be printable.
 	 */
-	size_t (*fp_read)(struct riff_handle *rh, void *ptr, size_t size);
-	
+	char id[5];
 	/**
-	 * @brief Seek position relative to start pos.
+	 * @brief 1 if the entry counts the lists with type riff_statsEntry::id, 0 if it counts chunks with that ID.
 	 * 
-	 * @note Required for proper operation.
+	 * Lists are counted in both, e.g. in `"LIST"` and in `"hdrl"`.
 	 */
-	size_t (*fp_seek)(struct riff_handle *rh, size_t pos);
-	
+	int list;
 	/**
-	 * @brief Print error.
-	 * 
-	 * riff_allocate maps it to `vfprintf(stderr, ...)` by default.\n 
-	 * Set this pointer to NULL right after allocation to disable any printing.\n 
-	 * This pointer should only be modified right after allocation, and before any other `riff_...()` functions.
+	 * @brief Amount of chunks.
 	 */
-	int (*fp_printf)(const char * format, ... );
+	size_t count;
+	/**
+	 * @brief Sum of the data sizes.
+	 */
+	uint64_t total;
+	/**
+	 * @brief Smallest data size.
+	 */
+	size_t min;
+	/**
+	 * @brief Largest data size.
+	 */
+	size_t max;
+	/**
+	 * @brief Largest depth a chunk was found at, 1 for list level 0 like riff_treeNode::depth.
+	 */
+	int32_t max_depth;
+	/**
+	 * @brief Histogram of the data sizes, see RIFF_STATS_BUCKETS.
+	 */
+	size_t histogram[RIFF_STATS_BUCKETS];
+};
 
-	///@}
+/**
+ * @brief Statistics of a file.
+ * 
+ * Zero-initialize before the first use, free with riff_statsFree().
+ */
+struct riff_stats {
+	/**
+	 * @brief Entries in the order the IDs were first seen.
+	 */
+	struct riff_statsEntry *entries;
+	/**
+	 * @brief Amount of entries.
+	 */
+	int32_t count;
+	/**
+	 * @brief Allocated size of the entry array.
+	 */
+	int32_t capacity;
+	/**
+	 * @brief Total amount of chunks, without the RIFF header.
+	 */
+	size_t chunks;
+	/**
+	 * @brief Largest depth of any chunk.
+	 */
+	int32_t max_depth;
+	/**
+	 * @brief Hash index into the entries, internal.
+	 */
+	int32_t *index;
+	/**
+	 * @brief Size of riff_stats::index, internal.
+	 */
+	int32_t index_size;
+};
+
+///@}
+
+/**
+ * @defgroup Path Chunk paths
+ * 
+ * Compiled chunk paths like `"RIFF:AVI /LIST:hdrl/LIST:strl[1]/strf"`.
+ * 
+ * A path consists of steps separated by `/`, each step has the form `ID[:TYPE][[N]]`:
+ * - `ID` is the chunk ID, IDs shorter than 4 characters are padded with spaces, `*` matches any ID
+ * - `TYPE` is the optional list type ID, only list chunks (RIFF, LIST, BW64) with this type match
+ * - `N` optionally selects the N-th matching chunk of the level (starting at 0), otherwise all matching chunks are visited
+ * 
+ * A leading `RIFF` or `BW64` step matches the file header, otherwise the path starts at list level 0.
+ * @{
+ */
+
+/**
+ * @brief Chunk path step.
+ */
+struct riff_pathStep {
+	/**
+	 * @brief Chunk ID to match, `"*"` matches any ID.
+	 */
+	char c_id[5];
+	/**
+	 * @brief List type ID to match, empty to match any chunk.
+	 */
+	char c_type[5];
+	/**
+	 * @brief Index of the matching chunk to select, -1 to select all.
+	 */
+	int32_t index;
+};
+
+/**
+ * @brief Compiled chunk path.
+ * 
+ * Filled by riff_pathCompile(), free with riff_pathFree().
+ */
+struct riff_path {
+	/**
+	 * @brief Step array.
+	 */
+	struct riff_pathStep *steps;
+	/**
+	 * @brief Amount of steps.
+	 */
+	int32_t count;
+	/**
+	 * @brief 1 if the first step matches the file header.
+	 */
+	int header;
+};
+
+///@}
+
+/**
+ * @defgroup Hash Chunk hashing
+ * @{
+ */
+
+/**
+ * @name Hash algorithms
+ * @{
+ */
+
+/**
+ * @brief CRC-32C (Castagnoli), uses the SSE4.2 or ARMv8 CRC instructions where available.
+ */
+#define RIFF_HASH_CRC32C	0
+/**
+ * @brief 64-bit xxHash (XXH64) with seed 0.
+ */
+#define RIFF_HASH_XXH64		1
+
+///@}
+
+///@}
+
+/**
+ * @defgroup Diff Structural diff
+ * @{
+ */
+
+/**
+ * @name Diff events
+ * @{
+ */
+
+/**
+ * @brief Chunk only exists in the new file.
+ */
+#define RIFF_DIFF_ADDED		0
+/**
+ * @brief Chunk only exists in the old file.
+ */
+#define RIFF_DIFF_REMOVED	1
+/**
+ * @brief Chunk exists in both files but its order relative to its siblings changed.
+ */
+#define RIFF_DIFF_MOVED		2
+/**
+ * @brief Chunk exists in both files but its size or data differs.
+ */
+#define RIFF_DIFF_CHANGED	3
+
+///@}
+
+/**
+ * @name Diff flags
+ * @{
+ */
+
+/**
+ * @brief Trust equal hashes, by default the data is compared byte by byte when the hashes are equal.
+ */
+#define RIFF_DIFF_TRUST_HASH	1
+/**
+ * @brief Also read chunks with identical position and size.
+ * 
+ * By default they are treated as unchanged without reading them, which suits revisions that were only appended to.
+ * Use this flag for files that were edited in place, e.g. with riff_editChunk() to the same size.
+ */
+#define RIFF_DIFF_READ_LAYOUT	2
+
+///@}
+
+///@}
+
+/**
+ * @brief Level stack entry struct.
+ *
+ * Needed to retrace from sublevel (list) chunks.
+ * 
+ * (sorta) Contains header info of the parent level.
+ */
+struct riff_levelStackE {
+	/**
+	 * @brief Absolute parent chunk position in file stream.
+	 */
+	size_t c_pos_start;
+	/**
+	 * @brief ID of parent chunk.
+	 *
+	 * The first 4 bytes of RIFF/LIST chunk data.
+	 */
+	char c_id[5];
+	/**
+	 * @brief Parent chunk size.
+	 *
+	 * Without header (contains value as stored in RIFF file).
+	 */
+	size_t c_size;
+	/**
+	 * @brief Type ID of parent chunk.
+	 * 
+	 * Should either be RIFF, LIST or BW64.
+	 */
+	char c_type[5];
+	/**
+	 * @name Level metadata.
+	 * 
+	 * Memoized by walks through the level, kept while the same list is entered again and reset by riff_editChunk().
+	 */
+	///@{
+	/**
+	 * @brief Amount of chunks in the level, 0 if the level was not walked to its end yet.
+	 */
+	int32_t child_count;
+	/**
+	 * @brief 1 if riff_levelValidate() succeeded for the level.
+	 */
+	int validated;
+	/**
+	 * @brief Position of the furthest chunk reached by walking from the first chunk of the level, 0 if unknown.
+	 */
+	size_t visit_pos;
+	/**
+	 * @brief Index of the chunk at visit_pos in the level.
+	 */
+	int32_t visit_index;
+	/**
+	 * @brief Breadcrumbs, positions of the chunks of the level by index, see riff_setBreadcrumbs().
+	 */
+	size_t *crumbs;
+	/**
+	 * @brief Amount of valid entries in crumbs, always the first chunks of the level.
+	 */
+	int32_t crumbs_count;
+	/**
+	 * @brief Allocated entries of crumbs.
+	 */
+	int32_t crumbs_size;
+	///@}
+};
+
+/**
+ * @defgroup Access Access modes
+ * 
+ * Traversal hints for the operating system, see riff_setAccessMode().
+ * @{
+ */
+
+/**
+ * @brief No hints, the default read-ahead of the operating system.
+ */
+#define RIFF_ACCESS_NORMAL	0
+/**
+ * @brief Header-only walks (e.g. riff_levelValidate(), riff_parseTree()), read-ahead is disabled.
+ */
+#define RIFF_ACCESS_HEADERS	1
+/**
+ * @brief Sequential payload streaming, data ahead of the position is prefetched and data behind it is dropped from the page cache.
+ */
+#define RIFF_ACCESS_STREAM	2
+
+///@}
+
+/**
+ * @defgroup Advice Advice values
+ * 
+ * Access pattern hints passed to riff_handle::fp_advise, like the `posix_fadvise()` values of the same name.
+ * @{
+ */
+
+/**
+ * @brief No special treatment.
+ */
+#define RIFF_ADVISE_NORMAL		0
+/**
+ * @brief Random access, read-ahead is disabled.
+ */
+#define RIFF_ADVISE_RANDOM		1
+/**
+ * @brief Sequential access, more read-ahead.
+ */
+#define RIFF_ADVISE_SEQUENTIAL	2
+/**
+ * @brief The range will be accessed soon, read it ahead.
+ */
+#define RIFF_ADVISE_WILLNEED	3
+/**
+ * @brief The range won't be accessed again soon, drop it from memory and the page cache.
+ */
+#define RIFF_ADVISE_DONTNEED	4
+
+///@}
+
+/**
+ * @defgroup Batch Batch scanning
+ * @{
+ */
+
+/**
+ * @brief Maximum depth of subtree tasks, see riff_batch().
+ */
+#define RIFF_BATCH_SPLIT_DEPTH	4
+
+/**
+ * @brief A unit of work of riff_batch(), passed to the visitor.
+ */
+struct riff_batchTask {
+	/**
+	 * @brief Path of the file.
+	 */
+	const char *path;
+	/**
+	 * @brief Index of the file in the path list.
+	 */
+	size_t file;
+	/**
+	 * @brief -1 if the visitor gets the whole file, else the number of the subtree within the file (in file order).
+	 */
+	int32_t part;
+	/**
+	 * @brief Index of the worker thread running the task.
+	 */
+	int thread;
+	/**
+	 * @brief Scratch buffer of the worker thread, reused for all its tasks.
+	 */
+	uint8_t *buf;
+	/**
+	 * @brief Size of riff_batchTask::buf in bytes.
+	 */
+	size_t buf_size;
+	/**
+	 * @brief Internal: positions of the chunks to enter, from level 0 down to the subtree.
+	 */
+	size_t pos[RIFF_BATCH_SPLIT_DEPTH];
+	/**
+	 * @brief Internal: amount of valid riff_batchTask::pos entries.
+	 */
+	int depth;
+	/**
+	 * @brief Internal: amount of consecutive subtrees of the task, the first one is at the last riff_batchTask::pos entry.
+	 */
+	int32_t count;
+};
+
+/**
+ * @brief Aggregated results of riff_batch().
+ */
+struct riff_batchStats {
+	/**
+	 * @brief Amount of files scanned.
+	 */
+	size_t files;
+	/**
+	 * @brief Amount of files with a critical error.
+	 */
+	size_t failed;
+	/**
+	 * @brief Amount of tasks run, files plus ranges of subtrees.
+	 */
+	size_t tasks;
+	/**
+	 * @brief Amount of tasks taken from the queue of another thread.
+	 */
+	size_t stolen;
+	/**
+	 * @brief Sum of the I/O statistics of all handles.
+	 */
+	struct riff_ioStats io;
+};
+
+///@}
+
+/**
+ * @defgroup Cache Chunk data cache
+ * 
+ * LRU cache of chunk data, shared by all handles reading the same source, see riff_cacheAllocate().
+ * @{
+ */
+
+/**
+ * @brief Immutable, reference counted view of the data of a chunk.
+ * 
+ * Obtained with riff_readChunkView(), stays valid until released with riff_chunkViewRelease(), even if it was evicted from the cache meanwhile.
+ */
+struct riff_chunkView {
+	/**
+	 * @brief The chunk data, must not be modified.
+	 */
+	const uint8_t *data;
+	/**
+	 * @brief Size of the chunk data in bytes.
+	 */
+	size_t size;
+	/**
+	 * @brief Position of the chunk header in the stream, the key in the cache.
+	 */
+	size_t pos;
+	/**
+	 * @brief ID of the chunk.
+	 */
+	char id[5];
+};
+
+/**
+ * @brief Counters of a chunk cache, see riff_cacheGetStats().
+ */
+struct riff_cacheStats {
+	/**
+	 * @brief Amount of views served from the cache.
+	 */
+	size_t hits;
+	/**
+	 * @brief Amount of views read from the source.
+	 */
+	size_t misses;
+	/**
+	 * @brief Amount of chunks removed to stay within the budget.
+	 */
+	size_t evictions;
+	/**
+	 * @brief Amount of cached chunks.
+	 */
+	size_t entries;
+	/**
+	 * @brief Sum of the data sizes of the cached chunks.
+	 */
+	size_t bytes;
+};
+
+///@}
+
+/**
+ * @defgroup Zstd Seekable zstd archives
+ * 
+ * RIFF files compressed in the zstd seekable format, see riff_open_zstd() and riff_zstdCompress().
+ * Requires the library to be built with zstd (CMake option RIFF_ZSTD).
+ * @{
+ */
+
+/**
+ * @brief Default amount of uncompressed data per frame written by riff_zstdCompress().
+ */
+#define RIFF_ZSTD_FRAME_SIZE	(1 << 20)
+/**
+ * @brief Default amount of decompressed frames kept by riff_open_zstd().
+ */
+#define RIFF_ZSTD_CACHE_FRAMES	4
+
+///@}
+
+/**
+ * @defgroup Http HTTP backend
+ * 
+ * Reading RIFF files from an HTTP server with Range requests, see riff_open_http().
+ * @{
+ */
+
+/**
+ * @brief Default block size of riff_open_http(), the smallest amount of data fetched by one request.
+ */
+#define RIFF_HTTP_BLOCK_SIZE	(1 << 16)
+/**
+ * @brief Default amount of blocks cached by riff_open_http().
+ */
+#define RIFF_HTTP_CACHE_BLOCKS	64
+
+///@}
+
+/**
+ * @defgroup riff_handle The RIFF handle
+ * @{
+ */
+/**
+ * @brief The RIFF handle.
+ * 
+ * Members are public and intended for read access (to avoid a plethora of get-functions).
+ * 
+ * Be careful with the level stack, check riff_handle::ls_size first. 
+ *
+ * @todo Show the current level's info instead of the header (2.0)
+ * @todo Rename riff_handle struct to _riff_handle (2.0)
+ */
+typedef struct riff_handle {
+	/**
+	 * @name RIFF file header info.
+	 * 
+	 * Available after the file has been opened.
+	 */
+	///@{
+	/**
+	 * @brief Header ID, should be `"RIFF"`.
+	 * 
+	 * Contains terminator to be printable.
+	 */
+	char h_id[5];
+	/**
+	 * @brief Size value given in header.
+	 * 
+	 * h_size + 8 equals to the file size.
+	 */
+	size_t h_size;
+	/**
+	 * @brief Type ID of file.
+	 * 
+	 * Should contain 4 ASCII characters.
+	 * 
+	 * Also contains terminator to be printable.
+	 */
+	char h_type[5];
+	/**
+	 * @brief Start position of RIFF file.
+	 */
+	size_t pos_start;
+	///@}
+
+	/**
+	 * @brief Total size of RIFF file.
+	 * 
+	 * 0 means unspecified.
+	 */
+	size_t size;
+	/**
+	 * @brief Current position in data stream.
+	 */
+	size_t pos;
+	
+	/**
+	 * @name Current chunk's data.
+	 */
+	///@{
+	/**
+	 * @brief Absolute start position of current chunk.
+	 */
+	size_t c_pos_start;
+	/**
+	 * @brief Position in current chunk.
+	 * 
+	 * Relative to the start of the chunk's data block.
+	 */
+	size_t c_pos;
+	/**
+	 * @brief ID of current chunk.
+	 * 
+	 * Contains terminator to be printable.
+	 */
+	char c_id[5];
+	/**
+	 * @brief Size of current chunk.
+	 * 
+	 * Excludes chunk header - same value as stored in RIFF file.
+	 */
+	size_t c_size;
+	/**
+	 * @brief Pad byte.
+	 * 
+	 * 1 if c_size is odd, else 0 (indicates unused extra byte at end of chunk).
+	 */
+	uint8_t pad;
+	///@}
+
+	/**
+	 * @name Level stack data.
+	 */
+	///@{
+	/**
+	 * @brief Level stack pointer.
+	 * 
+	 * Resizes dynamically.
+	 * 
+	 * To access the parent chunk data use `ls[ls_level-1]`.
+	 */
+	struct riff_levelStackE *ls;
+	/**
+	 * @brief Size of stack in entries.
+	 * 
+	 * Stack extends automatically if needed.
+	 */
+	size_t ls_size;
+	/**
+	 * @brief Current stack level.
+	 * 
+	 * Starts at 0.
+	 */
+	int ls_level;
+	/**
+	 * @brief Entry of the RIFF header chunk, used for the metadata of level 0.
+	 */
+	struct riff_levelStackE ls_root;
+	/**
+	 * @brief 1 if breadcrumbs are recorded, set with riff_setBreadcrumbs().
+	 */
+	int breadcrumbs;
+	///@}
+	
+	/**
+	 * @brief Data access handle.
+	 * 
+	 * File handle or memory address.
+	 * 
+	 * Only accessed by user FP functions.
+	 */
+	void *fh;
+	
+	
+	
+	/**
+	 * @name Internal functions
+	 * 
+	 * Function pointers for e.g. defining your own input methods
+	 */
+	///@{
+	/**
+	 * @brief Read bytes.
+	 * 
+	 * @note Required for proper operation.
+	 */
+	size_t (*fp_read)(struct riff_handle *rh, void *ptr, size_t size);
+	
+	/**
+	 * @brief Seek position relative to start pos.
+	 * 
+	 * @note Required for proper operation.
+	 */
+	size_t (*fp_seek)(struct riff_handle *rh, size_t pos);
+	
+	/**
+	 * @brief Get direct access to stream data.
+	 * 
+	 * Returns a pointer to `size` bytes at position `pos`, or NULL if the data is not directly accessible.\n 
+	 * Must not change any state, it may be called from several threads at once.
+	 * 
+	 * @note Optional, leave NULL if the source cannot provide direct access. Set up for memory access by riff_open_mem().
+	 */
+	const void *(*fp_map)(struct riff_handle *rh, size_t pos, size_t size);
+	
+	/**
+	 * @brief Get the OS file descriptor of the stream.
+	 * 
+	 * Returns a file descriptor whose file offsets equal stream positions, or -1 if there is none.\n 
+	 * Used to copy chunk data inside the kernel, see riff_copyChunk().
+	 * 
+	 * @note Optional, leave NULL if the source is not a file. Set up by riff_open_file() on POSIX systems.
+	 */
+	int (*fp_fd)(struct riff_handle *rh);
+	
+	/**
+	 * @brief Pass an access pattern hint for a byte range to the operating system.
+	 * 
+	 * advice is one of the RIFF_ADVISE_* values, size 0 means up to the end of the file.
+	 * 
+	 * @note Optional. Set up by riff_open_file(), riff_open_fd() and riff_open_mmap() on POSIX systems.
+	 */
+	int (*fp_advise)(struct riff_handle *rh, int advice, size_t pos, size_t size);
+	
+	/**
+	 * @brief Read bytes at an absolute position without changing the stream position.
+	 * 
+	 * Must be safe to call from another thread while the stream is used, see riff_prefetchStart().
+	 * 
+	 * @note Optional. Set up by all built-in open functions (riff_open_file() only on POSIX systems).
+	 */
+	size_t (*fp_readAt)(struct riff_handle *rh, void *ptr, size_t size, size_t pos);
+	
+	/**
+	 * @brief Release resources allocated by the open function, called by riff_handleClose().
+	 * 
+	 * @note Optional. Set up by riff_open_mmap().
+	 */
+	void (*fp_close)(struct riff_handle *rh);
+	
+	/**
+	 * @brief Take another reference on the resources of the open function for a copy of the handle.
+	 * 
+	 * Called on the copy right after the riff_handle was copied, both handles call riff_handle::fp_close then.
+	 * 
+	 * @note Optional. Set up by riff_open_mmap(). Copies of handles with riff_handle::fp_close but without this function must not be used.
+	 * 
+	 * @return RIFF error code.
+	 */
+	int (*fp_dup)(struct riff_handle *rh);
+	
+	/**
+	 * @brief Print error.
+	 * 
+	 * NULL by default, nothing is printed or formatted then.\n 
+	 * Set this pointer to riff_printf() (or your own function) right after allocation to print every diagnostic as it occurs.\n 
+	 * This pointer should only be modified right after allocation, and before any other `riff_...()` functions.
+	 */
+	int (*fp_printf)(const char * format, ... );
+
+	///@}
+
+	/**
+	 * @name Diagnostics
+	 */
+	///@{
+	/**
+	 * @brief Latest diagnostic record.
+	 * 
+	 * Only valid if riff_handle::diag_count > 0.
+	 */
+	struct riff_diag diag;
+	/**
+	 * @brief Ring buffer of recent diagnostic records.
+	 * 
+	 * NULL unless enabled with riff_diagRingAllocate().
+	 */
+	struct riff_diag *diag_ring;
+	/**
+	 * @brief Size of the ring buffer in entries.
+	 */
+	size_t diag_ring_size;
+	/**
+	 * @brief Total amount of diagnostics recorded since allocation or riff_diagClear().
+	 */
+	size_t diag_count;
+	///@}
+
+	/**
+	 * @name Instrumentation
+	 */
+	///@{
+	/**
+	 * @brief I/O statistics.
+	 */
+	struct riff_ioStats io;
+	/**
+	 * @brief Clock used to measure the time spent in I/O callbacks.
+	 * 
+	 * NULL by default, which disables time measurement.\n 
+	 * Set it to riff_clockNs() (or your own monotonic clock) to fill riff_ioStats::time_read and riff_ioStats::time_seek.
+	 */
+	uint64_t (*fp_clock)(void);
+	/**
+	 * @brief Tracing hook.
+	 * 
+	 * NULL by default. If set, it is called with RIFF_TRACE_BEGIN and RIFF_TRACE_END around riff_seekNextChunk(), riff_seekLevelSub() and riff_readInChunk().\n 
+	 * On RIFF_TRACE_END, result is the return value of the traced function.
+	 */
+	void (*fp_trace)(struct riff_handle *rh, int event, int phase, size_t result);
+	/**
+	 * @brief User data for riff_handle::fp_trace, not touched by the library.
+	 */
+	void *trace_data;
+	///@}
+	
+	/**
+	 * @name Access hints
+	 */
+	///@{
+	/**
+	 * @brief Current access mode, one of the RIFF_ACCESS values.
+	 * 
+	 * Set with riff_setAccessMode().
+	 */
+	int access_mode;
+	/**
+	 * @brief Start of the current stream window in RIFF_ACCESS_STREAM mode.
+	 */
+	size_t access_pos;
+	///@}
+	
+	/**
+	 * @brief Prefetch state, NULL unless started with riff_prefetchStart().
+	 */
+	struct riff_prefetch *prefetch;
+	
+	/**
+	 * @brief Chunk data cache, NULL unless set with riff_setCache().
+	 */
+	struct riff_cache *cache;
 	
 } riff_handle;
 
 ///@}
 
 /**
- * @defgroup RIFF_C C RIFF functions
- * @{
+ * @defgroup riff_writer The RIFF writer
+ * @{
+ */
+
+/**
+ * @brief Open chunk of a riff_writer, its size is written when it is ended.
+ */
+struct riff_writerStackE {
+	/**
+	 * @brief Absolute chunk position in the output stream.
+	 */
+	size_t c_pos_start;
+	/**
+	 * @brief ID of the chunk.
+	 */
+	char c_id[5];
+};
+
+/**
+ * @brief The RIFF writer.
+ * 
+ * Writes chunks sequentially, chunk sizes of lists are patched when the list is ended.
+ */
+typedef struct riff_writer {
+	/**
+	 * @brief Current position in the output stream.
+	 */
+	size_t pos;
+	
+	/**
+	 * @brief Stack of open chunks.
+	 */
+	struct riff_writerStackE *ls;
+	/**
+	 * @brief Size of stack in entries.
+	 */
+	size_t ls_size;
+	/**
+	 * @brief Amount of open chunks.
+	 */
+	int ls_level;
+	
+	/**
+	 * @brief Total amount of bytes written, including bytes copied by the kernel.
+	 */
+	size_t bytes_written;
+	/**
+	 * @brief Amount of bytes copied inside the kernel without passing user space.
+	 */
+	size_t bytes_offloaded;
+	
+	/**
+	 * @name Commit mode
+	 * 
+	 * Periodic commits of the sizes of the open chunks, see riff_writerSetCommit().
+	 */
+	///@{
+	/**
+	 * @brief Commit after this amount of bytes, 0 if off.
+	 */
+	size_t commit_bytes;
+	/**
+	 * @brief Commit after this time in nanoseconds, 0 if off.
+	 */
+	uint64_t commit_ns;
+	/**
+	 * @brief End of the data covered by the last commit, the file is valid if cut off there.
+	 * 
+	 * Before the write position if that is odd (the last byte is left for the next commit) or inside a list without subchunks yet (the commit ends before the list).
+	 */
+	size_t commit_pos;
+	/**
+	 * @brief Time of the last commit, see riff_clockNs().
+	 */
+	uint64_t commit_time;
+	/**
+	 * @brief Amount of successful commits.
+	 */
+	size_t commits;
+	///@}
+	
+	/**
+	 * @brief Pointer to the output stream.
+	 * 
+	 * Only accessed by user FP functions.
+	 */
+	void *fh;
+	
+	/**
+	 * @name Internal functions
+	 * 
+	 * Function pointers for e.g. defining your own output methods
+	 */
+	///@{
+	/**
+	 * @brief Write bytes, returns the amount of bytes written.
+	 * 
+	 * @note Required for proper operation.
+	 */
+	size_t (*fp_write)(struct riff_writer *rw, const void *ptr, size_t size);
+	/**
+	 * @brief Seek absolute position.
+	 * 
+	 * @note Required for proper operation.
+	 */
+	size_t (*fp_seek)(struct riff_writer *rw, size_t pos);
+	/**
+	 * @brief Get the OS file descriptor of the stream, see riff_handle::fp_fd.
+	 * 
+	 * Must flush pending buffered data before returning it.
+	 * 
+	 * @note Optional. Set up by riff_writer_open_file() and riff_writer_open_fd() on POSIX systems.
+	 */
+	int (*fp_fd)(struct riff_writer *rw);
+	/**
+	 * @brief Write out buffered data, called by riff_writeFinish().
+	 * 
+	 * @note Optional. Set up by riff_writer_open_sink().
+	 */
+	int (*fp_flush)(struct riff_writer *rw);
+	/**
+	 * @brief Flush and release resources of the output, called by riff_writerFree().
+	 * 
+	 * The output stream itself is not closed.
+	 * 
+	 * @note Optional. Set up by riff_writer_open_sink().
+	 */
+	void (*fp_close)(struct riff_writer *rw);
+	///@}
+} riff_writer;
+
+///@}
+
+/**
+ * @defgroup Sink Buffered file descriptor sink
+ * 
+ * Output for high, steady write rates, see riff_writer_open_sink().
+ * @{
+ */
+
+/**
+ * @brief Default write buffer size of riff_writer_open_sink().
+ */
+#define RIFF_SINK_BUFFER_SIZE	(1 << 22)
+/**
+ * @brief Default alignment of the write buffer and of file offsets of writes, also the O_DIRECT block size.
+ */
+#define RIFF_SINK_ALIGN	4096
+/**
+ * @brief Default preallocation extent, the file is extended in steps of this size.
+ */
+#define RIFF_SINK_PREALLOC	(1 << 26)
+/**
+ * @brief Default writeback window, written data is handed to writeback and dropped from the page cache in steps of this size.
+ */
+#define RIFF_SINK_SYNC_WINDOW	(1 << 23)
+
+/**
+ * @name Sink flags
+ * @{
+ */
+
+/**
+ * @brief Bypass the page cache with O_DIRECT (Linux), falls back to buffered writes if the file system refuses it.
+ */
+#define RIFF_SINK_DIRECT	1
+
+///@}
+
+/**
+ * @brief Settings of riff_writer_open_sink().
+ * 
+ * Fields that are 0 take the defaults for buffer_size and align, and turn the feature off for prealloc and sync_window.
+ */
+struct riff_sinkConfig {
+	/**
+	 * @brief Write buffer size, rounded up to a multiple of align.
+	 */
+	size_t buffer_size;
+	/**
+	 * @brief Alignment in bytes, a power of 2. Must be a multiple of the logical block size for RIFF_SINK_DIRECT.
+	 */
+	size_t align;
+	/**
+	 * @brief Preallocation extent in bytes, see RIFF_SINK_PREALLOC.
+	 */
+	size_t prealloc;
+	/**
+	 * @brief Writeback window in bytes, see RIFF_SINK_SYNC_WINDOW. Not used with RIFF_SINK_DIRECT.
+	 */
+	size_t sync_window;
+	/**
+	 * @brief Combination of the sink flags.
+	 */
+	int flags;
+};
+
+///@}
+
+/**
+ * @defgroup RIFF_C C RIFF functions
+ * @{
+ */
+/**
+ * @name riff_handle allocation/deallocation functions
+ * @{
+ */
+/**
+ * @brief Allocate, initialize and return a riff_handle.
+ * 
+ * @return Pointer to the intialized riff_handle.
+ */
+riff_handle *riff_handleAllocate();
+/**
+ * @brief Free the memory allocated to a riff_handle.
+ * 
+ * @param rh The riff_handle to free.
+ */
+void riff_handleFree(riff_handle *rh);
+/**
+ * @brief Release the source of a riff_handle and clear its optional callbacks.
+ * 
+ * Stops the prefetch thread and calls riff_handle::fp_close if set, the handle can be opened again afterwards.
+ * Called by all built-in open functions and by riff_handleFree().
+ * 
+ * @param rh The riff_handle to close.
+ */
+void riff_handleClose(riff_handle *rh);
+
+///@}
+
+
+/**
+ * @name Parsing functions
+ * @{
+ */
+/**
+ * @brief Read to memory block.
+ *
+ * @param rh The riff_handle to use.
+ * @param to The pointer to read data to.
+ * @param size The amount of data to read.
+ * 
+ * @return Amount of successfully read bytes.
+ *
+ * Does not read beyond end of chunk.
+ * 
+ * Does not read the pad byte.
+ */
+size_t riff_readInChunk(riff_handle *rh, void *to, size_t size);
+/**
+ * @brief Seek in current chunk.
+ *
+ * @param rh The riff_handle to use.
+ * @param c_pos The chunk position to seek to.
+ * 
+ * @return RIFF error code.
+ *
+ * @note Only counts the actual data section of the chunk - position 0 is first byte after chunk size (chunk offset 8).
+ */
+int riff_seekInChunk(riff_handle *rh, size_t c_pos);
+
+///@}
+
+/**
+ * @name Chunk seeking functions
+ * @{
+ */
+/**
+ * @brief Seek to start of next chunk within current level.
+ * 
+ * ID and size are read automatically.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_seekNextChunk(struct riff_handle *rh);
+/**
+ * @brief Seek to start of previous chunk within current level.
+ * 
+ * ID and size are read automatically.\n 
+ * Jumps straight to the chunk if its position is known from the breadcrumbs (see riff_setBreadcrumbs()),
+ * else walks forward from the closest known chunk before it.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code, RIFF_ERROR_EOCL if the current chunk is the first of the level (the position is not changed then).
+ */
+int riff_seekPrevChunk(struct riff_handle *rh);
+/**
+ * @brief Seek to start of a chunk by its index within current level.
+ * 
+ * ID and size are read automatically.\n 
+ * Jumps straight to the chunk if its position is known from the breadcrumbs (see riff_setBreadcrumbs()),
+ * else walks forward from the closest known chunk before it.
+ * 
+ * @param rh The riff_handle to use.
+ * @param i Index of the chunk, 0 is the first chunk of the level.
+ * 
+ * @return RIFF error code, RIFF_ERROR_EOCL if the level has less chunks (positioned at the last chunk then).
+ */
+int riff_seekChunkIndex(struct riff_handle *rh, int32_t i);
+/**
+ * @brief Enable or disable breadcrumbs.
+ * 
+ * With breadcrumbs every level records the positions of its chunks as they are walked from the first chunk on,
+ * so riff_seekPrevChunk() and riff_seekChunkIndex() jump without I/O within the walked part of a level.
+ * Costs the size of a `size_t` per visited chunk, the memory is kept until the handle is freed or breadcrumbs are disabled.
+ * 
+ * @param rh The riff_handle to use.
+ * @param enable 1 to record breadcrumbs, 0 to stop and free them.
+ * 
+ * @return RIFF error code.
+ */
+int riff_setBreadcrumbs(struct riff_handle *rh, int enable);
+//int riff_seekNextChunkID(struct riff_handle *rh, char *id);  //find and go to next chunk with id (4 byte) in current level, fails if not found - position is invalid then -> maybe not needed, the user can do it via simple loop
+/**
+ * @brief Seek to data start of the current chunk.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_seekChunkStart(struct riff_handle *rh);
+/**
+ * @brief Seek to the very first chunk of the file.
+ * 
+ * Rewinds to the same position as just after opening via `riff_open_...()`.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_rewind(struct riff_handle *rh);
+/**
+ * @brief Seek to the beginning of the current level.
+ * 
+ * Seeks to the first data byte of the first chunk in current level.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_seekLevelStart(struct riff_handle *rh);
+
+///@}
+
+/**
+ * @name Level seeking functions
+ * @{
+ */
+
+/**
+ * @brief Go to sub level, load first chunk.
+ * 
+ * @note Automatically seeks to the start of parent chunk's data.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_seekLevelSub(struct riff_handle *rh);
+
+/**
+ * @brief Step back from sub level.
+ * 
+ * @note The position does not change, you are still inside the data section of the parent list chunk!
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_levelParent(struct riff_handle *rh);
+
+/**
+ * @brief Step back from sub level, seek to start of current chunk
+ *
+ * @param rh The riff_handle to use.
+ *
+ * @return RIFF error code. 
+ */
+int riff_seekLevelParentStart(struct riff_handle *rh);
+
+/**
+ * @brief Step back from sub level, seek to start of next chunk
+ *
+ * @param rh The riff_handle to use.
+ *
+ * @return RIFF error code. 
+ */
+int riff_seekLevelParentNext(struct riff_handle *rh);
+
+///@}
+
+/**
+ * @name Validation functions
+ *
+ * By the way, *you* are valid too ;)
+ *
+ * @{
+ */
+
+/**
+ * @brief Validate chunk level structure.
+ * 
+ * Seeks to the first byte of the current level, then from header to header inside of the current chunk level.
+ * Chunks already reached by earlier walks through the level are not read again, a level that was validated before returns immediately.
+ *
+ * @note File position is changed by this function, unless the level was validated before.
+ * 
+ * @param rh The riff_handle to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_levelValidate(struct riff_handle *rh);
+
+/**
+ * @brief Validate file structure.
+ *
+ * Rewinds to the first chunk of the file, then from header to header inside of the current chunk level. If a level can contain subchunks, it is recursively checked.
+ *
+ * @note File position is changed by this function.
+ * 
+ * @param rh The riff_handle to use.
+ *
+ * @return RIFF error code.
+ */
+int riff_fileValidate(struct riff_handle *rh);
+
+///@}
+
+/**
+ * @name Chunk counting functions
+ * @{
+ */
+
+/**
+ * @brief Count chunks in current level.
+ *
+ * Seeks back to the first chunk of the level, then header to header, counting the chunks. Does not recursively count subchunks.
+ * The walk resumes at the furthest chunk reached by earlier walks through the level.
+ * Once the end of the level was reached the count is remembered and returned without any I/O.
+ *
+ * @note File position is changed by this function, unless the count is already known.
+ * 
+ * @param rh The riff_handle to use.
+ *
+ * @return The amount of chunks in the current level, or -1 if an error occured.
+ */
+int32_t riff_amountOfChunksInLevel(struct riff_handle *rh);
+
+/**
+ * @brief Count chunks with a certain ID in current level.
+ *
+ * Seeks back to the first chunk of the level, then header to header, counting the chunks with the matching ID. Does not recursively count subchunks.
+ *
+ * @note File position is changed by this function.
+ * 
+ * @param rh The riff_handle to use.
+ * @param id The chunk ID to match against.
+ *
+ * @return The amount of chunks with the id in the current level, or -1 if an error occured.
+ */
+int32_t riff_amountOfChunksInLevelWithID(struct riff_handle *rh, const char * id);
+
+/**
+ * @brief Collect per-ID statistics of the whole file in one pass.
+ * 
+ * Rewinds, then walks every chunk of the file once, reading only headers. For every chunk ID and every list type
+ * it counts the chunks, sums up their sizes, tracks the smallest and largest size and depth, and fills a size histogram.
+ * Query the result with riff_statsFind(). The entry array is reused if it is big enough.
+ * 
+ * @note File position is changed by this function.
+ * 
+ * @param rh The riff_handle to use.
+ * @param stats The statistics to fill, contains the chunks counted so far if an error occurs.
+ * 
+ * @return RIFF error code.
+ */
+int riff_collectStats(riff_handle *rh, struct riff_stats *stats);
+
+/**
+ * @brief Look up the statistics of a chunk ID or list type.
+ * 
+ * @param stats The statistics filled by riff_collectStats().
+ * @param id The chunk ID or list type to look up, 4 characters.
+ * @param list 0 to look up chunks with the ID, 1 to look up lists with that type.
+ * 
+ * @return The entry, or NULL if no such chunk was found.
+ */
+const struct riff_statsEntry *riff_statsFind(const struct riff_stats *stats, const char *id, int list);
+
+/**
+ * @brief Free the arrays of statistics.
+ * 
+ * @param stats The statistics to free, are reset to empty statistics.
+ */
+void riff_statsFree(struct riff_stats *stats);
+
+///@}
+
+/**
+ * @brief Return error string.
+ * 
+ * @note The current position (riff_handle::pos) tells you where the problem occured in the file.
+ * 
+ * @param e The error code.
+ * 
+ * @return Pointer to string with the name of the error.
+ */
+const char *riff_errorToString(int e);
+
+/**
+ * @name Chunk tree functions
+ * @{
+ */
+
+/**
+ * @brief Read the whole chunk hierarchy into a tree.
+ * 
+ * Rewinds, then walks every chunk of the file once, reading only headers. The tree's node array is reused if it is big enough.
+ * 
+ * @note File position is changed by this function.
+ * 
+ * @param rh The riff_handle to use.
+ * @param tree The tree to fill, contains the nodes parsed so far if an error occurs.
+ * 
+ * @return RIFF error code.
+ */
+int riff_parseTree(riff_handle *rh, struct riff_tree *tree);
+
+/**
+ * @brief Scan the chunk headers of a RIFF file that is completely in memory.
+ * 
+ * Works directly on the buffer without a riff_handle, FOURCCs are validated a word at a time.
+ * Produces the same nodes as riff_parseTree() with positions relative to the buffer start.
+ * riff_parseTree() uses it for sources that provide riff_handle::fp_map.
+ * 
+ * @param ptr Buffer starting with the RIFF header.
+ * @param len Size of the buffer in bytes.
+ * @param nodes Node array to fill, may be NULL if cap is 0.
+ * @param cap Capacity of the node array in entries, further nodes are only counted.
+ * @param count Receives the amount of nodes found, can be larger than cap. Call again with a bigger array in that case.
+ * 
+ * @return RIFF error code, RIFF_ERROR_EXDAT if there are excess bytes at a list end. On critical errors the nodes scanned so far are valid.
+ */
+int riff_scanBuffer(const void *ptr, size_t len, struct riff_treeNode *nodes, int32_t cap, int32_t *count);
+
+/**
+ * @brief Free the node array of a tree.
+ * 
+ * @param tree The tree to free, is reset to an empty tree.
+ */
+void riff_treeFree(struct riff_tree *tree);
+
+/**
+ * @brief Find the next node with an ID in a subtree.
+ * 
+ * Searches in depth-first order, only touches the node array.
+ * 
+ * @param tree The tree to search.
+ * @param root Index of the node whose subtree is searched.
+ * @param from Index of the node to continue after, pass root to start the search.
+ * @param id The chunk ID to match against, also matches the type ID of list chunks (e.g. `"hdrl"`).
+ * 
+ * @return Index of the found node, or RIFF_TREE_NONE.
+ */
+int32_t riff_treeFind(const struct riff_tree *tree, int32_t root, int32_t from, const char *id);
+
+/**
+ * @brief Seek to a chunk of a tree.
+ * 
+ * Enters all parent levels of the chunk, then seeks to its data start.
+ * 
+ * @param rh The riff_handle the tree was parsed from.
+ * @param tree The tree.
+ * @param node Index of the node to seek to, 0 rewinds.
+ * 
+ * @return RIFF error code.
+ */
+int riff_seekTreeNode(riff_handle *rh, const struct riff_tree *tree, int32_t node);
+
+///@}
+
+/**
+ * @name Chunk path functions
+ * @{
+ */
+
+/**
+ * @brief Compile a chunk path.
+ * 
+ * See @ref Path for the syntax.
+ * 
+ * @param path The path to fill, free with riff_pathFree().
+ * @param str The path string.
+ * 
+ * @return RIFF error code, RIFF_ERROR_ILLID on a syntax error.
+ */
+int riff_pathCompile(struct riff_path *path, const char *str);
+
+/**
+ * @brief Free a compiled chunk path.
+ * 
+ * @param path The path to free, is reset to an empty path.
+ */
+void riff_pathFree(struct riff_path *path);
+
+/**
+ * @brief Visit all chunks matching a path.
+ * 
+ * Rewinds, then only enters list chunks that match the current step of the path, all other subtrees are skipped.
+ * 
+ * The callback is called with the handle positioned at the data start of the matching chunk. It may read and seek inside the chunk, but must not change the list level.
+ * 
+ * @note File position is changed by this function.
+ * 
+ * @param rh The riff_handle to use.
+ * @param path The compiled path.
+ * @param cb The callback, return non-zero to stop, the handle then stays at the matching chunk.
+ * @param user User data passed to the callback.
+ * 
+ * @return RIFF error code, RIFF_ERROR_NONE also if nothing matched.
+ */
+int riff_pathForEach(riff_handle *rh, const struct riff_path *path, int (*cb)(riff_handle *rh, void *user), void *user);
+
+/**
+ * @brief Seek to the first chunk matching a compiled path.
+ * 
+ * @note File position is changed by this function, even if no chunk matches.
+ * 
+ * @param rh The riff_handle to use.
+ * @param path The compiled path.
+ * 
+ * @return RIFF error code, RIFF_ERROR_EOCL if no chunk matches.
+ */
+int riff_seekPathCompiled(riff_handle *rh, const struct riff_path *path);
+
+/**
+ * @brief Seek to the first chunk matching a path.
+ * 
+ * Compiles the path for a single use, use riff_pathCompile() and riff_seekPathCompiled() for paths used repeatedly.
+ * 
+ * @note File position is changed by this function, even if no chunk matches.
+ * 
+ * @param rh The riff_handle to use.
+ * @param str The path string.
+ * 
+ * @return RIFF error code, RIFF_ERROR_EOCL if no chunk matches.
+ */
+int riff_seekPath(riff_handle *rh, const char *str);
+
+///@}
+
+/**
+ * @name Chunk hashing functions
+ * @{
+ */
+
+/**
+ * @brief Hash a memory block.
+ * 
+ * @param algo The hash algorithm, one of the RIFF_HASH values.
+ * @param data The data to hash.
+ * @param size The size of the data.
+ * 
+ * @return The hash value, 32-bit algorithms only use the lower 32 bits.
+ */
+uint64_t riff_hashBuffer(int algo, const void *data, size_t size);
+
+/**
+ * @brief Hash the data of the current chunk.
+ * 
+ * Hashes the whole chunk data regardless of the current position, without the pad byte.\n 
+ * Reads the data directly if riff_handle::fp_map is available, otherwise streams it through riff_handle::fp_read.
+ * 
+ * @note Afterwards the position is at the end of the chunk data.
+ * 
+ * @param rh The riff_handle to use.
+ * @param algo The hash algorithm, one of the RIFF_HASH values.
+ * @param hash Receives the hash value.
+ * 
+ * @return RIFF error code.
+ */
+int riff_hashChunk(riff_handle *rh, int algo, uint64_t *hash);
+
+/**
+ * @brief Hash every chunk of a tree, Merkle style.
+ * 
+ * Chunks without subchunks get the hash of their data. List chunks (and the RIFF header node) get the hash of their type ID followed by the ID, size and hash of each subchunk, so the hash of node 0 fingerprints the whole file.\n 
+ * Identical subtrees get identical hashes regardless of their position.
+ * 
+ * If riff_handle::fp_map or riff_handle::fp_readAt is available and the library was built with threads, the chunk data is hashed by several threads.
+ * 
+ * @note File position is changed by this function, the handle is rewound afterwards.
+ * 
+ * @param rh The riff_handle the tree was parsed from.
+ * @param tree The tree, see riff_parseTree().
+ * @param algo The hash algorithm, one of the RIFF_HASH values.
+ * @param threads Amount of threads to use, 0 or 1 for the calling thread only.
+ * @param hashes Array of riff_tree::count entries, receives the hash of every node.
+ * 
+ * @return RIFF error code.
+ */
+int riff_hashTree(riff_handle *rh, const struct riff_tree *tree, int algo, int threads, uint64_t *hashes);
+
+///@}
+
+/**
+ * @name Diff functions
+ */
+///@{
+
+/**
+ * @brief Compare the chunk structure and data of 2 files.
+ * 
+ * The subchunks of every list pair are matched by ID and list type, in order of appearance.
+ * Matched chunks without subchunks are compared by size, then by XXH64 hash of their data, then byte by byte. Data is only read when the sizes are equal.\n 
+ * Matched pairs that are not part of the longest in-order sequence are reported as RIFF_DIFF_MOVED, a moved chunk with different data is reported again as RIFF_DIFF_CHANGED.
+ * 
+ * @note File positions are changed by this function, both handles are rewound afterwards.
+ * 
+ * @param a The riff_handle of the old file.
+ * @param b The riff_handle of the new file.
+ * @param flags Combination of RIFF_DIFF_TRUST_HASH and RIFF_DIFF_READ_LAYOUT, or 0.
+ * @param cb Called for every difference with the event (one of the RIFF_DIFF events) and the tree nodes of both files, NULL for the missing side. Return non-zero to stop.
+ * @param user Passed to cb.
+ * 
+ * @return RIFF error code.
+ */
+int riff_diff(riff_handle *a, riff_handle *b, int flags, int (*cb)(int event, const struct riff_treeNode *a, const struct riff_treeNode *b, void *user), void *user);
+
+///@}
+
+/**
+ * @name Diagnostic functions
+ * @{
+ */
+
+/**
+ * @brief Enable, resize or disable the diagnostic ring buffer.
+ * 
+ * Previously stored records are discarded.
+ * 
+ * @param rh The riff_handle to use.
+ * @param size The amount of records to keep, 0 disables the ring buffer.
+ * 
+ * @return RIFF error code.
+ */
+int riff_diagRingAllocate(riff_handle *rh, size_t size);
+
+/**
+ * @brief Get a recent diagnostic record.
+ * 
+ * Without a ring buffer only the latest record (age 0) is available.
+ * 
+ * @param rh The riff_handle to use.
+ * @param age 0 for the latest record, 1 for the one before, etc.
+ * 
+ * @return Pointer to the record, or NULL if it is not available.
+ */
+const struct riff_diag *riff_diagGet(const riff_handle *rh, size_t age);
+
+/**
+ * @brief Forget all recorded diagnostics.
+ * 
+ * @param rh The riff_handle to use.
+ */
+void riff_diagClear(riff_handle *rh);
+
+/**
+ * @brief Format a diagnostic record as text.
+ * 
+ * @param d The record to format.
+ * @param buf The buffer to write to.
+ * @param size The size of the buffer.
+ * 
+ * @return The length of the full message, as with `snprintf()`.
+ */
+int riff_diagToString(const struct riff_diag *d, char *buf, size_t size);
+
+/**
+ * @brief Default print function.
+ * 
+ * Maps to `vfprintf(stderr, ...)`, assign it to riff_handle::fp_printf to print diagnostics.
+ * 
+ * @param format The format string.
+ * 
+ * @return Amount of characters printed.
+ */
+int riff_printf(const char *format, ... );
+
+///@}
+
+/**
+ * @name Instrumentation functions
+ * @{
+ */
+
+/**
+ * @brief Reset the I/O statistics.
+ * 
+ * @param rh The riff_handle to use.
+ */
+void riff_ioStatsReset(riff_handle *rh);
+
+/**
+ * @brief Default clock for I/O time measurement.
+ * 
+ * Assign it to riff_handle::fp_clock to measure time spent in I/O callbacks.
+ * 
+ * @return Monotonic time in nanoseconds.
+ */
+uint64_t riff_clockNs(void);
+
+///@}
+
+/**
+ * @name Writer functions
+ * @{
+ */
+
+/**
+ * @brief Allocate and initialize a riff_writer.
+ * 
+ * @return Pointer to the riff_writer, NULL if allocation failed.
+ */
+riff_writer *riff_writerAllocate();
+/**
+ * @brief Free the memory allocated to a riff_writer.
+ * 
+ * The output stream is not closed, open chunks are not ended. Buffered data is written, see riff_writer::fp_close.
+ * 
+ * @param rw The riff_writer to free.
+ */
+void riff_writerFree(riff_writer *rw);
+
+/**
+ * @brief Set up a riff_writer for C FILE output.
+ * 
+ * @note Writing starts at the current file position. The file must be opened for writing and reading ("wb+"), since chunk sizes are patched.
+ * 
+ * @param rw The riff_writer to initialize.
+ * @param f The FILE pointer to write to.
+ * 
+ * @return RIFF error code.
+ */
+int riff_writer_open_file(riff_writer *rw, FILE *f);
+/**
+ * @brief Set up a riff_writer for POSIX file descriptor output.
+ * 
+ * @note Writing starts at the current file offset. Returns RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+ * 
+ * @param rw The riff_writer to initialize.
+ * @param fd The file descriptor to write to.
+ * 
+ * @return RIFF error code.
+ */
+int riff_writer_open_fd(riff_writer *rw, int fd);
+/**
+ * @brief Set up a riff_writer for buffered output to a POSIX file descriptor.
+ * 
+ * Data is collected in an aligned buffer and written with `pwrite()` in whole buffers, size fields of ended chunks are patched in place.
+ * On Linux the file is preallocated with `fallocate()` in large extents (the file size is not changed by that), written data is handed to writeback
+ * with `sync_file_range()` one window behind the cursor and then dropped from the page cache, so sustained writing doesn't stall on dirty pages.
+ * With RIFF_SINK_DIRECT the page cache is bypassed completely.\n 
+ * Buffered data is written by riff_writeFinish() and riff_writerFree(), which also trims the preallocation and restores the file status flags.
+ * 
+ * @note Writing starts at the current file offset, the file must be open for reading and writing. Returns RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+ * 
+ * @param rw The riff_writer to initialize.
+ * @param fd The file descriptor to write to, it is not closed.
+ * @param cfg Settings, NULL for the defaults (RIFF_SINK_BUFFER_SIZE, RIFF_SINK_ALIGN, RIFF_SINK_PREALLOC, RIFF_SINK_SYNC_WINDOW, buffered I/O).
+ * 
+ * @return RIFF error code.
+ */
+int riff_writer_open_sink(riff_writer *rw, int fd, const struct riff_sinkConfig *cfg);
+
+/**
+ * @brief Start a chunk whose size is not known yet.
+ * 
+ * Write its data with riff_writeData() and subchunks, then end it with riff_writeChunkEnd().
+ * 
+ * @param rw The riff_writer to use.
+ * @param id The chunk ID, 4 characters.
+ * 
+ * @return RIFF error code.
  */
+int riff_writeChunkStart(riff_writer *rw, const char *id);
 /**
- * @name riff_handle allocation/deallocation functions
- * @{
+ * @brief Start a chunk with subchunks, e.g. the file header or a LIST chunk.
+ * 
+ * @param rw The riff_writer to use.
+ * @param id The chunk ID, "RIFF" or "LIST".
+ * @param type The list type, 4 characters.
+ * 
+ * @return RIFF error code.
  */
+int riff_writeListStart(riff_writer *rw, const char *id, const char *type);
 /**
- * @brief Allocate, initialize and return a riff_handle.
+ * @brief Write data to the open chunk.
  * 
- * @return Pointer to the intialized riff_handle.
+ * @param rw The riff_writer to use.
+ * @param ptr The data.
+ * @param size Size of the data in bytes.
+ * 
+ * @return RIFF error code.
  */
-riff_handle *riff_handleAllocate();
+int riff_writeData(riff_writer *rw, const void *ptr, size_t size);
 /**
- * @brief Free the memory allocated to a riff_handle.
+ * @brief End the innermost open chunk.
  * 
- * @param rh The riff_handle to free.
+ * Writes its size into its header and adds a pad byte if the size is odd.
+ * 
+ * @param rw The riff_writer to use.
+ * 
+ * @return RIFF error code, RIFF_ERROR_ICSIZE if the chunk is too large for a 32 bit size field.
  */
-void riff_handleFree(riff_handle *rh);
+int riff_writeChunkEnd(riff_writer *rw);
+/**
+ * @brief Write a complete chunk, including pad byte.
+ * 
+ * @param rw The riff_writer to use.
+ * @param id The chunk ID, 4 characters.
+ * @param ptr The chunk data.
+ * @param size Size of the chunk data in bytes.
+ * 
+ * @return RIFF error code.
+ */
+int riff_writeChunk(riff_writer *rw, const char *id, const void *ptr, size_t size);
+/**
+ * @brief End all open chunks.
+ * 
+ * Buffered data is written out afterwards, see riff_writer::fp_flush.
+ * 
+ * @param rw The riff_writer to use.
+ * 
+ * @return RIFF error code.
+ */
+int riff_writeFinish(riff_writer *rw);
+/**
+ * @brief Turn on commit mode for crash-consistent recording.
+ * 
+ * Whenever the given amount of bytes was written or the given time has passed since the last commit, the size fields of all open chunks
+ * are set to cover the data written so far, see riff_writeCommit(). If the program dies afterwards, the file is a valid RIFF file up to the last commit
+ * instead of having 0 sizes in the file header and in every open list.\n 
+ * Commits are checked at the end of the write functions (riff_writeData(), riff_writeChunk(), ...), a long riff_writeData() call is not interrupted.
+ * 
+ * @param rw The riff_writer to use.
+ * @param bytes Commit interval in bytes, 0 for none.
+ * @param ms Commit interval in milliseconds, 0 for none. Both 0 turns commit mode off.
+ * 
+ * @return RIFF error code.
+ */
+int riff_writerSetCommit(riff_writer *rw, size_t bytes, uint32_t ms);
+/**
+ * @brief Commit now, the size fields of all open chunks are set to the current position.
+ * 
+ * Buffered data is written first (riff_writer::fp_fd), then the size fields in order from the innermost open chunk to the file header, each a 4 byte write.
+ * There is no `fsync()`: a crashed process loses nothing that was committed, surviving a power failure depends on the writeback of the operating system
+ * (e.g. the writeback window of riff_writer_open_sink()).
+ * 
+ * @param rw The riff_writer to use.
+ * 
+ * @return RIFF error code, RIFF_ERROR_ICSIZE if an open chunk is larger than 4 GiB.
+ */
+int riff_writeCommit(riff_writer *rw);
 
 ///@}
 
-
 /**
- * @name Parsing functions
+ * @name Copy functions
  * @{
  */
+
 /**
- * @brief Read to memory block.
- *
- * @param rh The riff_handle to use.
- * @param to The pointer to read data to.
- * @param size The amount of data to read.
+ * @brief Copy the current chunk of a riff_handle to a riff_writer.
  * 
- * @return Amount of successfully read bytes.
- *
- * Does not read beyond end of chunk.
+ * Copies header, data (including subchunks) and pad byte as they are.\n 
+ * If both sides provide a file descriptor (riff_handle::fp_fd and riff_writer::fp_fd) the data is copied inside the kernel with `copy_file_range()` or `sendfile()` on Linux, otherwise through a buffer.
  * 
- * Does not read the pad byte.
+ * @note Afterwards the reader position is at the end of the chunk data.
+ * 
+ * @param rh The riff_handle to copy from.
+ * @param rw The riff_writer to copy to.
+ * 
+ * @return RIFF error code.
  */
-size_t riff_readInChunk(riff_handle *rh, void *to, size_t size);
+int riff_copyChunk(riff_handle *rh, riff_writer *rw);
 /**
- * @brief Seek in current chunk.
- *
- * @param rh The riff_handle to use.
- * @param c_pos The chunk position to seek to.
+ * @brief Copy the current chunk with all its subchunks, dropping subchunks on the way.
+ * 
+ * List chunks are rebuilt recursively, every subchunk is passed to the filter first and only copied if it returns non-zero. Chunks without subchunks are copied with riff_copyChunk().\n 
+ * To copy a whole file, start the header with riff_writeListStart() (riff_handle::h_id, riff_handle::h_type), copy every chunk of level 0 and call riff_writeFinish().
+ * 
+ * @note Afterwards the reader position is at the end of the chunk data, at the same list level.
+ * 
+ * @param rh The riff_handle to copy from.
+ * @param rw The riff_writer to copy to.
+ * @param filter Called with the reader positioned at a subchunk, return non-zero to keep it. NULL keeps everything (same as riff_copyChunk()).
+ * @param user Passed to filter.
  * 
  * @return RIFF error code.
- *
- * @note Only counts the actual data section of the chunk - position 0 is first byte after chunk size (chunk offset 8).
  */
-int riff_seekInChunk(riff_handle *rh, size_t c_pos);
+int riff_copySubtree(riff_handle *rh, riff_writer *rw, int (*filter)(riff_handle *rh, void *user), void *user);
+/**
+ * @brief Compress a RIFF file into a seekable zstd archive.
+ * 
+ * Every frame is compressed independently and starts at a chunk edge, only chunks larger than frame_size are split into several frames.
+ * The seek table follows the frames in a skippable frame, so `zstd -d` still restores the RIFF file. Open the archive with riff_open_zstd().
+ * 
+ * @note File position is changed by this function.
+ * @note Returns RIFF_ERROR_ACCESS if the library was built without zstd.
+ * 
+ * @param rh The riff_handle to read the RIFF file from.
+ * @param rw The riff_writer to write the archive to, written at its current position.
+ * @param level The zstd compression level.
+ * @param frame_size Maximum amount of uncompressed data per frame, 0 for RIFF_ZSTD_FRAME_SIZE.
+ * 
+ * @return RIFF error code.
+ */
+int riff_zstdCompress(riff_handle *rh, riff_writer *rw, int level, size_t frame_size);
 
 ///@}
 
 /**
- * @name Chunk seeking functions
+ * @name Appender functions
+ * 
+ * Several threads appending chunks to the current list of a riff_writer at once.\n 
+ * Every chunk reserves its range of the file with an atomic add and is written with `pwrite()`, there is no lock.
+ * The order of the chunks is the order of the reservations. The sizes of the open lists of the writer are written as usual by
+ * riff_writeChunkEnd() or riff_writeFinish() after the appender is closed.
  * @{
  */
+
+struct riff_appender;
+
 /**
- * @brief Seek to start of next chunk within current level.
+ * @brief Start appending chunks at the current position of a writer.
  * 
- * ID and size are read automatically.
+ * The writer must not be used until riff_appenderClose().
  * 
- * @param rh The riff_handle to use.
+ * @note Requires a file descriptor (riff_writer::fp_fd) without O_DIRECT, e.g. riff_writer_open_fd() or riff_writer_open_sink() without RIFF_SINK_DIRECT.
+ * Returns RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+ * 
+ * @param rw The riff_writer, usually with a list started by riff_writeListStart().
+ * @param ap Receives the appender.
  * 
  * @return RIFF error code.
  */
-int riff_seekNextChunk(struct riff_handle *rh);
-//int riff_seekNextChunkID(struct riff_handle *rh, char *id);  //find and go to next chunk with id (4 byte) in current level, fails if not found - position is invalid then -> maybe not needed, the user can do it via simple loop
+int riff_appenderOpen(riff_writer *rw, struct riff_appender **ap);
 /**
- * @brief Seek to data start of the current chunk.
+ * @brief Append a chunk, can be called from several threads at once.
  * 
- * @param rh The riff_handle to use.
+ * @param ap The appender.
+ * @param id The chunk ID, 4 bytes.
+ * @param ptr The chunk data.
+ * @param size Size of the chunk data.
  * 
  * @return RIFF error code.
  */
-int riff_seekChunkStart(struct riff_handle *rh);
+int riff_appendChunk(struct riff_appender *ap, const char *id, const void *ptr, size_t size);
 /**
- * @brief Seek to the very first chunk of the file.
+ * @brief Append a chunk whose data is written by the caller, can be called from several threads at once.
  * 
- * Rewinds to the same position as just after opening via `riff_open_...()`.
+ * Header and pad byte are written, the data is left to the caller, e.g. with `pwrite()` in several parts.
+ * It must be written before riff_appenderClose().
  * 
- * @param rh The riff_handle to use.
+ * @param ap The appender.
+ * @param id The chunk ID, 4 bytes.
+ * @param size Size of the chunk data.
+ * @param pos Receives the position of the chunk data in the file.
  * 
  * @return RIFF error code.
  */
-int riff_rewind(struct riff_handle *rh);
+int riff_appendReserve(struct riff_appender *ap, const char *id, size_t size, size_t *pos);
 /**
- * @brief Seek to the beginning of the current level.
+ * @brief Stop appending and continue with the writer behind the last chunk.
  * 
- * Seeks to the first data byte of the first chunk in current level.
+ * Must be called after all appending threads are done, the appender is freed.
  * 
- * @param rh The riff_handle to use.
+ * @param ap The appender, can be NULL.
  * 
- * @return RIFF error code.
+ * @return RIFF error code, the first error of any append call if there was one.
  */
-int riff_seekLevelStart(struct riff_handle *rh);
+int riff_appenderClose(struct riff_appender *ap);
 
 ///@}
 
 /**
- * @name Level seeking functions
+ * @name Editing functions
  * @{
  */
 
 /**
- * @brief Go to sub level, load first chunk.
+ * @brief Replace the data of the current chunk in place.
  * 
- * @note Automatically seeks to the start of parent chunk's data.
+ * Only the chunk and a few headers are written, the rest of the file is not moved:
+ * - Same size: the data is overwritten.
+ * - Smaller: the remainder becomes a JUNK chunk, merged with following JUNK and PAD chunks of the same level.
+ * - Larger: following JUNK and PAD chunks of the same level are consumed, the rest of them becomes a JUNK chunk.
+ * - Larger and last chunk of the file: the file grows, the sizes of all parent lists, the file header and the ds64 chunk are updated via the level stack.
  * 
- * @param rh The riff_handle to use.
+ * @note The riff_writer must write to the same file as the riff_handle reads from, e.g. the same FILE opened with "rb+".
+ * @note Afterwards the reader position is at the end of the chunk data.
  * 
- * @return RIFF error code.
+ * @param rh The riff_handle positioned at the chunk to edit.
+ * @param rw The riff_writer to write with.
+ * @param data The new chunk data.
+ * @param size Size of the new chunk data in bytes.
+ * 
+ * @return RIFF error code, RIFF_ERROR_ICSIZE if there is no room for the new size (nothing is written then).
  */
-int riff_seekLevelSub(struct riff_handle *rh);
+int riff_editChunk(riff_handle *rh, riff_writer *rw, const void *data, size_t size);
+
+///@}
 
 /**
- * @brief Step back from sub level.
+ * @name Access hint functions
+ * @{
+ */
+
+/**
+ * @brief Set the access mode, see the RIFF_ACCESS values.
  * 
- * @note The position does not change, you are still inside the data section of the parent list chunk!
+ * Hints are passed to the operating system via riff_handle::fp_advise (posix_fadvise() or madvise()), nothing happens if the source doesn't provide it.\n 
+ * In RIFF_ACCESS_STREAM mode the next window ahead of the position is prefetched and the one behind it is dropped as the payload is read, so large scans don't fill the page cache.
  * 
  * @param rh The riff_handle to use.
+ * @param mode One of the RIFF_ACCESS values.
  * 
  * @return RIFF error code.
  */
-int riff_levelParent(struct riff_handle *rh);
+int riff_setAccessMode(riff_handle *rh, int mode);
+
+///@}
 
 /**
- * @brief Step back from sub level, seek to start of current chunk
- *
- * @param rh The riff_handle to use.
- *
- * @return RIFF error code. 
+ * @name Prefetch functions
+ * @{
  */
-int riff_seekLevelParentStart(struct riff_handle *rh);
 
 /**
- * @brief Step back from sub level, seek to start of next chunk
- *
+ * @brief Start reading ahead chunk headers in a background thread.
+ * 
+ * The thread follows the chunks of the current list level and queues up to `depth` headers with the first `bytes` bytes of their data.
+ * riff_seekNextChunk() takes headers from the queue, riff_readInChunk() serves the queued data. Any other seek restarts the thread at the new position.\n 
+ * Each list level entered keeps its own queue, so the queue of the parent level is still there after riff_levelParent().\n 
+ * This hides the latency of sources where every read is a round trip, e.g. network file systems.
+ * 
+ * @note Requires riff_handle::fp_readAt and a library built with threads (RIFF_THREADS), returns RIFF_ERROR_ACCESS otherwise.
+ * 
  * @param rh The riff_handle to use.
- *
- * @return RIFF error code. 
+ * @param depth Maximum amount of queued chunks, > 0.
+ * @param bytes Amount of data bytes read ahead per chunk, can be 0.
+ * 
+ * @return RIFF error code.
  */
-int riff_seekLevelParentNext(struct riff_handle *rh);
+int riff_prefetchStart(riff_handle *rh, int depth, size_t bytes);
+/**
+ * @brief Stop the prefetch thread and free the queue.
+ * 
+ * Called by riff_handleFree().
+ * 
+ * @param rh The riff_handle to use.
+ */
+void riff_prefetchStop(riff_handle *rh);
 
 ///@}
 
 /**
- * @name Validation functions
- *
- * By the way, *you* are valid too ;)
- *
+ * @name Batch functions
  * @{
  */
 
 /**
- * @brief Validate chunk level structure.
+ * @brief Scan many files on a work-stealing thread pool.
  * 
- * Seeks to the first byte of the current level, then from header to header inside of the current chunk level.
- *
- * @note File position is changed by this function.
+ * Every worker thread owns a riff_handle and a read buffer which it reuses for all files.\n 
+ * Files larger than split_size are split into subtree tasks: level 0 chunks, and the subchunks of lists that are still larger than split_size (up to RIFF_BATCH_SPLIT_DEPTH levels).
+ * Consecutive subtrees are grouped into tasks of about split_size bytes, so small chunks don't cost a task each.
+ * The visitor is then called once per subtree with the handle positioned at its chunk and riff_batchTask::part >= 0, it must only process that chunk. Lists that were split are not visited themselves.\n 
+ * Otherwise the visitor is called once per file with the handle at the first chunk and riff_batchTask::part == -1.\n 
+ * Idle threads steal tasks from the queues of the others. The visitor may be called from several threads at once, results are best stored per riff_batchTask::file.
  * 
- * @param rh The riff_handle to use.
+ * @note Without threads (RIFF_THREADS) all tasks run in the calling thread.
  * 
- * @return RIFF error code.
- */
-int riff_levelValidate(struct riff_handle *rh);
-
-/**
- * @brief Validate file structure.
- *
- * Rewinds to the first chunk of the file, then from header to header inside of the current chunk level. If a level can contain subchunks, it is recursively checked.
- *
- * @note File position is changed by this function.
+ * @param paths The file paths.
+ * @param count Amount of paths.
+ * @param threads Amount of worker threads, 0 for one per CPU.
+ * @param split_size Files and lists larger than this are split into subtree tasks, 0 to never split.
+ * @param visit Called for every task, returns a RIFF error code.
+ * @param user Passed to visit.
+ * @param errors Array of count entries or NULL, receives the most severe error of every file (open error or visitor result).
+ * @param stats Receives the aggregated results, can be NULL.
  * 
- * @param rh The riff_handle to use.
- *
- * @return RIFF error code.
+ * @return RIFF error code of the pool itself, e.g. RIFF_ERROR_MEMORY.
  */
-int riff_fileValidate(struct riff_handle *rh);
+int riff_batch(const char *const *paths, size_t count, int threads, size_t split_size, int (*visit)(riff_handle *rh, const struct riff_batchTask *task, void *user), void *user, int *errors, struct riff_batchStats *stats);
 
 ///@}
 
 /**
- * @name Chunk counting functions
+ * @name Chunk cache functions
  * @{
  */
 
 /**
- * @brief Count chunks in current level.
- *
- * Seeks back to the first chunk of the level, then header to header, counting the chunks. Does not recursively count subchunks.
- *
- * @note File position is changed by this function.
+ * @brief Allocate a chunk data cache.
  * 
- * @param rh The riff_handle to use.
- *
- * @return The amount of chunks in the current level, or -1 if an error occured.
+ * One cache belongs to one source (file or memory block), chunks are identified by the position of their header.
+ * Attach it to every handle reading that source with riff_setCache(), the handles can be used from different threads.
+ * 
+ * @param budget Maximum sum of the data sizes of the cached chunks in bytes. Larger chunks are read into uncached views.
+ * 
+ * @return The cache, or NULL if out of memory.
  */
-int32_t riff_amountOfChunksInLevel(struct riff_handle *rh);
-
+struct riff_cache *riff_cacheAllocate(size_t budget);
 /**
- * @brief Count chunks with a certain ID in current level.
- *
- * Seeks back to the first chunk of the level, then header to header, counting the chunks with the matching ID. Does not recursively count subchunks.
- *
- * @note File position is changed by this function.
+ * @brief Free a chunk cache.
+ * 
+ * Views still held stay valid until they are released, the memory of the cache is freed with the last of them.
+ * 
+ * @param cache The cache, can be NULL.
+ */
+void riff_cacheFree(struct riff_cache *cache);
+/**
+ * @brief Drop every cached chunk, e.g. after the source was modified.
+ * 
+ * @param cache The cache.
+ */
+void riff_cacheClear(struct riff_cache *cache);
+/**
+ * @brief Drop the chunk at a position from the cache.
+ * 
+ * Called by riff_editChunk() for the edited chunk.
+ * 
+ * @param cache The cache.
+ * @param pos Position of the chunk header.
+ */
+void riff_cacheInvalidate(struct riff_cache *cache, size_t pos);
+/**
+ * @brief Get the counters of a chunk cache.
+ * 
+ * @param cache The cache.
+ * @param stats Receives the counters.
+ */
+void riff_cacheGetStats(struct riff_cache *cache, struct riff_cacheStats *stats);
+/**
+ * @brief Attach a chunk cache to a handle.
+ * 
+ * The cache is not freed by riff_handleFree().
  * 
  * @param rh The riff_handle to use.
- * @param id The chunk ID to match against.
- *
- * @return The amount of chunks with the id in the current level, or -1 if an error occured.
+ * @param cache The cache of the source of the handle, NULL to detach.
+ * 
+ * @return RIFF error code.
  */
-int32_t riff_amountOfChunksInLevelWithID(struct riff_handle *rh, const char * id);
-
-///@}
-
+int riff_setCache(riff_handle *rh, struct riff_cache *cache);
 /**
- * @brief Return error string.
+ * @brief Get a view of the data of the current chunk.
  * 
- * @note The current position (riff_handle::pos) tells you where the problem occured in the file.
+ * With a cache attached the data is taken from the cache if present, otherwise it is read and added as the most recently used entry, evicting the least recently used chunks that are not within the budget.
+ * Without a cache the data is read into a new view.\n 
+ * The position in the chunk is not changed.
  * 
- * @param e The error code.
+ * @param rh The riff_handle to use.
+ * @param view Receives the view, release it with riff_chunkViewRelease().
  * 
- * @return Pointer to string with the name of the error.
+ * @return RIFF error code.
  */
-const char *riff_errorToString(int e);
+int riff_readChunkView(riff_handle *rh, const struct riff_chunkView **view);
+/**
+ * @brief Add a reference to a view.
+ * 
+ * @param view The view.
+ */
+void riff_chunkViewRetain(const struct riff_chunkView *view);
+/**
+ * @brief Release a reference to a view, frees it if it was the last one and the chunk is not cached.
+ * 
+ * @param view The view, can be NULL.
+ */
+void riff_chunkViewRelease(const struct riff_chunkView *view);
+
+///@}
 
 /**
  * @name I/O Init functions
@@ -631,6 +2631,76 @@ int riff_open_file(riff_handle *rh, FILE *f, size_t size);
 int riff_open_mem(riff_handle *rh, const void *memptr, size_t size);
 
 
+/**
+ * @brief Initialize RIFF handle and set up FPs for POSIX file descriptor access.
+ * 
+ * Reads with pread(), the file offset of the descriptor is not changed.
+ * 
+ * @note The file offset must be at the start of the RIFF data. Returns RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+ * @note Since the file was opened by the user, it must be closed by the user.
+ * 
+ * @param rh The riff_handle to initialize.
+ * @param fd The file descriptor to read from.
+ * @param size The file size, 0 if unknown (see riff_open_file()).
+ * 
+ * @return RIFF error code.
+ */
+int riff_open_fd(riff_handle *rh, int fd, size_t size);
+
+/**
+ * @brief Initialize RIFF handle and map a file into memory.
+ * 
+ * Data is accessed directly via riff_handle::fp_map like with riff_open_mem(), the mapping is released by riff_handleFree().
+ * 
+ * @note The file offset must be at the start of the RIFF data. Returns RIFF_ERROR_INVALID_HANDLE on systems without mmap().
+ * @note The file descriptor is not closed by the library, it can be closed right after this call.
+ * 
+ * @param rh The riff_handle to initialize.
+ * @param fd The file descriptor to map.
+ * @param size The file size, 0 to map up to the end of the file.
+ * 
+ * @return RIFF error code.
+ */
+int riff_open_mmap(riff_handle *rh, int fd, size_t size);
+
+/**
+ * @brief Initialize RIFF handle and set up FPs for a seekable zstd archive.
+ * 
+ * Reads the seek table of the archive, then decompresses only the frames that are read from.
+ * The last decompressed frames are kept in a cache, reads via riff_handle::fp_readAt are safe from several threads.
+ * 
+ * @note The file offset must be at the start of the archive, the seek table must end at the end of the file.
+ * @note Returns RIFF_ERROR_ACCESS if the library was built without zstd, RIFF_ERROR_ILLID if the file is no seekable archive.
+ * @note The file descriptor is not closed by the library, the cache is released by riff_handleFree().
+ * 
+ * @param rh The riff_handle to initialize.
+ * @param fd The file descriptor of the archive.
+ * @param cache Amount of decompressed frames to keep, 0 for RIFF_ZSTD_CACHE_FRAMES.
+ * 
+ * @return RIFF error code.
+ */
+int riff_open_zstd(riff_handle *rh, int fd, int cache);
+
+/**
+ * @brief Initialize RIFF handle and set up FPs for reading from an HTTP server.
+ * 
+ * Reads with `Range` requests over one keep-alive connection, which is reopened if the server closes it.
+ * The file is fetched in blocks kept in an LRU cache, so the small header reads of a traversal cost a request only every few blocks.
+ * Missing blocks of a read are fetched with a single request, sequential reads fetch more and more blocks ahead (up to half the cache).
+ * 
+ * @note Plain `http://` URLs only, the server must answer range requests with `206 Partial Content` and a `Content-Length`.
+ * @note Returns RIFF_ERROR_INVALID_HANDLE on systems without BSD sockets or for unsupported URLs, RIFF_ERROR_ACCESS if the server can't be reached or doesn't support ranges.
+ * @note The connection and cache are released by riff_handleFree(). Reads via riff_handle::fp_readAt are safe from several threads.
+ * 
+ * @param rh The riff_handle to initialize.
+ * @param url The URL of the RIFF file, `http://host[:port]/path`.
+ * @param block Block size in bytes, 0 for RIFF_HTTP_BLOCK_SIZE.
+ * @param cache Amount of blocks to cache, 0 for RIFF_HTTP_CACHE_BLOCKS.
+ * 
+ * @return RIFF error code.
+ */
+int riff_open_http(riff_handle *rh, const char *url, size_t block, int cache);
+
 //user open - must handle "riff_handle" allocation and setup
 // e.g. for file access via network socket
 // see and use "riff_open_file()" definition as template
@@ -18,10 +18,22 @@ extern "C" {
     #include "riff.h"
 }
 #include <fstream>
+#include <functional>
+#include <string>
+#include <utility>
 #include <vector>
 #if RIFF_CXX17_SUPPORT
 #include <filesystem>
 #endif
+#if RIFF_CXX20_COROUTINES
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
 
 namespace RIFF {
 
@@ -29,10 +41,404 @@ enum fileTypes : int {
     C_FILE      = 0,
     FSTREAM,
     MEM_PTR     = 0x10,
+    FD          = 0x20,     // File descriptor, always opened by the user
     MANUAL      = 0x800000, // For manually opened files
     CLOSED      = -1
 };
 
+/**
+ * @brief Declarative schemas of RIFF forms, checked by RIFFFile::validateSchema().
+ * 
+ * A schema is a tree of constexpr rules. Every list rule lists the chunks its level requires or allows, with their counts, minimal sizes and optionally their order.
+ * Schemas can be checked at compile time with `static_assert(RIFF::Schema::wellFormed(rule), "...")`.
+ */
+namespace Schema {
+
+/**
+ * @brief Maximum count meaning "any amount".
+ */
+constexpr unsigned UNBOUNDED = 0;
+
+/**
+ * @brief Flags of list rules.
+ */
+enum Flags : unsigned {
+    ORDERED     = 1,    ///< The chunks must appear in the order of the rules.
+    STRICT      = 2     ///< Chunks without a matching rule are rejected, otherwise they are skipped.
+};
+
+/**
+ * @brief Kinds of schema violations, see Violation.
+ */
+enum Kind : int {
+    NONE        = 0,    ///< The file matches the schema.
+    FORM,               ///< The form type in the file header does not match.
+    UNEXPECTED,         ///< A chunk has no matching rule in a STRICT list.
+    ORDER,              ///< A chunk appears after a chunk of a later rule in an ORDERED list.
+    TOO_MANY,           ///< A chunk appears more often than allowed.
+    MISSING,            ///< A required chunk is missing.
+    TOO_SMALL           ///< A chunk is smaller than allowed.
+};
+
+/**
+ * @brief A chunk rule.
+ * 
+ * Create rules with chunk(), list() and form() rather than directly.
+ */
+struct Rule {
+    const char * id;        ///< Chunk ID, 4 characters.
+    const char * type;      ///< List type ID, 4 characters, nullptr matches any type and plain chunks.
+    unsigned min;           ///< Minimum count in the level.
+    unsigned max;           ///< Maximum count in the level, UNBOUNDED for any amount.
+    uint32_t minSize;       ///< Minimum chunk data size in bytes.
+    unsigned flags;         ///< Flags for the level of a list, see Flags.
+    const Rule * children;  ///< Rules of the subchunks of a list, nullptr if its content is not checked.
+    size_t count;           ///< Amount of children.
+};
+
+/**
+ * @brief Rule for a plain chunk.
+ */
+constexpr Rule chunk (const char * id, unsigned min = 1, unsigned max = 1, uint32_t minSize = 0) {
+    return Rule{id, nullptr, min, max, minSize, 0, nullptr, 0};
+}
+
+/**
+ * @brief Rule for a list whose content is not checked.
+ */
+constexpr Rule list (const char * type, unsigned min = 1, unsigned max = 1) {
+    return Rule{"LIST", type, min, max, 4, 0, nullptr, 0};
+}
+
+/**
+ * @brief Rule for a list and its subchunks.
+ */
+template <size_t N>
+constexpr Rule list (const char * type, unsigned min, unsigned max, unsigned flags, const Rule (&children)[N]) {
+    return Rule{"LIST", type, min, max, 4, flags, children, N};
+}
+
+/**
+ * @brief Root rule of a form, matches the file header (RIFF or BW64) with the given form type.
+ */
+template <size_t N>
+constexpr Rule form (const char * type, unsigned flags, const Rule (&children)[N]) {
+    return Rule{"RIFF", type, 1, 1, 4, flags, children, N};
+}
+
+constexpr size_t idLength (const char * s) {
+    return *s ? 1 + idLength(s + 1) : 0;
+}
+
+constexpr bool wellFormed (const Rule & rule);
+
+constexpr bool wellFormed (const Rule * rules, size_t count) {
+    return count == 0 || (wellFormed(*rules) && wellFormed(rules + 1, count - 1));
+}
+
+/**
+ * @brief Check a schema at compile time: 4 character IDs, min <= max, and recursively all children.
+ */
+constexpr bool wellFormed (const Rule & rule) {
+    return rule.id != nullptr && idLength(rule.id) == 4
+        && (rule.type == nullptr || idLength(rule.type) == 4)
+        && (rule.max == UNBOUNDED || rule.min <= rule.max)
+        && (rule.children != nullptr || rule.count == 0)
+        && wellFormed(rule.children, rule.count);
+}
+
+/**
+ * @brief Details of the first schema violation found by RIFFFile::validateSchema().
+ */
+struct Violation {
+    int kind = NONE;                ///< One of Kind.
+    size_t pos = 0;                 ///< Position of the offending chunk, or of the list missing a chunk.
+    char id[5] = {0};               ///< ID of the offending chunk, or of the missing one.
+    const Rule * rule = nullptr;    ///< The violated rule, nullptr for UNEXPECTED.
+};
+
+/**
+ * @brief Name of a violation kind.
+ */
+const char * kindToString (int kind);
+
+// WAVE: fmt, optional fact, data (EBU Tech 3306 / Multimedia Programming Interface and Data Specifications 1.0)
+constexpr Rule WAVE_chunks[] = {chunk("fmt ", 1, 1, 16), chunk("fact", 0, 1, 4), chunk("data")};
+/**
+ * @brief Schema of WAVE files.
+ */
+constexpr Rule WAVE = form("WAVE", ORDERED, WAVE_chunks);
+
+// AVI: hdrl with avih and a strl per stream, movi, optional idx1 (AVI RIFF File Reference)
+constexpr Rule AVI_strl[] = {chunk("strh", 1, 1, 48), chunk("strf"), chunk("strd", 0, 1), chunk("strn", 0, 1)};
+constexpr Rule AVI_hdrl[] = {chunk("avih", 1, 1, 56), list("strl", 1, UNBOUNDED, ORDERED, AVI_strl)};
+constexpr Rule AVI_chunks[] = {list("hdrl", 1, 1, ORDERED, AVI_hdrl), list("movi"), chunk("idx1", 0, 1)};
+/**
+ * @brief Schema of AVI files.
+ */
+constexpr Rule AVI = form("AVI ", ORDERED, AVI_chunks);
+
+// DLS: collection header, instruments with regions, pool table and wave pool, no particular order (DLS Level 1/2)
+constexpr Rule DLS_rgn[] = {chunk("rgnh", 1, 1, 12), chunk("wsmp", 0, 1, 20), chunk("wlnk", 1, 1, 12)};
+constexpr Rule DLS_lrgn[] = {list("rgn ", 0, UNBOUNDED, 0, DLS_rgn), list("rgn2", 0, UNBOUNDED, 0, DLS_rgn)};
+constexpr Rule DLS_ins[] = {chunk("insh", 1, 1, 12), list("lrgn", 1, 1, 0, DLS_lrgn)};
+constexpr Rule DLS_lins[] = {list("ins ", 0, UNBOUNDED, 0, DLS_ins)};
+constexpr Rule DLS_wave[] = {chunk("fmt ", 1, 1, 16), chunk("data")};
+constexpr Rule DLS_wvpl[] = {list("wave", 0, UNBOUNDED, 0, DLS_wave)};
+constexpr Rule DLS_chunks[] = {chunk("colh", 1, 1, 4), chunk("vers", 0, 1, 8), list("lins", 1, 1, 0, DLS_lins), chunk("ptbl", 1, 1, 8), list("wvpl", 1, 1, 0, DLS_wvpl)};
+/**
+ * @brief Schema of DLS instrument collections.
+ */
+constexpr Rule DLS = form("DLS ", 0, DLS_chunks);
+
+// ANI: animated cursor header, optional rate and sequence tables, frames as icons
+constexpr Rule ANI_fram[] = {chunk("icon", 1, UNBOUNDED)};
+constexpr Rule ANI_chunks[] = {chunk("anih", 1, 1, 36), chunk("rate", 0, 1), chunk("seq ", 0, 1), list("fram", 1, 1, 0, ANI_fram)};
+/**
+ * @brief Schema of animated cursors.
+ */
+constexpr Rule ANI = form("ACON", 0, ANI_chunks);
+
+static_assert(wellFormed(WAVE) && wellFormed(AVI) && wellFormed(DLS) && wellFormed(ANI), "built-in schema is malformed");
+
+}       // namespace Schema
+
+/**
+ * @brief A shared, reference counted view of the data of a chunk, see riff_readChunkView().
+ * 
+ * Copies share the data, it is released when the last copy is destroyed.
+ */
+class ChunkView {
+    public:
+        ChunkView () {};
+        /**
+         * @brief Take over a reference obtained from riff_readChunkView().
+         */
+        explicit ChunkView (const riff_chunkView * view) : view(view) {};
+        ChunkView (const ChunkView & rhs) : view(rhs.view) {if (view) riff_chunkViewRetain(view);};
+        ChunkView (ChunkView && rhs) : view(rhs.view) {rhs.view = nullptr;};
+        ChunkView & operator = (ChunkView rhs) {std::swap(view, rhs.view); return *this;};
+        ~ChunkView () {riff_chunkViewRelease(view);};
+
+        /**
+         * @brief The chunk data, nullptr if the view is empty.
+         */
+        inline const uint8_t * data () const {return view ? view->data : nullptr;};
+        /**
+         * @brief Size of the chunk data in bytes.
+         */
+        inline size_t size () const {return view ? view->size : 0;};
+        /**
+         * @brief Position of the chunk header.
+         */
+        inline size_t pos () const {return view ? view->pos : 0;};
+        /**
+         * @brief ID of the chunk, empty if the view is empty.
+         */
+        inline const char * id () const {return view ? view->id : "";};
+        /**
+         * @brief Whether the view holds data.
+         */
+        explicit operator bool () const {return view != nullptr;};
+
+    private:
+        const riff_chunkView * view = nullptr;
+};
+
+/**
+ * @brief An LRU cache of chunk data for one source, see riff_cacheAllocate().
+ * 
+ * Attach it to every RIFFFile reading the source with RIFFFile::setCache(), copies of a RIFFFile share the cache.
+ * The cache must outlive the files using it, views may outlive it.
+ */
+class ChunkCache {
+    public:
+        /**
+         * @brief Construct a new ChunkCache object.
+         * 
+         * @param budget Maximum sum of the cached data sizes in bytes.
+         */
+        explicit ChunkCache (size_t budget) : cache(riff_cacheAllocate(budget)) {};
+        ChunkCache (const ChunkCache &) = delete;
+        ChunkCache & operator = (const ChunkCache &) = delete;
+        ~ChunkCache () {riff_cacheFree(cache);};
+
+        /**
+         * @brief Drop every cached chunk.
+         */
+        inline void clear () {riff_cacheClear(cache);};
+        /**
+         * @brief Drop the chunk at a position.
+         */
+        inline void invalidate (size_t pos) {riff_cacheInvalidate(cache, pos);};
+        /**
+         * @brief Get the counters of the cache.
+         */
+        inline riff_cacheStats stats () const {riff_cacheStats s; std::memset(&s, 0, sizeof(s)); riff_cacheGetStats(cache, &s); return s;};
+        /**
+         * @brief Access the riff_cache object, nullptr if the allocation failed.
+         */
+        inline riff_cache * get () const {return cache;};
+
+    private:
+        riff_cache * cache;
+};
+
+#if RIFF_CXX20_COROUTINES
+
+/**
+ * @brief Runs the blocking work of asynchronous operations and resumes the waiting coroutine.
+ * 
+ * Implement this to plug the wrapper into an event loop, e.g. run the work on a thread pool and post the resumption back to the loop.
+ */
+class Executor {
+    public:
+        virtual ~Executor () {};
+
+        /**
+         * @brief Run work, then resume cont.
+         * 
+         * @param work The blocking work, e.g. a call to riff_seekNextChunk().
+         * @param cont The coroutine waiting for the work.
+         * 
+         * @return true if cont will be resumed once the work is done, false if the work already ran to completion and cont must not be resumed (it continues right away).
+         */
+        virtual bool execute (std::function<void ()> work, std::coroutine_handle<> cont) = 0;
+};
+
+/**
+ * @brief Executor running the work right away in the calling thread, it blocks like the synchronous methods.
+ */
+class InlineExecutor : public Executor {
+    public:
+        bool execute (std::function<void ()> work, std::coroutine_handle<>) override {work(); return false;};
+};
+
+/**
+ * @brief Executor running the work in order on one background thread, the coroutine is resumed on that thread.
+ */
+class ThreadExecutor : public Executor {
+    public:
+        ThreadExecutor ();
+        ThreadExecutor (const ThreadExecutor &) = delete;
+        ThreadExecutor & operator = (const ThreadExecutor &) = delete;
+        /**
+         * @brief Finish the queued work and join the thread.
+         */
+        ~ThreadExecutor ();
+
+        bool execute (std::function<void ()> work, std::coroutine_handle<> cont) override;
+
+    private:
+        std::mutex lock;
+        std::condition_variable ready;
+        std::deque<std::pair<std::function<void ()>, std::coroutine_handle<>>> queue;
+        bool stop = false;
+        std::thread thread;
+
+        void run ();
+};
+
+/**
+ * @brief Awaitable running a blocking function on an Executor, co_await returns its result.
+ */
+template <typename T>
+class AsyncOp {
+    public:
+        AsyncOp (Executor & ex, std::function<T ()> fn) : ex(ex), fn(std::move(fn)) {};
+
+        bool await_ready () const noexcept {return false;};
+        bool await_suspend (std::coroutine_handle<> h) {return ex.execute([this] {result = fn();}, h);};
+        T await_resume () {return std::move(result);};
+
+    private:
+        Executor & ex;
+        std::function<T ()> fn;
+        T result {};
+};
+
+/**
+ * @brief Asynchronous generator, the body can co_await and co_yield.
+ * 
+ * Consume it with `while (auto value = co_await gen.next()) {...}`, the pointer is valid until the next call.
+ * 
+ * next() resumes the generator and returns to the consumer without suspending it if a value is there already (e.g. with the InlineExecutor),
+ * so the stack doesn't grow with the amount of values.
+ */
+template <typename T>
+class AsyncGenerator {
+    public:
+        struct promise_type;
+        using handle = std::coroutine_handle<promise_type>;
+
+        /**
+         * @brief Transfers control back to the consumer on co_yield and at the end.
+         * 
+         * Whichever comes second of the yield and the return of NextAwaiter::await_suspend() continues the consumer.
+         */
+        struct YieldAwaiter {
+            bool await_ready () noexcept {return false;};
+            std::coroutine_handle<> await_suspend (handle h) noexcept {
+                auto & p = h.promise();
+                if (p.handoff.exchange(true, std::memory_order_acq_rel)) return p.consumer;  // resumed by an executor, the consumer is suspended
+                return std::noop_coroutine();  // back to NextAwaiter::await_suspend()
+            };
+            void await_resume () noexcept {};
+        };
+
+        struct promise_type {
+            const T * value = nullptr;
+            std::exception_ptr error;
+            std::coroutine_handle<> consumer;
+            std::atomic<bool> handoff {false};
+
+            AsyncGenerator get_return_object () {return AsyncGenerator(handle::from_promise(*this));};
+            std::suspend_always initial_suspend () noexcept {return {};};
+            YieldAwaiter final_suspend () noexcept {value = nullptr; return {};};
+            YieldAwaiter yield_value (const T & v) noexcept {value = std::addressof(v); return {};};
+            void return_void () {};
+            void unhandled_exception () {error = std::current_exception();};
+        };
+
+        /**
+         * @brief Resumes the generator up to its next co_yield, co_await returns the value or nullptr at the end.
+         */
+        struct NextAwaiter {
+            handle h;
+            bool await_ready () noexcept {return !h || h.done();};
+            bool await_suspend (std::coroutine_handle<> c) {
+                auto & p = h.promise();
+                p.consumer = c;
+                p.handoff.store(false, std::memory_order_relaxed);
+                h.resume();
+                return !p.handoff.exchange(true, std::memory_order_acq_rel);  // false: the value is there, the consumer continues
+            };
+            const T * await_resume () {
+                if (!h || h.done()) {
+                    if (h && h.promise().error) std::rethrow_exception(h.promise().error);
+                    return nullptr;
+                }
+                return h.promise().value;
+            };
+        };
+
+        AsyncGenerator (AsyncGenerator && rhs) : coro(rhs.coro) {rhs.coro = nullptr;};
+        AsyncGenerator (const AsyncGenerator &) = delete;
+        AsyncGenerator & operator = (const AsyncGenerator &) = delete;
+        ~AsyncGenerator () {if (coro) coro.destroy();};
+
+        /**
+         * @brief Get the next value.
+         */
+        NextAwaiter next () {return NextAwaiter{coro};};
+
+    private:
+        explicit AsyncGenerator (handle h) : coro(h) {};
+        handle coro;
+};
+
+#endif
+
 /**
  * @brief A lightweight wrapper class around riff_handle
  * 
@@ -267,6 +673,28 @@ class RIFFFile {
          * @return RIFF error code.
          */
         int openMemory (const void * mem_ptr, size_t size = 0);
+        /**
+         * @brief Open a RIFF file from a file descriptor, read with pread(), see riff_open_fd().
+         * 
+         * @note The close() function of the class will not close the file descriptor.
+         * 
+         * @param fd The file descriptor, positioned at the start of the RIFF data.
+         * @param size The expected size of the file, leave blank if unknown.
+         * 
+         * @return RIFF error code.
+         */
+        int openFd (int fd, size_t size = 0);
+        /**
+         * @brief Map a RIFF file into memory, see riff_open_mmap().
+         * 
+         * @note The file descriptor can be closed right after this call, the mapping is released when the object is destroyed.
+         * 
+         * @param fd The file descriptor, positioned at the start of the RIFF data.
+         * @param size The file size, leave blank to map up to the end of the file.
+         * 
+         * @return RIFF error code.
+         */
+        int openMmap (int fd, size_t size = 0);
 
         /**
          * @brief Closes the file.
@@ -298,11 +726,70 @@ class RIFFFile {
         /**
          * @brief Read current chunk's data.
          * 
+         * Served from the chunk cache if one is attached (see setCache()), the position in the chunk is not changed then.
+         * 
          * @note Returns an empty vector if an error occurred.
          * 
          * @return std::vector<uint8_t> with the data.
          */
         std::vector<uint8_t> readChunkData ();
+        /**
+         * @brief Get a shared view of the current chunk's data, see riff_readChunkView().
+         * 
+         * @note Returns an empty view if an error occurred.
+         * 
+         * @return The view.
+         */
+        ChunkView readChunkView ();
+
+#if RIFF_CXX20_COROUTINES
+        /**
+         * @name Coroutine methods
+         * 
+         * The blocking calls run on the given Executor, only one operation may be in flight per file.
+         * @{
+         */
+
+        /**
+         * @brief Asynchronous seekNextChunk().
+         * 
+         * @param ex The executor running the read.
+         * 
+         * @return Awaitable, co_await returns the RIFF error code.
+         */
+        inline AsyncOp<int> nextChunkAsync (Executor & ex) {return AsyncOp<int>(ex, [this] {return seekNextChunk();});};
+        /**
+         * @brief Asynchronous seekLevelSub().
+         * 
+         * @param ex The executor running the read.
+         * 
+         * @return Awaitable, co_await returns the RIFF error code.
+         */
+        inline AsyncOp<int> seekLevelSubAsync (Executor & ex) {return AsyncOp<int>(ex, [this] {return seekLevelSub();});};
+        /**
+         * @brief Asynchronous readChunkData().
+         * 
+         * @param ex The executor running the read.
+         * 
+         * @return Awaitable, co_await returns the data, empty if an error occurred.
+         */
+        inline AsyncOp<std::vector<uint8_t>> readChunkDataAsync (Executor & ex) {return AsyncOp<std::vector<uint8_t>>(ex, [this] {return readChunkData();});};
+        /**
+         * @brief Walk the whole chunk tree asynchronously, depth first in file order.
+         * 
+         * Yields a node for every chunk, with the list type filled in for lists. The tree links (riff_treeNode::parent etc.) are RIFF_TREE_NONE, riff_treeNode::depth is 1 for list level 0 like in riff_parseTree().\n 
+         * The handle is positioned at the yielded chunk, so its data can be read before asking for the next node. Lists have already been entered then, the handle is at their first subchunk.
+         * 
+         * @note The generator ends at the end of the file or on a critical error, see latestError().
+         * 
+         * @param ex The executor running the reads.
+         * 
+         * @return The generator.
+         */
+        AsyncGenerator<riff_treeNode> walkAsync (Executor & ex);
+
+        ///@}
+#endif
         /**
          * @brief Seek in current chunk.
          * 
@@ -329,6 +816,28 @@ class RIFFFile {
          * @return RIFF error code.
          */
         inline int seekNextChunk () {return __latestError = riff_seekNextChunk (rh);};
+        /**
+         * @brief Seek to start of previous chunk within current level, see riff_seekPrevChunk().
+         *
+         * @return RIFF error code.
+         */
+        inline int seekPrevChunk () {return __latestError = riff_seekPrevChunk (rh);};
+        /**
+         * @brief Seek to start of a chunk by its index within current level, see riff_seekChunkIndex().
+         *
+         * @param i Index of the chunk, 0 is the first chunk of the level.
+         *
+         * @return RIFF error code.
+         */
+        inline int seekChunkIndex (int32_t i) {return __latestError = riff_seekChunkIndex (rh, i);};
+        /**
+         * @brief Enable or disable breadcrumbs for seekPrevChunk() and seekChunkIndex(), see riff_setBreadcrumbs().
+         *
+         * @param enable true to record breadcrumbs, false to stop and free them.
+         *
+         * @return RIFF error code.
+         */
+        inline int setBreadcrumbs (bool enable) {return __latestError = riff_setBreadcrumbs (rh, enable);};
         /**
          * @brief Seek back to data start of current chunk.
          * 
@@ -424,6 +933,19 @@ class RIFFFile {
          * @return RIFF error code.
          */
         inline int fileValidate () {return __latestError = riff_fileValidate(rh);}
+        /**
+         * @brief Validate the file against a schema, e.g. RIFF::Schema::AVI.
+         *
+         * Rewinds and walks the whole file once, reading only chunk headers and list type IDs. Besides the size consistency checked by fileValidate(), every list level with a rule is checked for required, allowed and repeated chunks, their minimal sizes and, for ORDERED lists, their order.
+         *
+         * @note File position is changed by this function.
+         * 
+         * @param schema The root rule, created with RIFF::Schema::form().
+         * @param violation Receives the details of the first violation, can be nullptr.
+         * 
+         * @return RIFF error code, RIFF_ERROR_ICSIZE for TOO_SMALL and RIFF_ERROR_ILLID for other violations.
+         */
+        int validateSchema (const Schema::Rule & schema, Schema::Violation * violation = nullptr);
 
         ///@}
 
@@ -456,6 +978,166 @@ class RIFFFile {
          */
         inline int32_t amountOfChunksInLevelWithID (const char * id) {return riff_amountOfChunksInLevelWithID(rh, id);};
 
+        /**
+         * @brief Collect per-ID statistics of the whole file in one pass.
+         *
+         * See riff_collectStats() for details, look up IDs with riff_statsFind().
+         *
+         * @note File position is changed by this function.
+         * @note The statistics must be freed with riff_statsFree().
+         *
+         * @param stats The statistics to fill.
+         *
+         * @return RIFF error code.
+         */
+        inline int collectStats (riff_stats & stats) {return __latestError = riff_collectStats(rh, &stats);};
+
+        ///@}
+
+        /**
+         * @name Chunk tree methods
+         * @{
+         */
+
+        /**
+         * @brief Read the whole chunk hierarchy into a tree.
+         * 
+         * Rewinds, then walks every chunk of the file once, reading only headers.
+         * 
+         * @note File position is changed by this function.
+         * @note The tree must be freed with riff_treeFree().
+         * 
+         * @param tree The tree to fill.
+         * 
+         * @return RIFF error code.
+         */
+        inline int parseTree (riff_tree & tree) {return __latestError = riff_parseTree(rh, &tree);};
+
+        /**
+         * @brief Seek to a chunk of a tree.
+         * 
+         * Enters all parent levels of the chunk, then seeks to its data start.
+         * 
+         * @param tree The tree parsed from this file.
+         * @param node Index of the node to seek to.
+         * 
+         * @return RIFF error code.
+         */
+        inline int seekTreeNode (const riff_tree & tree, int32_t node) {return __latestError = riff_seekTreeNode(rh, &tree, node);};
+
+        ///@}
+
+        /**
+         * @name Chunk hashing methods
+         * @{
+         */
+
+        /**
+         * @brief Hash the data of the current chunk.
+         * 
+         * @note Afterwards the position is at the end of the chunk data.
+         * 
+         * @param hash Receives the hash value.
+         * @param algo The hash algorithm, one of the RIFF_HASH values.
+         * 
+         * @return RIFF error code.
+         */
+        inline int hashChunk (uint64_t & hash, int algo = RIFF_HASH_XXH64) {return __latestError = riff_hashChunk(rh, algo, &hash);};
+
+        /**
+         * @brief Hash every chunk of a tree, Merkle style.
+         * 
+         * See riff_hashTree() for details.
+         * 
+         * @note File position is changed by this method, the file is rewound afterwards.
+         * 
+         * @param tree The tree parsed from this file.
+         * @param algo The hash algorithm, one of the RIFF_HASH values.
+         * @param threads Amount of threads to use, only used for memory sources.
+         * 
+         * @return The hash of every node, empty if an error occurred.
+         */
+        std::vector<uint64_t> hashTree (const riff_tree & tree, int algo = RIFF_HASH_XXH64, int threads = 1);
+
+        ///@}
+
+        /**
+         * @name Diff methods
+         * @{
+         */
+
+        /**
+         * @brief Compare the chunk structure and data of this file (old) with another file (new).
+         * 
+         * See riff_diff() for details.
+         * 
+         * @note File positions of both files are changed by this method, both files are rewound afterwards.
+         * 
+         * @param other The new file.
+         * @param visitor Called for every difference with the event (one of the RIFF_DIFF events) and the tree nodes of both files, nullptr for the missing side. Return true to stop.
+         * @param flags Combination of RIFF_DIFF_TRUST_HASH and RIFF_DIFF_READ_LAYOUT, or 0.
+         * 
+         * @return RIFF error code.
+         */
+        int diff (RIFFFile & other, const std::function<bool (int, const riff_treeNode *, const riff_treeNode *)> & visitor, int flags = 0);
+
+        ///@}
+
+        /**
+         * @name Chunk path methods
+         * @{
+         */
+
+        /**
+         * @brief Seek to the first chunk matching a path.
+         * 
+         * See @ref Path for the syntax.
+         * 
+         * @note File position is changed by this function, even if no chunk matches.
+         * 
+         * @param path The path string.
+         * 
+         * @return RIFF error code, RIFF_ERROR_EOCL if no chunk matches.
+         */
+        inline int seekPath (const char * path) {return __latestError = riff_seekPath(rh, path);};
+        /**
+         * @brief Seek to the first chunk matching a path.
+         * 
+         * See @ref Path for the syntax.
+         * 
+         * @note File position is changed by this function, even if no chunk matches.
+         * 
+         * @param path The path string.
+         * 
+         * @return RIFF error code, RIFF_ERROR_EOCL if no chunk matches.
+         */
+        inline int seekPath (const std::string & path) {return seekPath(path.c_str());};
+        /**
+         * @brief Seek to the first chunk matching a compiled path.
+         * 
+         * @note File position is changed by this function, even if no chunk matches.
+         * 
+         * @param path The path compiled with riff_pathCompile().
+         * 
+         * @return RIFF error code, RIFF_ERROR_EOCL if no chunk matches.
+         */
+        inline int seekPath (const riff_path & path) {return __latestError = riff_seekPathCompiled(rh, &path);};
+        /**
+         * @brief Visit all chunks matching a compiled path.
+         * 
+         * Only enters list chunks that match the current step of the path, all other subtrees are skipped.
+         * 
+         * The visitor is called with the file positioned at the data start of the matching chunk. It may read and seek inside the chunk, but must not change the list level.
+         * 
+         * @note File position is changed by this function.
+         * 
+         * @param path The path compiled with riff_pathCompile().
+         * @param visitor Called for every match, return true to stop (the file then stays at the matching chunk).
+         * 
+         * @return RIFF error code.
+         */
+        int pathForEach (const riff_path & path, const std::function<bool ()> & visitor);
+
         ///@}
 
         /**
@@ -476,6 +1158,82 @@ class RIFFFile {
          */
         std::string latestErrorToString ();
 
+        /**
+         * @brief Enable, resize or disable the diagnostic ring buffer.
+         * 
+         * @param size The amount of records to keep, 0 disables the ring buffer.
+         * 
+         * @return RIFF error code.
+         */
+        inline int diagRingAllocate (size_t size) {return __latestError = riff_diagRingAllocate(rh, size);};
+
+        /**
+         * @brief Get a recent diagnostic record.
+         * 
+         * @param age 0 for the latest record, 1 for the one before, etc.
+         * 
+         * @return Pointer to the record, or nullptr if it is not available.
+         */
+        inline const riff_diag * diag (size_t age = 0) {return riff_diagGet(rh, age);};
+
+        /**
+         * @brief Format a recent diagnostic record as text.
+         * 
+         * @param age 0 for the latest record, 1 for the one before, etc.
+         * 
+         * @return The formatted diagnostic, empty if it is not available.
+         */
+        std::string diagToString (size_t age = 0);
+
+        /**
+         * @brief Get the I/O statistics.
+         * 
+         * @return The riff_ioStats of the riff_handle.
+         */
+        inline const riff_ioStats & ioStats () {return rh->io;};
+
+        /**
+         * @brief Reset the I/O statistics.
+         */
+        inline void ioStatsReset () {riff_ioStatsReset(rh);};
+
+        /**
+         * @brief Set the access mode, see riff_setAccessMode().
+         * 
+         * @param mode One of the RIFF_ACCESS values.
+         * 
+         * @return RIFF error code.
+         */
+        inline int setAccessMode (int mode) {return __latestError = riff_setAccessMode(rh, mode);};
+
+        /**
+         * @brief Start reading ahead chunk headers in a background thread, see riff_prefetchStart().
+         * 
+         * @param depth Maximum amount of queued chunks.
+         * @param bytes Amount of data bytes read ahead per chunk.
+         * 
+         * @return RIFF error code.
+         */
+        inline int prefetchStart (int depth, size_t bytes = 0) {return __latestError = riff_prefetchStart(rh, depth, bytes);};
+
+        /**
+         * @brief Stop the prefetch thread.
+         */
+        inline void prefetchStop () {riff_prefetchStop(rh);};
+
+        /**
+         * @brief Attach a chunk cache, see riff_setCache().
+         * 
+         * @param cache The cache of the source of this file.
+         * 
+         * @return RIFF error code.
+         */
+        inline int setCache (ChunkCache & cache) {return __latestError = riff_setCache(rh, cache.get());};
+        /**
+         * @brief Detach the chunk cache.
+         */
+        inline void resetCache () {riff_setCache(rh, nullptr);};
+
         /**
          * @brief Access the riff_handle object.
          * 
@@ -512,6 +1270,64 @@ class RIFFFile {
 
         void die ();
         void reset ();
+
+        int validateLevel (const Schema::Rule & rule, bool empty, Schema::Violation & violation);
+};
+
+/**
+ * @brief Scans many RIFF files in parallel on a work-stealing thread pool, see riff_batch().
+ * 
+ * The scanner only stores its settings, so one object can run any amount of scans.
+ */
+class BatchScanner {
+    public:
+        /**
+         * @brief Aggregated result of a scan.
+         */
+        struct Result {
+            /**
+             * @brief Most severe error per file, in the order of the paths.
+             */
+            std::vector<int> errors;
+            /**
+             * @brief Task, steal and I/O counters of the scan.
+             */
+            riff_batchStats stats;
+            /**
+             * @brief RIFF error code of the scan itself.
+             */
+            int error = RIFF_ERROR_NONE;
+        };
+
+        /**
+         * @brief Construct a new BatchScanner object.
+         * 
+         * @param threads Amount of worker threads, 0 for one per CPU.
+         * @param splitSize Files larger than this many bytes are split into subtree tasks, 0 to never split.
+         */
+        BatchScanner (int threads = 0, size_t splitSize = 0) : threads(threads), splitSize(splitSize) {};
+
+        /**
+         * @brief Scan files.
+         * 
+         * @note The visitor may be called from several threads at once.
+         * 
+         * @param paths The file paths.
+         * @param visitor Called per file or per subtree with the positioned handle and the task, returns a RIFF error code.
+         * 
+         * @return The errors per file and the statistics.
+         */
+        Result scan (const std::vector<std::string> & paths, const std::function<int (riff_handle *, const riff_batchTask &)> & visitor);
+
+        /**
+         * @brief Amount of worker threads, 0 for one per CPU.
+         */
+        int threads;
+
+        /**
+         * @brief Split size in bytes, 0 to never split.
+         */
+        size_t splitSize;
 };
 
 }       // namespace RIFF
@@ -0,0 +1,175 @@
+// Concurrent chunk appender on top of a riff_writer
+//
+// Producers reserve the range of a chunk with an atomic add on the end position, then write header, data and
+// pad byte with pwrite(). Nothing else is shared, so there is no lock. The writer takes over at the end again
+// when the appender is closed, it patches the sizes of its open lists as usual.
+//
+// Compiles to stubs returning RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //O_DIRECT, pwritev()
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define RIFF_FD 1
+#endif
+#if defined(__linux__)
+#include <sys/uio.h>
+#endif
+
+//atomic also without RIFF_THREADS, the producers are threads of the application
+#define APPEND_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+
+struct riff_appender {
+	riff_writer *rw;
+	int fd;
+	size_t start;  //position of the first chunk
+	size_t end;    //end of the reserved ranges, only changed with APPEND_ADD
+	int error;     //first error of an append call
+};
+
+
+#if RIFF_FD
+
+/*****************************************************************************/
+//remember the first error, returns it
+int append_error(struct riff_appender *ap, int r){
+	int none = RIFF_ERROR_NONE;
+	__atomic_compare_exchange_n(&ap->error, &none, r, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	return r;
+}
+
+/*****************************************************************************/
+//reserve the range of a chunk and write it, data can be NULL to leave it to the caller
+int append_write(struct riff_appender *ap, const char *id, const void *ptr, size_t size, size_t *pos){
+	if(ap == NULL  ||  id == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	if(size > 0xFFFFFFFF)
+		return RIFF_ERROR_ICSIZE;
+
+	uint8_t hdr[RIFF_CHUNK_DATA_OFFSET];
+	memcpy(hdr, id, 4);
+	hdr[4] = size & 0xFF;
+	hdr[5] = (size >> 8) & 0xFF;
+	hdr[6] = (size >> 16) & 0xFF;
+	hdr[7] = (size >> 24) & 0xFF;
+	size_t pad = size & 1;
+	size_t cpos = APPEND_ADD(&ap->end, RIFF_CHUNK_DATA_OFFSET + size + pad);
+	if(pos != NULL)
+		*pos = cpos + RIFF_CHUNK_DATA_OFFSET;
+
+	if(ptr == NULL){
+		//header and pad byte only
+		if(riff_writeAtFd(ap->fd, hdr, RIFF_CHUNK_DATA_OFFSET, cpos) != RIFF_CHUNK_DATA_OFFSET
+			||  (pad  &&  riff_writeAtFd(ap->fd, "", 1, cpos + RIFF_CHUNK_DATA_OFFSET + size) != 1))
+			return append_error(ap, RIFF_ERROR_ACCESS);
+		return RIFF_ERROR_NONE;
+	}
+
+#if defined(__linux__)
+	//everything with one call
+	struct iovec iov[3] = {{hdr, RIFF_CHUNK_DATA_OFFSET}, {(void *)ptr, size}, {"", pad}};
+	ssize_t n = pwritev(ap->fd, iov, 3, cpos);
+	if(n == (ssize_t)(RIFF_CHUNK_DATA_OFFSET + size + pad))
+		return RIFF_ERROR_NONE;
+	if(n < 0)
+		n = 0;
+	//short write, write the rest piece by piece
+	size_t done = n;
+#else
+	size_t done = 0;
+#endif
+	if(done < RIFF_CHUNK_DATA_OFFSET){
+		if(riff_writeAtFd(ap->fd, hdr + done, RIFF_CHUNK_DATA_OFFSET - done, cpos + done) != RIFF_CHUNK_DATA_OFFSET - done)
+			return append_error(ap, RIFF_ERROR_ACCESS);
+		done = RIFF_CHUNK_DATA_OFFSET;
+	}
+	size_t d = done - RIFF_CHUNK_DATA_OFFSET;
+	if(d < size  &&  riff_writeAtFd(ap->fd, (const uint8_t *)ptr + d, size - d, cpos + done) != size - d)
+		return append_error(ap, RIFF_ERROR_ACCESS);
+	if(pad  &&  d <= size  &&  riff_writeAtFd(ap->fd, "", 1, cpos + RIFF_CHUNK_DATA_OFFSET + size) != 1)
+		return append_error(ap, RIFF_ERROR_ACCESS);
+	return RIFF_ERROR_NONE;
+}
+
+#endif
+
+/*****************************************************************************/
+//description: see header file
+int riff_appenderOpen(riff_writer *rw, struct riff_appender **ap){
+#if RIFF_FD
+	if(rw == NULL  ||  ap == NULL  ||  rw->fp_write == NULL  ||  rw->fp_fd == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	int fd = rw->fp_fd(rw); //buffered data of the writer is written now
+	if(fd < 0)
+		return RIFF_ERROR_ACCESS;
+#if defined(O_DIRECT)
+	int fl = fcntl(fd, F_GETFL);
+	if(fl < 0  ||  (fl & O_DIRECT))
+		return RIFF_ERROR_ACCESS; //unaligned pwrite() would fail
+#endif
+
+	struct riff_appender *a = calloc(1, sizeof(struct riff_appender));
+	if(a == NULL)
+		return RIFF_ERROR_MEMORY;
+	a->rw = rw;
+	a->fd = fd;
+	a->start = rw->pos;
+	a->end = rw->pos;
+	*ap = a;
+	return RIFF_ERROR_NONE;
+#else
+	(void)rw; (void)ap;
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_appendChunk(struct riff_appender *ap, const char *id, const void *ptr, size_t size){
+#if RIFF_FD
+	if(ptr == NULL  &&  size > 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	return append_write(ap, id, ptr != NULL ? ptr : "", size, NULL);
+#else
+	(void)ap; (void)id; (void)ptr; (void)size;
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_appendReserve(struct riff_appender *ap, const char *id, size_t size, size_t *pos){
+#if RIFF_FD
+	if(pos == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	return append_write(ap, id, NULL, size, pos);
+#else
+	(void)ap; (void)id; (void)size; (void)pos;
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_appenderClose(struct riff_appender *ap){
+	if(ap == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	riff_writer *rw = ap->rw;
+	rw->bytes_written += ap->end - ap->start;
+	rw->pos = ap->end;
+	rw->fp_seek(rw, ap->end);
+	int r = ap->error;
+	free(ap);
+	return r;
+}
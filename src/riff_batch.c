@@ -0,0 +1,437 @@
+// Batch scanning of many files on a work-stealing thread pool
+//
+// Every worker owns a task queue, a riff_handle and buffers. Owners take their newest task, idle workers steal the oldest task of another queue.
+// Huge files are split into subtree tasks by the worker that opens them, so their parts spread over the pool by stealing.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //sysconf()
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if RIFF_THREADS
+#include <pthread.h>
+#define BATCH_LOCK(m) pthread_mutex_lock(m)
+#define BATCH_UNLOCK(m) pthread_mutex_unlock(m)
+#else
+#define BATCH_LOCK(m)
+#define BATCH_UNLOCK(m)
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+#define RIFF_BATCH_BUFFER_SIZE (1 << 16)  //size of the scratch and the stdio buffer of each worker
+
+
+//task queue of a worker
+struct batch_queue {
+#if RIFF_THREADS
+	pthread_mutex_t lock;
+#endif
+	struct riff_batchTask *tasks;
+	size_t head;  //oldest task, stolen by others
+	size_t tail;  //end, the owner pushes and pops here
+	size_t cap;
+};
+
+struct batch_pool {
+	const char *const *paths;
+	size_t split_size;
+	int (*visit)(riff_handle *rh, const struct riff_batchTask *task, void *user);
+	void *user;
+
+	int nqueues;
+	struct batch_queue *queues;
+
+#if RIFF_THREADS
+	pthread_mutex_t lock;  //protects everything below
+	pthread_cond_t cond;   //new task pushed or all done
+#endif
+	size_t pending;    //tasks pushed but not finished
+	unsigned version;  //incremented on every push, so idle workers don't miss one
+	int *errors;
+	struct riff_batchStats stats;
+	int failed;        //allocation failure of the pool
+};
+
+struct batch_worker {
+	struct batch_pool *pool;
+	int index;
+	riff_handle *rh;
+	uint8_t *buf;     //scratch buffer for the visitor
+	uint8_t *iobuf;   //stdio buffer
+};
+
+
+/*****************************************************************************/
+//add task to the end of a queue
+int batch_push(struct batch_pool *pool, int q, const struct riff_batchTask *t){
+	struct batch_queue *queue = pool->queues + q;
+	BATCH_LOCK(&queue->lock);
+	if(queue->tail == queue->cap){
+		//compact or grow
+		size_t n = queue->tail - queue->head;
+		if(queue->head > 0  &&  n < queue->cap / 2)
+			memmove(queue->tasks, queue->tasks + queue->head, n * sizeof(struct riff_batchTask));
+		else {
+			size_t capnew = queue->cap > 0 ? queue->cap * 2 : 64;
+			struct riff_batchTask *tasksnew = realloc(queue->tasks, capnew * sizeof(struct riff_batchTask));
+			if(tasksnew == NULL){
+				BATCH_UNLOCK(&queue->lock);
+				return RIFF_ERROR_MEMORY;
+			}
+			queue->tasks = tasksnew;
+			queue->cap = capnew;
+			if(queue->head > 0)
+				memmove(queue->tasks, queue->tasks + queue->head, n * sizeof(struct riff_batchTask));
+		}
+		queue->head = 0;
+		queue->tail = n;
+	}
+	queue->tasks[queue->tail++] = *t;
+	BATCH_UNLOCK(&queue->lock);
+
+	BATCH_LOCK(&pool->lock);
+	pool->pending++;
+	pool->version++;
+#if RIFF_THREADS
+	pthread_cond_broadcast(&pool->cond);
+#endif
+	BATCH_UNLOCK(&pool->lock);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//take task from a queue, newest one for the owner, oldest one for thieves
+int batch_take(struct batch_queue *queue, struct riff_batchTask *t, int steal){
+	int r = 0;
+	BATCH_LOCK(&queue->lock);
+	if(queue->tail > queue->head){
+		*t = steal ? queue->tasks[queue->head++] : queue->tasks[--queue->tail];
+		r = 1;
+	}
+	BATCH_UNLOCK(&queue->lock);
+	return r;
+}
+
+/*****************************************************************************/
+//record result of a task
+void batch_done(struct batch_pool *pool, struct batch_worker *w, const struct riff_batchTask *t, int r, int stolen){
+	BATCH_LOCK(&pool->lock);
+	if(r > pool->errors[t->file])
+		pool->errors[t->file] = r;
+	pool->stats.tasks++;
+	if(stolen)
+		pool->stats.stolen++;
+
+	struct riff_ioStats *a = &pool->stats.io, *b = &w->rh->io;
+	a->reads += b->reads;
+	a->seeks += b->seeks;
+	a->seeks_backward += b->seeks_backward;
+	a->bytes_read += b->bytes_read;
+	a->bytes_header += b->bytes_header;
+	a->bytes_payload += b->bytes_payload;
+	a->time_read += b->time_read;
+	a->time_seek += b->time_seek;
+
+	pool->pending--;
+#if RIFF_THREADS
+	if(pool->pending == 0)
+		pthread_cond_broadcast(&pool->cond);
+#endif
+	BATCH_UNLOCK(&pool->lock);
+}
+
+/*****************************************************************************/
+//make the handle of the worker fresh again, keeping the level stack allocation
+void batch_reset(riff_handle *rh){
+	riff_handleClose(rh);
+	free(rh->diag_ring);
+	riff_levelFreeCrumbs(rh);
+	struct riff_levelStackE *ls = rh->ls;
+	size_t ls_size = rh->ls_size;
+	memset(rh, 0, sizeof(riff_handle));
+	rh->ls = ls;
+	rh->ls_size = ls_size;
+}
+
+/*****************************************************************************/
+//push the collected range of chunks as one task
+int batch_pushRange(struct batch_worker *w, struct riff_batchTask *range, size_t *bytes){
+	if(range->count == 0)
+		return RIFF_ERROR_NONE;
+	int r = batch_push(w->pool, w->index, range);
+	range->count = 0;
+	*bytes = 0;
+	return r;
+}
+
+/*****************************************************************************/
+//split the current level into subtree tasks, consecutive chunks are grouped into ranges of about split_size bytes
+int batch_split(struct batch_worker *w, struct riff_batchTask *t, int depth, int32_t *parts){
+	struct batch_pool *pool = w->pool;
+	riff_handle *rh = w->rh;
+	struct riff_batchTask range = *t;
+	size_t bytes = 0; //size of the chunks in range
+	int r;
+	range.count = 0;
+	do {
+		int list = memcmp(rh->c_id, "LIST", 4) == 0  ||  memcmp(rh->c_id, "RIFF", 4) == 0  ||  memcmp(rh->c_id, "BW64", 4) == 0;
+		t->pos[depth] = rh->c_pos_start;
+		if(list  &&  rh->c_size > pool->split_size  &&  depth + 1 < RIFF_BATCH_SPLIT_DEPTH  &&  rh->c_size > 4
+			&&  riff_seekLevelSub(rh) == RIFF_ERROR_NONE){
+			//the range ends before the split list, parts stay in file order
+			if((r = batch_pushRange(w, &range, &bytes)) != RIFF_ERROR_NONE)
+				return r;
+			r = batch_split(w, t, depth + 1, parts);
+			riff_levelParent(rh);
+			if(r >= RIFF_ERROR_CRITICAL)
+				return r;
+		}
+		else {
+			if(range.count == 0){
+				memcpy(range.pos, t->pos, sizeof(range.pos));
+				range.depth = depth + 1;
+				range.part = *parts;
+			}
+			range.count++;
+			(*parts)++;
+			bytes += RIFF_CHUNK_DATA_OFFSET + rh->c_size + rh->pad;
+			if(bytes >= pool->split_size  &&  (r = batch_pushRange(w, &range, &bytes)) != RIFF_ERROR_NONE)
+				return r;
+		}
+	} while((r = riff_seekNextChunk(rh)) == RIFF_ERROR_NONE);
+	int p = batch_pushRange(w, &range, &bytes);
+	if(p != RIFF_ERROR_NONE)
+		return p;
+	return r == RIFF_ERROR_EOCL ? RIFF_ERROR_NONE : r;
+}
+
+/*****************************************************************************/
+//read the chunk header at pos
+int batch_seek(riff_handle *rh, size_t pos){
+	rh->pos = pos;
+	rh->c_pos = 0;
+	riff_ioSeek(rh, rh->pos);
+	return riff_readChunkHeader(rh);
+}
+
+/*****************************************************************************/
+//run a task: open the file, split it or position at the subtree, visit
+int batch_run(struct batch_worker *w, struct riff_batchTask *t){
+	struct batch_pool *pool = w->pool;
+	riff_handle *rh = w->rh;
+	int r, v = RIFF_ERROR_NONE, d;
+	int32_t k;
+
+	batch_reset(rh);
+	FILE *f = fopen(t->path, "rb");
+	if(f == NULL)
+		return RIFF_ERROR_ACCESS;
+	setvbuf(f, (char *)w->iobuf, _IOFBF, RIFF_BATCH_BUFFER_SIZE);
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	r = riff_open_file(rh, f, size);
+	if(r < RIFF_ERROR_CRITICAL){
+		t->thread = w->index;
+		t->buf = w->buf;
+		t->buf_size = RIFF_BATCH_BUFFER_SIZE;
+		if(t->part < 0  &&  pool->split_size > 0  &&  size > pool->split_size){
+			int32_t parts = 0;
+			struct riff_batchTask sub = *t;
+			v = batch_split(w, &sub, 0, &parts);
+		}
+		else if(t->part < 0)
+			v = pool->visit(rh, t, pool->user);
+		else {
+			//enter the parent lists, then go to the first subtree of the range
+			for(d = 0; d < t->depth  &&  v == RIFF_ERROR_NONE; d++){
+				v = batch_seek(rh, t->pos[d]);
+				if(v == RIFF_ERROR_NONE  &&  d + 1 < t->depth)
+					v = riff_seekLevelSub(rh);
+			}
+			//visit every subtree of the range, the visitor may leave the handle anywhere
+			struct riff_batchTask vt = *t;
+			int level = rh->ls_level;
+			for(k = 0; k < t->count  &&  v == RIFF_ERROR_NONE; k++){
+				size_t next = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET + rh->c_size + rh->pad;
+				vt.part = t->part + k;
+				v = pool->visit(rh, &vt, pool->user);
+				if(v == RIFF_ERROR_NONE  &&  k + 1 < t->count){
+					while(rh->ls_level > level)
+						riff_levelParent(rh);
+					v = batch_seek(rh, next);
+				}
+			}
+		}
+	}
+	fclose(f);
+	return v > r ? v : r;
+}
+
+/*****************************************************************************/
+void *batch_worker(void *arg){
+	struct batch_worker *w = (struct batch_worker *)arg;
+	struct batch_pool *pool = w->pool;
+	struct riff_batchTask t;
+
+	for(;;){
+		BATCH_LOCK(&pool->lock);
+		unsigned version = pool->version;
+		BATCH_UNLOCK(&pool->lock);
+
+		int stolen = 0, q;
+		int found = batch_take(pool->queues + w->index, &t, 0);
+		for(q = 1; !found  &&  q < pool->nqueues; q++)
+			found = stolen = batch_take(pool->queues + (w->index + q) % pool->nqueues, &t, 1);
+
+		if(found){
+			int r = batch_run(w, &t);
+			batch_done(pool, w, &t, r, stolen);
+			continue;
+		}
+
+		//nothing to do, wait for new tasks or the end
+		BATCH_LOCK(&pool->lock);
+		int end = pool->pending == 0;
+#if RIFF_THREADS
+		if(!end  &&  version == pool->version)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+#else
+		(void)version;
+#endif
+		BATCH_UNLOCK(&pool->lock);
+		if(end)
+			break;
+	}
+	return NULL;
+}
+
+
+/*****************************************************************************/
+//description: see header file
+int riff_batch(const char *const *paths, size_t count, int threads, size_t split_size, int (*visit)(riff_handle *rh, const struct riff_batchTask *task, void *user), void *user, int *errors, struct riff_batchStats *stats){
+	if(paths == NULL  ||  visit == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+
+#if RIFF_THREADS
+	if(threads <= 0){
+		threads = 1;
+	#if defined(_SC_NPROCESSORS_ONLN)
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		if(n > 0)
+			threads = n;
+	#endif
+	}
+#else
+	threads = 1;
+#endif
+
+	struct batch_pool pool;
+	memset(&pool, 0, sizeof(struct batch_pool));
+	pool.paths = paths;
+	pool.split_size = split_size;
+	pool.visit = visit;
+	pool.user = user;
+	pool.nqueues = threads;
+
+	int r = RIFF_ERROR_MEMORY, i;
+	size_t k;
+	pool.queues = calloc(threads, sizeof(struct batch_queue));
+	pool.errors = calloc(count > 0 ? count : 1, sizeof(int));
+	struct batch_worker *workers = calloc(threads, sizeof(struct batch_worker));
+	if(pool.queues == NULL  ||  pool.errors == NULL  ||  workers == NULL)
+		goto end;
+	for(i = 0; i < threads; i++){
+		workers[i].pool = &pool;
+		workers[i].index = i;
+		workers[i].rh = riff_handleAllocate();
+		workers[i].buf = malloc(RIFF_BATCH_BUFFER_SIZE);
+		workers[i].iobuf = malloc(RIFF_BATCH_BUFFER_SIZE);
+		if(workers[i].rh == NULL  ||  workers[i].buf == NULL  ||  workers[i].iobuf == NULL)
+			goto end;
+	}
+#if RIFF_THREADS
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	for(i = 0; i < threads; i++)
+		pthread_mutex_init(&pool.queues[i].lock, NULL);
+#endif
+
+	//deal out the files round robin
+	for(k = 0; k < count; k++){
+		struct riff_batchTask t;
+		memset(&t, 0, sizeof(struct riff_batchTask));
+		t.path = paths[k];
+		t.file = k;
+		t.part = -1;
+		if((r = batch_push(&pool, k % threads, &t)) != RIFF_ERROR_NONE)
+			goto destroy;
+	}
+	r = RIFF_ERROR_NONE;
+
+#if RIFF_THREADS
+	{
+		pthread_t *th = malloc(threads * sizeof(pthread_t));
+		char *started = calloc(threads, 1); //a failed thread just leaves its queue to be stolen from
+		if(th != NULL  &&  started != NULL)
+			for(i = 1; i < threads; i++)
+				started[i] = pthread_create(th + i, NULL, batch_worker, workers + i) == 0;
+		batch_worker(workers);
+		if(th != NULL  &&  started != NULL)
+			for(i = 1; i < threads; i++)
+				if(started[i])
+					pthread_join(th[i], NULL);
+		free(started);
+		free(th);
+	}
+#else
+	batch_worker(workers);
+#endif
+
+	pool.stats.files = count;
+	for(k = 0; k < count; k++)
+		if(pool.errors[k] >= RIFF_ERROR_CRITICAL)
+			pool.stats.failed++;
+	if(errors != NULL)
+		memcpy(errors, pool.errors, count * sizeof(int));
+	if(stats != NULL)
+		*stats = pool.stats;
+
+destroy:
+#if RIFF_THREADS
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+	for(i = 0; i < threads; i++)
+		pthread_mutex_destroy(&pool.queues[i].lock);
+#endif
+end:
+	if(workers != NULL){
+		for(i = 0; i < threads; i++){
+			if(workers[i].rh != NULL){
+				batch_reset(workers[i].rh);
+				riff_handleFree(workers[i].rh);
+			}
+			free(workers[i].buf);
+			free(workers[i].iobuf);
+		}
+	}
+	if(pool.queues != NULL)
+		for(i = 0; i < threads; i++)
+			free(pool.queues[i].tasks);
+	free(pool.queues);
+	free(pool.errors);
+	free(workers);
+	return r;
+}
@@ -0,0 +1,369 @@
+// LRU cache of chunk data, keyed by the position of the chunk header
+//
+// Entries hold the data right behind the entry struct and are reference counted.
+// An evicted entry is only unlinked from the cache, the last release of a view frees it.
+// The cache lives as long as such entries are held, their release still takes its lock.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if RIFF_THREADS
+#include <pthread.h>
+#define CACHE_LOCK(c) pthread_mutex_lock(&(c)->lock)
+#define CACHE_UNLOCK(c) pthread_mutex_unlock(&(c)->lock)
+#else
+#define CACHE_LOCK(c)
+#define CACHE_UNLOCK(c)
+#endif
+
+
+#define RIFF_CACHE_BUCKETS 64  //initial hash table size, doubled when the entries exceed it
+
+
+struct riff_cacheEntry {
+	struct riff_chunkView view;  //must be first, views are cast to entries
+	struct riff_cache *cache;
+	int refs;     //views held by users
+	int cached;   //linked into the hash table and LRU list
+	struct riff_cacheEntry *hnext;  //hash chain
+	struct riff_cacheEntry *prev;   //more recently used
+	struct riff_cacheEntry *next;   //less recently used
+};
+
+struct riff_cache {
+#if RIFF_THREADS
+	pthread_mutex_t lock;
+#endif
+	size_t budget;
+	struct riff_cacheEntry **buckets;
+	size_t nbuckets;
+	struct riff_cacheEntry *head;  //most recently used
+	struct riff_cacheEntry *tail;  //least recently used
+	struct riff_cacheStats stats;
+	size_t held;  //evicted entries still held by views
+	int freed;    //riff_cacheFree() was called, the last release of a held entry frees the cache
+};
+
+
+/*****************************************************************************/
+size_t cache_bucket(const struct riff_cache *cache, size_t pos){
+	uint64_t h = (uint64_t)pos * 0x9E3779B97F4A7C15ULL; //Fibonacci hashing, chunk positions are even
+	return (size_t)(h >> 32) & (cache->nbuckets - 1);
+}
+
+/*****************************************************************************/
+//unlink entry from the hash table and LRU list, frees it if no view is held
+void cache_remove(struct riff_cache *cache, struct riff_cacheEntry *e){
+	struct riff_cacheEntry **p = cache->buckets + cache_bucket(cache, e->view.pos);
+	while(*p != e)
+		p = &(*p)->hnext;
+	*p = e->hnext;
+
+	if(e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if(e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+
+	cache->stats.entries--;
+	cache->stats.bytes -= e->view.size;
+	e->cached = 0;
+	if(e->refs == 0)
+		free(e);
+	else
+		cache->held++;
+}
+
+/*****************************************************************************/
+//free the cache itself, no entries are left
+void cache_destroy(struct riff_cache *cache){
+#if RIFF_THREADS
+	pthread_mutex_destroy(&cache->lock);
+#endif
+	free(cache->buckets);
+	free(cache);
+}
+
+/*****************************************************************************/
+//move entry to the front of the LRU list
+void cache_touch(struct riff_cache *cache, struct riff_cacheEntry *e){
+	if(cache->head == e)
+		return;
+	e->prev->next = e->next;
+	if(e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+	e->prev = NULL;
+	e->next = cache->head;
+	cache->head->prev = e;
+	cache->head = e;
+}
+
+/*****************************************************************************/
+//double the hash table, the old one is kept if allocation fails
+void cache_grow(struct riff_cache *cache){
+	size_t nold = cache->nbuckets;
+	struct riff_cacheEntry **old = cache->buckets;
+	struct riff_cacheEntry **bnew = calloc(nold * 2, sizeof(struct riff_cacheEntry *));
+	if(bnew == NULL)
+		return;
+	cache->buckets = bnew;
+	cache->nbuckets = nold * 2;
+	size_t i;
+	for(i = 0; i < nold; i++){
+		struct riff_cacheEntry *e = old[i], *hnext;
+		for(; e != NULL; e = hnext){
+			hnext = e->hnext;
+			size_t b = cache_bucket(cache, e->view.pos);
+			e->hnext = bnew[b];
+			bnew[b] = e;
+		}
+	}
+	free(old);
+}
+
+/*****************************************************************************/
+//find entry, must be locked
+struct riff_cacheEntry *cache_find(struct riff_cache *cache, size_t pos){
+	struct riff_cacheEntry *e = cache->buckets[cache_bucket(cache, pos)];
+	while(e != NULL  &&  e->view.pos != pos)
+		e = e->hnext;
+	return e;
+}
+
+/*****************************************************************************/
+//add entry as most recently used and evict down to the budget, must be locked
+void cache_insert(struct riff_cache *cache, struct riff_cacheEntry *e){
+	while(cache->tail != NULL  &&  cache->stats.bytes + e->view.size > cache->budget){
+		cache_remove(cache, cache->tail);
+		cache->stats.evictions++;
+	}
+	if(cache->stats.entries >= cache->nbuckets)
+		cache_grow(cache);
+
+	size_t b = cache_bucket(cache, e->view.pos);
+	e->hnext = cache->buckets[b];
+	cache->buckets[b] = e;
+	e->prev = NULL;
+	e->next = cache->head;
+	if(cache->head != NULL)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+	e->cached = 1;
+	cache->stats.entries++;
+	cache->stats.bytes += e->view.size;
+}
+
+/*****************************************************************************/
+//read the data of the current chunk into a new entry, position in the chunk is kept
+int cache_read(riff_handle *rh, struct riff_cacheEntry **entry){
+	size_t size = rh->c_size;
+	struct riff_cacheEntry *e = malloc(sizeof(struct riff_cacheEntry) + size);
+	if(e == NULL)
+		return RIFF_ERROR_MEMORY;
+	memset(e, 0, sizeof(struct riff_cacheEntry));
+	uint8_t *data = (uint8_t *)(e + 1);
+	e->view.data = data;
+	e->view.size = size;
+	e->view.pos = rh->c_pos_start;
+	memcpy(e->view.id, rh->c_id, 5);
+	e->refs = 1;
+
+	size_t n = 0;
+	if(rh->fp_readAt != NULL){
+		//positional read, the stream is not touched
+		n = rh->fp_readAt(rh, data, size, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET);
+		rh->io.reads++;
+		rh->io.bytes_read += n;
+		rh->io.bytes_payload += n;
+	}
+	else {
+		size_t c_pos = rh->c_pos, k;
+		riff_seekInChunk(rh, 0);
+		while(n < size  &&  (k = riff_readInChunk(rh, data + n, size - n)) > 0)
+			n += k;
+		riff_seekInChunk(rh, c_pos);
+	}
+	if(n != size){
+		free(e);
+		return riff_report(rh, RIFF_ERROR_EOF, RIFF_DIAG_CHUNK_DATA_SHORT, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET, rh->c_id, size, n);
+	}
+	*entry = e;
+	return RIFF_ERROR_NONE;
+}
+
+
+/*****************************************************************************/
+//description: see header file
+struct riff_cache *riff_cacheAllocate(size_t budget){
+	struct riff_cache *cache = calloc(1, sizeof(struct riff_cache));
+	if(cache == NULL)
+		return NULL;
+	cache->buckets = calloc(RIFF_CACHE_BUCKETS, sizeof(struct riff_cacheEntry *));
+	if(cache->buckets == NULL){
+		free(cache);
+		return NULL;
+	}
+	cache->nbuckets = RIFF_CACHE_BUCKETS;
+	cache->budget = budget;
+#if RIFF_THREADS
+	pthread_mutex_init(&cache->lock, NULL);
+#endif
+	return cache;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_cacheFree(struct riff_cache *cache){
+	if(cache == NULL)
+		return;
+	CACHE_LOCK(cache);
+	while(cache->tail != NULL)
+		cache_remove(cache, cache->tail);
+	cache->freed = 1;
+	int last = cache->held == 0; //else the release of the last held view frees it
+	CACHE_UNLOCK(cache);
+	if(last)
+		cache_destroy(cache);
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_cacheClear(struct riff_cache *cache){
+	if(cache == NULL)
+		return;
+	CACHE_LOCK(cache);
+	while(cache->tail != NULL)
+		cache_remove(cache, cache->tail);
+	CACHE_UNLOCK(cache);
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_cacheInvalidate(struct riff_cache *cache, size_t pos){
+	if(cache == NULL)
+		return;
+	CACHE_LOCK(cache);
+	struct riff_cacheEntry *e = cache_find(cache, pos);
+	if(e != NULL)
+		cache_remove(cache, e);
+	CACHE_UNLOCK(cache);
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_cacheGetStats(struct riff_cache *cache, struct riff_cacheStats *stats){
+	if(cache == NULL  ||  stats == NULL)
+		return;
+	CACHE_LOCK(cache);
+	*stats = cache->stats;
+	CACHE_UNLOCK(cache);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_setCache(riff_handle *rh, struct riff_cache *cache){
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	rh->cache = cache;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_readChunkView(riff_handle *rh, const struct riff_chunkView **view){
+	if(rh == NULL  ||  view == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	struct riff_cache *cache = rh->cache;
+	struct riff_cacheEntry *e;
+	int r;
+
+	if(cache != NULL){
+		CACHE_LOCK(cache);
+		e = cache_find(cache, rh->c_pos_start);
+		if(e != NULL  &&  e->view.size == rh->c_size  &&  memcmp(e->view.id, rh->c_id, 4) == 0){
+			e->refs++;
+			cache_touch(cache, e);
+			cache->stats.hits++;
+			CACHE_UNLOCK(cache);
+			*view = &e->view;
+			return RIFF_ERROR_NONE;
+		}
+		if(e != NULL)
+			cache_remove(cache, e); //stale, the chunk at this position changed
+		cache->stats.misses++;
+		CACHE_UNLOCK(cache);
+	}
+
+	//read without holding the lock, other handles may read the same chunk meanwhile
+	if((r = cache_read(rh, &e)) != RIFF_ERROR_NONE)
+		return r;
+
+	if(cache != NULL  &&  e->view.size <= cache->budget){
+		CACHE_LOCK(cache);
+		struct riff_cacheEntry *other = cache_find(cache, e->view.pos);
+		if(other != NULL  &&  other->view.size == e->view.size){
+			//lost the race, use the entry that is already there
+			other->refs++;
+			cache_touch(cache, other);
+			CACHE_UNLOCK(cache);
+			free(e);
+			*view = &other->view;
+			return RIFF_ERROR_NONE;
+		}
+		if(other != NULL)
+			cache_remove(cache, other);
+		e->cache = cache;
+		cache_insert(cache, e);
+		CACHE_UNLOCK(cache);
+	}
+	*view = &e->view;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_chunkViewRetain(const struct riff_chunkView *view){
+	struct riff_cacheEntry *e = (struct riff_cacheEntry *)view;
+	struct riff_cache *cache = e->cache;
+	if(cache != NULL){
+		CACHE_LOCK(cache);
+		e->refs++;
+		CACHE_UNLOCK(cache);
+	}
+	else
+		__atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED); //not cached, but the view may be passed to other threads
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_chunkViewRelease(const struct riff_chunkView *view){
+	if(view == NULL)
+		return;
+	struct riff_cacheEntry *e = (struct riff_cacheEntry *)view;
+	struct riff_cache *cache = e->cache;
+	if(cache != NULL){
+		CACHE_LOCK(cache);
+		int last = --e->refs == 0  &&  !e->cached;
+		int gone = 0;
+		if(last)
+			gone = --cache->held == 0  &&  cache->freed;
+		CACHE_UNLOCK(cache);
+		if(last)
+			free(e);
+		if(gone)
+			cache_destroy(cache);
+	}
+	else if(__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(e);
+}
@@ -0,0 +1,340 @@
+// Structural diff of two RIFF files
+//
+// Both chunk trees are parsed (headers only), then the subchunks of every list pair are matched by ID and list type in order.
+// Chunk data is only read for matched chunks of the same size: hashes first, bytes only to verify equal hashes.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+
+//matching key of a subchunk
+struct diff_key {
+	char id[4];
+	char type[4];
+	int32_t order;  //index among its siblings
+};
+
+struct diff_ctx {
+	riff_handle *rh[2];
+	struct riff_tree tree[2];
+	uint64_t *hash[2];    //lazily computed data hashes
+	uint8_t *hashed[2];   //1 if hash[] entry is valid
+	uint8_t *buf[2];      //read buffers
+	int flags;
+	int (*cb)(int event, const struct riff_treeNode *a, const struct riff_treeNode *b, void *user);
+	void *user;
+	int stop;
+};
+
+
+/*****************************************************************************/
+int diff_keyCompare(const void *a, const void *b){
+	const struct diff_key *ka = (const struct diff_key *)a, *kb = (const struct diff_key *)b;
+	int c = memcmp(ka->id, kb->id, 8); //ID and type
+	if(c != 0)
+		return c;
+	return (ka->order > kb->order) - (ka->order < kb->order);
+}
+
+/*****************************************************************************/
+//report event, remember if the user wants to stop
+void diff_report(struct diff_ctx *ctx, int event, int32_t a, int32_t b){
+	if(ctx->stop)
+		return;
+	const struct riff_treeNode *na = a != RIFF_TREE_NONE ? ctx->tree[0].nodes + a : NULL;
+	const struct riff_treeNode *nb = b != RIFF_TREE_NONE ? ctx->tree[1].nodes + b : NULL;
+	if(ctx->cb(event, na, nb, ctx->user))
+		ctx->stop = 1;
+}
+
+/*****************************************************************************/
+//read raw stream data at absolute position
+int diff_read(riff_handle *rh, size_t pos, void *buf, size_t size){
+	rh->pos = pos;
+	riff_ioSeek(rh, pos);
+	size_t n = riff_ioRead(rh, buf, size, 1);
+	rh->pos += n;
+	return n == size ? RIFF_ERROR_NONE : RIFF_ERROR_EOF;
+}
+
+/*****************************************************************************/
+//compare data of 2 chunks of the same size byte by byte
+int diff_bytesEqual(struct diff_ctx *ctx, int32_t a, int32_t b, int *eq){
+	size_t pa = ctx->tree[0].nodes[a].c_pos_start + RIFF_CHUNK_DATA_OFFSET;
+	size_t pb = ctx->tree[1].nodes[b].c_pos_start + RIFF_CHUNK_DATA_OFFSET;
+	size_t size = ctx->tree[0].nodes[a].c_size;
+
+	while(size > 0){
+		size_t n = size < RIFF_HASH_BUFFER_SIZE ? size : RIFF_HASH_BUFFER_SIZE;
+		const void *da = ctx->rh[0]->fp_map ? ctx->rh[0]->fp_map(ctx->rh[0], pa, n) : NULL;
+		const void *db = ctx->rh[1]->fp_map ? ctx->rh[1]->fp_map(ctx->rh[1], pb, n) : NULL;
+		int r;
+		if(da == NULL){
+			if((r = diff_read(ctx->rh[0], pa, ctx->buf[0], n)) != RIFF_ERROR_NONE)
+				return r;
+			da = ctx->buf[0];
+		}
+		if(db == NULL){
+			if((r = diff_read(ctx->rh[1], pb, ctx->buf[1], n)) != RIFF_ERROR_NONE)
+				return r;
+			db = ctx->buf[1];
+		}
+		if(memcmp(da, db, n) != 0){
+			*eq = 0;
+			return RIFF_ERROR_NONE;
+		}
+		pa += n;
+		pb += n;
+		size -= n;
+	}
+	*eq = 1;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//get data hash of a chunk, computed on first use
+int diff_hash(struct diff_ctx *ctx, int side, int32_t n, uint64_t *hash){
+	if(!ctx->hashed[side][n]){
+		const struct riff_treeNode *node = ctx->tree[side].nodes + n;
+		int r = riff_hashRange(ctx->rh[side], node->c_pos_start + RIFF_CHUNK_DATA_OFFSET, node->c_size, RIFF_HASH_XXH64, ctx->buf[side], ctx->hash[side] + n);
+		if(r != RIFF_ERROR_NONE)
+			return r;
+		ctx->hashed[side][n] = 1;
+	}
+	*hash = ctx->hash[side][n];
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//compare data of 2 chunks without subchunks
+int diff_leafEqual(struct diff_ctx *ctx, int32_t a, int32_t b, int *eq){
+	const struct riff_treeNode *na = ctx->tree[0].nodes + a, *nb = ctx->tree[1].nodes + b;
+	*eq = 0;
+	if(na->c_size != nb->c_size)
+		return RIFF_ERROR_NONE;
+	if(!(ctx->flags & RIFF_DIFF_READ_LAYOUT)  &&  na->c_pos_start == nb->c_pos_start){
+		*eq = 1;
+		return RIFF_ERROR_NONE;
+	}
+
+	uint64_t ha, hb;
+	int r;
+	if((r = diff_hash(ctx, 0, a, &ha)) != RIFF_ERROR_NONE  ||  (r = diff_hash(ctx, 1, b, &hb)) != RIFF_ERROR_NONE)
+		return r;
+	if(ha != hb)
+		return RIFF_ERROR_NONE;
+	if(ctx->flags & RIFF_DIFF_TRUST_HASH){
+		*eq = 1;
+		return RIFF_ERROR_NONE;
+	}
+	return diff_bytesEqual(ctx, a, b, eq);
+}
+
+/*****************************************************************************/
+//collect subchunks of a list node, returns amount or -1 if allocation failed
+int32_t diff_children(const struct riff_tree *tree, int32_t list, int32_t **out){
+	int32_t n = 0, c;
+	for(c = tree->nodes[list].first_child; c != RIFF_TREE_NONE; c = tree->nodes[c].next_sibling)
+		n++;
+	*out = malloc((n > 0 ? n : 1) * sizeof(int32_t));
+	if(*out == NULL)
+		return -1;
+	n = 0;
+	for(c = tree->nodes[list].first_child; c != RIFF_TREE_NONE; c = tree->nodes[c].next_sibling)
+		(*out)[n++] = c;
+	return n;
+}
+
+/*****************************************************************************/
+//mark the longest increasing subsequence of seq, these pairs kept their relative order
+//returns -1 if allocation failed
+int diff_lis(const int32_t *seq, int32_t n, uint8_t *inLis){
+	int32_t *tails = malloc((n > 0 ? n : 1) * sizeof(int32_t));
+	int32_t *prev = malloc((n > 0 ? n : 1) * sizeof(int32_t));
+	if(tails == NULL  ||  prev == NULL){
+		free(tails);
+		free(prev);
+		return -1;
+	}
+
+	int32_t len = 0, i;
+	for(i = 0; i < n; i++){
+		//binary search for the first tail >= seq[i]
+		int32_t lo = 0, hi = len;
+		while(lo < hi){
+			int32_t mid = (lo + hi) / 2;
+			if(seq[tails[mid]] < seq[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo > 0 ? tails[lo - 1] : -1;
+		tails[lo] = i;
+		if(lo == len)
+			len++;
+	}
+
+	memset(inLis, 0, n);
+	for(i = len > 0 ? tails[len - 1] : -1; i >= 0; i = prev[i])
+		inLis[i] = 1;
+
+	free(tails);
+	free(prev);
+	return 0;
+}
+
+/*****************************************************************************/
+//diff the subchunks of 2 list nodes
+int diff_list(struct diff_ctx *ctx, int32_t la, int32_t lb){
+	int32_t *ca = NULL, *cb = NULL, *seq = NULL, *pairA = NULL;
+	struct diff_key *keys = NULL;
+	int32_t *cur = NULL;
+	uint8_t *usedA = NULL, *inLis = NULL;
+	int r = RIFF_ERROR_MEMORY;
+
+	int32_t na = diff_children(ctx->tree + 0, la, &ca);
+	int32_t nb = diff_children(ctx->tree + 1, lb, &cb);
+	if(na < 0  ||  nb < 0)
+		goto end;
+
+	size_t sa = na > 0 ? na : 1, sb = nb > 0 ? nb : 1;
+	keys = malloc(sa * sizeof(struct diff_key));
+	cur = malloc(sa * sizeof(int32_t));
+	usedA = calloc(sa, 1);
+	seq = malloc(sb * sizeof(int32_t));
+	pairA = malloc(sb * sizeof(int32_t));
+	inLis = malloc(sb);
+	if(keys == NULL  ||  cur == NULL  ||  usedA == NULL  ||  seq == NULL  ||  pairA == NULL  ||  inLis == NULL)
+		goto end;
+
+	//sort subchunks of A by key, then match subchunks of B in order (first come first served per key)
+	int32_t i, j;
+	for(i = 0; i < na; i++){
+		const struct riff_treeNode *node = ctx->tree[0].nodes + ca[i];
+		memcpy(keys[i].id, node->c_id, 4);
+		memcpy(keys[i].type, node->c_type, 4);
+		keys[i].order = i;
+		cur[i] = i;
+	}
+	qsort(keys, na, sizeof(struct diff_key), diff_keyCompare);
+
+	int32_t npairs = 0;
+	for(j = 0; j < nb; j++){
+		const struct riff_treeNode *node = ctx->tree[1].nodes + cb[j];
+		struct diff_key k;
+		memcpy(k.id, node->c_id, 4);
+		memcpy(k.type, node->c_type, 4);
+		k.order = -1;
+		//first key entry >= k, start of the key group
+		int32_t lo = 0, hi = na;
+		while(lo < hi){
+			int32_t mid = (lo + hi) / 2;
+			if(diff_keyCompare(keys + mid, &k) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		pairA[j] = -1;
+		if(lo < na  &&  memcmp(keys[lo].id, k.id, 8) == 0){
+			int32_t c = cur[lo];
+			if(c < na  &&  memcmp(keys[c].id, k.id, 8) == 0){
+				pairA[j] = keys[c].order;
+				usedA[keys[c].order] = 1;
+				seq[npairs++] = keys[c].order;
+				cur[lo] = c + 1;
+			}
+		}
+	}
+
+	//pairs outside of the longest in-order sequence were moved
+	if(diff_lis(seq, npairs, inLis) < 0)
+		goto end;
+
+	r = RIFF_ERROR_NONE;
+	int32_t p = 0;
+	for(j = 0; j < nb  &&  !ctx->stop; j++){
+		if(pairA[j] < 0){
+			diff_report(ctx, RIFF_DIFF_ADDED, RIFF_TREE_NONE, cb[j]);
+			continue;
+		}
+		int32_t a = ca[pairA[j]], b = cb[j];
+		const struct riff_treeNode *nodeA = ctx->tree[0].nodes + a, *nodeB = ctx->tree[1].nodes + b;
+		if(!inLis[p++])
+			diff_report(ctx, RIFF_DIFF_MOVED, a, b);
+
+		if(nodeA->c_type[0]  ||  nodeB->c_type[0]){
+			//lists with the same layout are trusted to be unchanged unless asked to read them
+			if(!(ctx->flags & RIFF_DIFF_READ_LAYOUT)  &&  nodeA->c_pos_start == nodeB->c_pos_start  &&  nodeA->c_size == nodeB->c_size)
+				continue;
+			if((r = diff_list(ctx, a, b)) != RIFF_ERROR_NONE)
+				goto end;
+		}
+		else {
+			int eq;
+			if((r = diff_leafEqual(ctx, a, b, &eq)) != RIFF_ERROR_NONE)
+				goto end;
+			if(!eq)
+				diff_report(ctx, RIFF_DIFF_CHANGED, a, b);
+		}
+	}
+	for(i = 0; i < na  &&  !ctx->stop; i++)
+		if(!usedA[i])
+			diff_report(ctx, RIFF_DIFF_REMOVED, ca[i], RIFF_TREE_NONE);
+
+end:
+	free(ca);
+	free(cb);
+	free(keys);
+	free(cur);
+	free(usedA);
+	free(seq);
+	free(pairA);
+	free(inLis);
+	return r;
+}
+
+
+/*****************************************************************************/
+//description: see header file
+int riff_diff(riff_handle *a, riff_handle *b, int flags, int (*cb)(int event, const struct riff_treeNode *a, const struct riff_treeNode *b, void *user), void *user){
+	if(a == NULL  ||  b == NULL  ||  cb == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+
+	struct diff_ctx ctx;
+	memset(&ctx, 0, sizeof(struct diff_ctx));
+	ctx.rh[0] = a;
+	ctx.rh[1] = b;
+	ctx.flags = flags;
+	ctx.cb = cb;
+	ctx.user = user;
+
+	int r, side;
+	for(side = 0; side < 2; side++){
+		if((r = riff_parseTree(ctx.rh[side], ctx.tree + side)) >= RIFF_ERROR_CRITICAL)
+			goto end;
+		ctx.hash[side] = malloc(ctx.tree[side].count * sizeof(uint64_t));
+		ctx.hashed[side] = calloc(ctx.tree[side].count, 1);
+		ctx.buf[side] = malloc(RIFF_HASH_BUFFER_SIZE);
+		r = RIFF_ERROR_MEMORY;
+		if(ctx.hash[side] == NULL  ||  ctx.hashed[side] == NULL  ||  ctx.buf[side] == NULL)
+			goto end;
+	}
+
+	if(memcmp(ctx.tree[0].nodes[0].c_type, ctx.tree[1].nodes[0].c_type, 4) != 0)
+		diff_report(&ctx, RIFF_DIFF_CHANGED, 0, 0);
+	r = diff_list(&ctx, 0, 0);
+
+end:
+	for(side = 0; side < 2; side++){
+		riff_treeFree(ctx.tree + side);
+		free(ctx.hash[side]);
+		free(ctx.hashed[side]);
+		free(ctx.buf[side]);
+		riff_rewind(ctx.rh[side]);
+	}
+	return r;
+}
@@ -0,0 +1,172 @@
+// In-place editing of chunk data
+//
+// The reader (riff_handle) provides the position and the level stack, the writer (riff_writer) must write to the same file.
+// Size changes are absorbed by JUNK chunks if possible, so only the edited chunk and a few headers are written.
+
+
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+
+/*****************************************************************************/
+//store native value as 32 bit LE
+void edit_uint32LE(uint8_t *p, uint32_t v){
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************/
+//write a JUNK chunk covering [pos, end), the range must be empty or at least a chunk header
+int edit_fill(riff_writer *rw, size_t pos, size_t end){
+	if(end == pos)
+		return RIFF_ERROR_NONE;
+	uint8_t buf[8];
+	memcpy(buf, "JUNK", 4);
+	edit_uint32LE(buf + 4, (uint32_t)(end - pos - RIFF_CHUNK_DATA_OFFSET));
+	return riff_writeAt(rw, pos, buf, 8);
+}
+
+/*****************************************************************************/
+//end of the current list level without pad byte
+size_t edit_levelEnd(riff_handle *rh, int level){
+	if(level > 0){
+		struct riff_levelStackE *ls = rh->ls + (level - 1);
+		return ls->c_pos_start + RIFF_CHUNK_DATA_OFFSET + ls->c_size;
+	}
+	return rh->pos_start + RIFF_CHUNK_DATA_OFFSET + rh->h_size;
+}
+
+/*****************************************************************************/
+//skip following JUNK and PAD chunks of the current level, returns the end of the free space
+size_t edit_freeEnd(riff_handle *rh, size_t pos){
+	size_t listend = edit_levelEnd(rh, rh->ls_level);
+	while(pos + RIFF_CHUNK_DATA_OFFSET <= listend){
+		char buf[8];
+		riff_ioSeek(rh, pos);
+		rh->pos = pos;
+		size_t n = riff_ioRead(rh, buf, 8, 0);
+		rh->pos += n;
+		if(n != 8  ||  (memcmp(buf, "JUNK", 4) != 0  &&  memcmp(buf, "PAD ", 4) != 0))
+			break;
+		size_t size = convUInt32LE(buf + 4);
+		size_t end = pos + RIFF_CHUNK_DATA_OFFSET + size + (size & 1);
+		if(end > listend)
+			break;
+		pos = end;
+	}
+	return pos;
+}
+
+/*****************************************************************************/
+//move the end of the file from end to end_new, the current chunk must be the last one of every level
+//updates the size of every parent list, the file header and the ds64 chunk
+int edit_growFile(riff_handle *rh, riff_writer *rw, size_t end, size_t end_new){
+	int i, r;
+	uint8_t buf[8];
+
+	//check before writing anything, files are never truncated
+	if(end_new < end)
+		return RIFF_ERROR_ICSIZE;
+	for(i = 0; i <= rh->ls_level; i++)
+		if(edit_levelEnd(rh, i) != end)
+			return RIFF_ERROR_ICSIZE; //not at the end, no room
+	for(i = 0; i < rh->ls_level; i++)
+		if(rh->ls[i].c_size + end_new - end > 0xFFFFFFFF)
+			return RIFF_ERROR_ICSIZE;
+
+	//raw header size field, 0xFFFFFFFF if the real size is in the ds64 chunk
+	riff_ioSeek(rh, rh->pos_start + 4);
+	rh->pos = rh->pos_start + 4;
+	if(riff_ioRead(rh, buf, 4, 0) != 4)
+		return RIFF_ERROR_EOF;
+	rh->pos += 4;
+	int ds64 = convUInt32LE(buf) == 0xFFFFFFFF;
+	size_t h_size = rh->h_size + end_new - end;
+	if(!ds64  &&  h_size > 0xFFFFFFFF)
+		return RIFF_ERROR_ICSIZE;
+
+	for(i = 0; i < rh->ls_level; i++){
+		struct riff_levelStackE *ls = rh->ls + i;
+		ls->c_size = ls->c_size + end_new - end;
+		edit_uint32LE(buf, (uint32_t)ls->c_size);
+		if((r = riff_writeAt(rw, ls->c_pos_start + 4, buf, 4)) != RIFF_ERROR_NONE)
+			return r;
+	}
+
+	rh->h_size = h_size;
+	rh->ls_root.c_size = h_size;
+	if(ds64){
+		//riffSize is the first field of the ds64 chunk, right after the file header
+		edit_uint32LE(buf, (uint32_t)(h_size & 0xFFFFFFFF));
+		edit_uint32LE(buf + 4, (uint32_t)((uint64_t)h_size >> 32));
+		r = riff_writeAt(rw, rh->pos_start + RIFF_HEADER_SIZE + RIFF_CHUNK_DATA_OFFSET, buf, 8);
+	}
+	else {
+		edit_uint32LE(buf, (uint32_t)h_size);
+		r = riff_writeAt(rw, rh->pos_start + 4, buf, 4);
+	}
+	if(r != RIFF_ERROR_NONE)
+		return r;
+
+	if(rh->size != 0)
+		rh->size = rh->size + end_new - end;
+	return RIFF_ERROR_NONE;
+}
+
+
+/*****************************************************************************/
+//description: see header file
+int riff_editChunk(riff_handle *rh, riff_writer *rw, const void *data, size_t size){
+	if(rh == NULL  ||  rw == NULL  ||  rw->fp_write == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	if(size > 0xFFFFFFFF)
+		return RIFF_ERROR_ICSIZE;
+
+	//cached data of the chunk and its parents becomes stale
+	if(rh->cache != NULL){
+		int i;
+		riff_cacheInvalidate(rh->cache, rh->c_pos_start);
+		for(i = 0; i < rh->ls_level; i++)
+			riff_cacheInvalidate(rh->cache, rh->ls[i].c_pos_start);
+	}
+	//remembered chunk counts of the levels become stale
+	riff_levelForget(rh);
+
+	size_t start = rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET;
+	size_t end = start + rh->c_size + rh->pad;
+	size_t end_new = start + size + (size & 1);
+	size_t free_end = end;
+	int r;
+
+	//need more room, or the freed room joins following JUNK into one chunk
+	if(end_new != end)
+		free_end = edit_freeEnd(rh, end);
+
+	if(end_new <= free_end  &&  (free_end == end_new  ||  free_end - end_new >= RIFF_CHUNK_DATA_OFFSET)){
+		//fits into the old chunk and following JUNK
+		if((r = edit_fill(rw, end_new, free_end)) != RIFF_ERROR_NONE)
+			return r;
+	}
+	else if((r = edit_growFile(rh, rw, free_end, end_new)) != RIFF_ERROR_NONE)
+		return r;
+
+	//data, pad byte and size field
+	if((r = riff_writeAt(rw, start, data, size)) != RIFF_ERROR_NONE)
+		return r;
+	if((size & 1)  &&  (r = riff_writeAt(rw, start + size, "", 1)) != RIFF_ERROR_NONE)
+		return r;
+	if(size != rh->c_size){
+		uint8_t buf[4];
+		edit_uint32LE(buf, (uint32_t)size);
+		if((r = riff_writeAt(rw, rh->c_pos_start + 4, buf, 4)) != RIFF_ERROR_NONE)
+			return r;
+		rh->c_size = size;
+		rh->pad = size & 1;
+	}
+
+	return riff_seekInChunk(rh, rh->c_size);
+}
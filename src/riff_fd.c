@@ -0,0 +1,277 @@
+// POSIX backends: file descriptor (pread) and memory mapped file, plus access hints
+//
+// Compiles to stubs returning RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //posix_fadvise(), pread()
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define RIFF_FD 1
+#endif
+
+
+#if RIFF_FD
+
+/*****************************************************************************/
+//description: see riff_internal.h
+int riff_adviseFd(int fd, int advice, size_t pos, size_t size){
+#if defined(POSIX_FADV_NORMAL)
+	static const int map[] = {POSIX_FADV_NORMAL, POSIX_FADV_RANDOM, POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED};
+	return posix_fadvise(fd, pos, size, map[advice]) == 0 ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+#else
+	(void)fd; (void)advice; (void)pos; (void)size;
+	return RIFF_ERROR_ACCESS;
+#endif
+}
+
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_readAtFd(int fd, void *ptr, size_t size, size_t pos){
+	size_t done = 0;
+	while(done < size){
+		ssize_t n = pread(fd, (uint8_t *)ptr + done, size - done, pos + done);
+		if(n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_writeAtFd(int fd, const void *ptr, size_t size, size_t pos){
+	size_t done = 0;
+	while(done < size){
+		ssize_t n = pwrite(fd, (const uint8_t *)ptr + done, size - done, pos + done);
+		if(n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+
+//** file descriptor **
+
+
+/*****************************************************************************/
+size_t read_fd(riff_handle *rh, void *ptr, size_t size){
+	return riff_readAtFd((int)(intptr_t)rh->fh, ptr, size, rh->pos);
+}
+
+/*****************************************************************************/
+size_t readAt_fd(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	return riff_readAtFd((int)(intptr_t)rh->fh, ptr, size, pos);
+}
+
+/*****************************************************************************/
+size_t seek_fd(riff_handle *rh, size_t pos){
+	(void)rh;
+	return pos; //every read passes its position
+}
+
+/*****************************************************************************/
+int fd_fd(riff_handle *rh){
+	return (int)(intptr_t)rh->fh;
+}
+
+/*****************************************************************************/
+int advise_fd(riff_handle *rh, int advice, size_t pos, size_t size){
+	return riff_adviseFd((int)(intptr_t)rh->fh, advice, pos, size);
+}
+
+
+//** memory mapped file **
+
+
+struct riff_mmap {
+	uint8_t *ptr;
+	size_t size; //mapped from file offset 0
+	int fd;      //own duplicate for posix_fadvise(), -1 if none
+	int refs;    //handles sharing the mapping, see dup_mmap()
+};
+
+/*****************************************************************************/
+size_t read_mmap(riff_handle *rh, void *ptr, size_t size){
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	if(rh->pos >= m->size)
+		return 0;
+	if(size > m->size - rh->pos)
+		size = m->size - rh->pos;
+	memcpy(ptr, m->ptr + rh->pos, size);
+	return size;
+}
+
+/*****************************************************************************/
+size_t readAt_mmap(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	if(pos >= m->size)
+		return 0;
+	if(size > m->size - pos)
+		size = m->size - pos;
+	memcpy(ptr, m->ptr + pos, size);
+	return size;
+}
+
+/*****************************************************************************/
+size_t seek_mmap(riff_handle *rh, size_t pos){
+	(void)rh;
+	return pos; //instant in memory
+}
+
+/*****************************************************************************/
+const void *map_mmap(riff_handle *rh, size_t pos, size_t size){
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	if(pos > m->size  ||  size > m->size - pos)
+		return NULL;
+	return m->ptr + pos;
+}
+
+/*****************************************************************************/
+int advise_mmap(riff_handle *rh, int advice, size_t pos, size_t size){
+	static const int map[] = {MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED};
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	if(pos >= m->size)
+		return RIFF_ERROR_NONE;
+	if(size == 0  ||  size > m->size - pos)
+		size = m->size - pos;
+	//madvise() needs a page aligned start
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = pos / page * page;
+	int r = madvise(m->ptr + start, size + pos - start, map[advice]) == 0 ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+	//madvise() only unmaps the pages, they stay in the page cache
+	if(advice == RIFF_ADVISE_DONTNEED  &&  m->fd >= 0)
+		riff_adviseFd(m->fd, RIFF_ADVISE_DONTNEED, pos, size);
+	return r;
+}
+
+/*****************************************************************************/
+int dup_mmap(riff_handle *rh){
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	__atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+void close_mmap(riff_handle *rh){
+	struct riff_mmap *m = (struct riff_mmap *)rh->fh;
+	rh->fh = NULL;
+	//the last handle of a copied one unmaps
+	if(__atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	munmap(m->ptr, m->size);
+	if(m->fd >= 0)
+		close(m->fd);
+	free(m);
+}
+
+#else
+
+/*****************************************************************************/
+//description: see riff_internal.h
+int riff_adviseFd(int fd, int advice, size_t pos, size_t size){
+	(void)fd; (void)advice; (void)pos; (void)size;
+	return RIFF_ERROR_ACCESS;
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_readAtFd(int fd, void *ptr, size_t size, size_t pos){
+	(void)fd; (void)ptr; (void)size; (void)pos;
+	return 0;
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_writeAtFd(int fd, const void *ptr, size_t size, size_t pos){
+	(void)fd; (void)ptr; (void)size; (void)pos;
+	return 0;
+}
+
+#endif
+
+
+/*****************************************************************************/
+//description: see header file
+int riff_open_fd(riff_handle *rh, int fd, size_t size){
+#if RIFF_FD
+	if(rh == NULL  ||  fd < 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	riff_handleClose(rh);
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	if(pos < 0)
+		return RIFF_ERROR_ACCESS;
+	rh->fh = (void *)(intptr_t)fd;
+	rh->size = size;
+	rh->pos_start = pos;
+	rh->pos = pos;
+
+	rh->fp_read = &read_fd;
+	rh->fp_seek = &seek_fd;
+	rh->fp_fd = &fd_fd;
+	rh->fp_advise = &advise_fd;
+	rh->fp_readAt = &readAt_fd;
+
+	return riff_readHeader(rh);
+#else
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_open_mmap(riff_handle *rh, int fd, size_t size){
+#if RIFF_FD
+	if(rh == NULL  ||  fd < 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	riff_handleClose(rh);
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	struct stat st;
+	if(pos < 0  ||  fstat(fd, &st) != 0)
+		return RIFF_ERROR_ACCESS;
+	size_t len = size != 0 ? pos + size : (size_t)st.st_size;
+	if(len <= (size_t)pos  ||  len > (size_t)st.st_size)
+		return RIFF_ERROR_EOF;
+
+	struct riff_mmap *m = malloc(sizeof(struct riff_mmap));
+	if(m == NULL)
+		return RIFF_ERROR_MEMORY;
+	m->ptr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if(m->ptr == MAP_FAILED){
+		free(m);
+		return RIFF_ERROR_ACCESS;
+	}
+	m->size = len;
+	m->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0); //the caller may close fd right away
+	m->refs = 1;
+	rh->fh = m;
+	rh->size = size;
+	rh->pos_start = pos;
+	rh->pos = pos;
+
+	rh->fp_read = &read_mmap;
+	rh->fp_seek = &seek_mmap;
+	rh->fp_map = &map_mmap;
+	rh->fp_advise = &advise_mmap;
+	rh->fp_readAt = &readAt_mmap;
+	rh->fp_close = &close_mmap;
+	rh->fp_dup = &dup_mmap;
+
+	return riff_readHeader(rh);
+#else
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
@@ -0,0 +1,542 @@
+// Chunk hashing: CRC-32C and XXH64, per chunk and Merkle style over a chunk tree
+//
+// Data is hashed in place if the source provides riff_handle::fp_map, otherwise it is streamed through riff_handle::fp_read,
+// or through riff_handle::fp_readAt by the threads of riff_hashTree().
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if RIFF_THREADS
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__)  &&  (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define RIFF_CRC32C_SSE42 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define RIFF_CRC32C_ARM 1
+#endif
+
+
+#define RIFF_HASH_BATCH 64  //nodes taken at once by a hashing thread
+
+
+
+
+//*** CRC-32C ***
+
+
+static uint32_t crc32c_table[8][256];
+static int crc32c_hw;
+#if RIFF_THREADS
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+#else
+static int crc32c_done;
+#endif
+
+/*****************************************************************************/
+//build slicing-by-8 tables and detect CRC instructions
+void crc32c_build(void){
+	uint32_t i, j;
+	for(i = 0; i < 256; i++){
+		uint32_t c = i;
+		for(j = 0; j < 8; j++)
+			c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1))); //reflected Castagnoli polynomial
+		crc32c_table[0][i] = c;
+	}
+	for(i = 0; i < 256; i++)
+		for(j = 1; j < 8; j++)
+			crc32c_table[j][i] = (crc32c_table[j-1][i] >> 8) ^ crc32c_table[0][crc32c_table[j-1][i] & 0xFF];
+
+#if RIFF_CRC32C_SSE42
+	__builtin_cpu_init();
+	crc32c_hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#elif RIFF_CRC32C_ARM
+	crc32c_hw = 1;
+#else
+	crc32c_hw = 0;
+#endif
+}
+
+/*****************************************************************************/
+//build the tables once, can be called from several threads at once
+void crc32c_init(void){
+#if RIFF_THREADS
+	pthread_once(&crc32c_once, crc32c_build);
+#else
+	if(!crc32c_done){
+		crc32c_build();
+		crc32c_done = 1;
+	}
+#endif
+}
+
+/*****************************************************************************/
+//software CRC-32C, slicing-by-8
+uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t n){
+	while(n >= 8){
+		uint32_t lo = crc ^ convUInt32LE(p);
+		uint32_t hi = convUInt32LE(p + 4);
+		crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^ crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24]
+			^ crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^ crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+		p += 8;
+		n -= 8;
+	}
+	while(n--)
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+	return crc;
+}
+
+#if RIFF_CRC32C_SSE42
+/*****************************************************************************/
+//hardware CRC-32C via SSE4.2, only called if the CPU supports it
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hwUpdate(uint32_t crc, const uint8_t *p, size_t n){
+#if defined(__x86_64__)
+	uint64_t c = crc;
+	while(n >= 8){
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+		p += 8;
+		n -= 8;
+	}
+	crc = (uint32_t)c;
+#endif
+	while(n >= 4){
+		uint32_t v;
+		memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		n -= 4;
+	}
+	while(n--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#elif RIFF_CRC32C_ARM
+/*****************************************************************************/
+//hardware CRC-32C via ARMv8 CRC instructions
+uint32_t crc32c_hwUpdate(uint32_t crc, const uint8_t *p, size_t n){
+	while(n >= 8){
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+		p += 8;
+		n -= 8;
+	}
+	while(n--)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+#endif
+
+/*****************************************************************************/
+//update CRC-32C (without pre/post inversion)
+uint32_t crc32c_update(uint32_t crc, const uint8_t *p, size_t n){
+#if RIFF_CRC32C_SSE42 || RIFF_CRC32C_ARM
+	if(crc32c_hw)
+		return crc32c_hwUpdate(crc, p, n);
+#endif
+	return crc32c_sw(crc, p, n);
+}
+
+
+
+
+//*** XXH64 ***
+
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+#define xxh_rotl(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/*****************************************************************************/
+uint64_t readUInt64LE(const uint8_t *p){
+	return (uint64_t)convUInt32LE(p) | ((uint64_t)convUInt32LE(p + 4) << 32);
+}
+
+/*****************************************************************************/
+uint64_t xxh_round(uint64_t acc, uint64_t input){
+	acc += input * XXH_P2;
+	acc = xxh_rotl(acc, 31);
+	return acc * XXH_P1;
+}
+
+/*****************************************************************************/
+uint64_t xxh_mergeRound(uint64_t acc, uint64_t val){
+	acc ^= xxh_round(0, val);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+
+
+
+//*** streaming hash state ***
+
+
+struct hash_state {
+	int algo;
+	uint32_t crc;
+	uint64_t v[4];  //XXH64 accumulators
+	uint64_t total;
+	uint8_t mem[32];
+	size_t memsize;
+};
+
+/*****************************************************************************/
+void hash_init(struct hash_state *st, int algo){
+	memset(st, 0, sizeof(struct hash_state));
+	st->algo = algo;
+	st->crc = 0xFFFFFFFF;
+	st->v[0] = XXH_P1 + XXH_P2;
+	st->v[1] = XXH_P2;
+	st->v[2] = 0;
+	st->v[3] = 0 - XXH_P1;
+}
+
+/*****************************************************************************/
+void hash_update(struct hash_state *st, const void *data, size_t n){
+	const uint8_t *p = (const uint8_t *)data;
+
+	if(st->algo == RIFF_HASH_CRC32C){
+		st->crc = crc32c_update(st->crc, p, n);
+		return;
+	}
+
+	st->total += n;
+
+	//fill up buffered stripe first
+	if(st->memsize){
+		size_t fill = 32 - st->memsize;
+		if(fill > n)
+			fill = n;
+		memcpy(st->mem + st->memsize, p, fill);
+		st->memsize += fill;
+		p += fill;
+		n -= fill;
+		if(st->memsize < 32)
+			return;
+		int i;
+		for(i = 0; i < 4; i++)
+			st->v[i] = xxh_round(st->v[i], readUInt64LE(st->mem + 8*i));
+		st->memsize = 0;
+	}
+
+	uint64_t v0 = st->v[0], v1 = st->v[1], v2 = st->v[2], v3 = st->v[3];
+	while(n >= 32){
+		v0 = xxh_round(v0, readUInt64LE(p));
+		v1 = xxh_round(v1, readUInt64LE(p + 8));
+		v2 = xxh_round(v2, readUInt64LE(p + 16));
+		v3 = xxh_round(v3, readUInt64LE(p + 24));
+		p += 32;
+		n -= 32;
+	}
+	st->v[0] = v0; st->v[1] = v1; st->v[2] = v2; st->v[3] = v3;
+
+	memcpy(st->mem, p, n);
+	st->memsize = n;
+}
+
+/*****************************************************************************/
+uint64_t hash_digest(const struct hash_state *st){
+	if(st->algo == RIFF_HASH_CRC32C)
+		return st->crc ^ 0xFFFFFFFF;
+
+	uint64_t h;
+	if(st->total >= 32){
+		h = xxh_rotl(st->v[0], 1) + xxh_rotl(st->v[1], 7) + xxh_rotl(st->v[2], 12) + xxh_rotl(st->v[3], 18);
+		int i;
+		for(i = 0; i < 4; i++)
+			h = xxh_mergeRound(h, st->v[i]);
+	}
+	else
+		h = XXH_P5;
+	h += st->total;
+
+	const uint8_t *p = st->mem;
+	size_t n = st->memsize;
+	while(n >= 8){
+		h ^= xxh_round(0, readUInt64LE(p));
+		h = xxh_rotl(h, 27) * XXH_P1 + XXH_P4;
+		p += 8;
+		n -= 8;
+	}
+	if(n >= 4){
+		h ^= (uint64_t)convUInt32LE(p) * XXH_P1;
+		h = xxh_rotl(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+		n -= 4;
+	}
+	while(n--){
+		h ^= (*p++) * XXH_P5;
+		h = xxh_rotl(h, 11) * XXH_P1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+
+
+//*** chunk hashing ***
+
+
+/*****************************************************************************/
+//hash size bytes at absolute stream position pos
+//buf: read buffer of RIFF_HASH_BUFFER_SIZE bytes, only used if the data can't be mapped
+int riff_hashRange(riff_handle *rh, size_t pos, size_t size, int algo, uint8_t *buf, uint64_t *hash){
+	struct hash_state st;
+	hash_init(&st, algo);
+
+	const void *p = rh->fp_map ? rh->fp_map(rh, pos, size) : NULL;
+	if(p != NULL){
+		hash_update(&st, p, size);
+		*hash = hash_digest(&st);
+		return RIFF_ERROR_NONE;
+	}
+
+	rh->pos = pos;
+	riff_ioSeek(rh, pos);
+	while(size > 0){
+		size_t n = size < RIFF_HASH_BUFFER_SIZE ? size : RIFF_HASH_BUFFER_SIZE;
+		size_t r = riff_ioRead(rh, buf, n, 1);
+		rh->pos += r;
+		if(r != n)
+			return RIFF_ERROR_EOF;
+		hash_update(&st, buf, n);
+		size -= n;
+	}
+	*hash = hash_digest(&st);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//true if tree node has subchunks (or could have, empty list)
+int hash_isList(const struct riff_tree *tree, int32_t i){
+	return i == 0  ||  tree->nodes[i].c_type[0] != 0  ||  tree->nodes[i].first_child != RIFF_TREE_NONE;
+}
+
+/*****************************************************************************/
+//combine hashes of list subchunks
+uint64_t hash_list(const struct riff_tree *tree, int32_t i, int algo, const uint64_t *hashes){
+	struct hash_state st;
+	hash_init(&st, algo);
+	hash_update(&st, tree->nodes[i].c_type, 4);
+
+	int32_t c;
+	for(c = tree->nodes[i].first_child; c != RIFF_TREE_NONE; c = tree->nodes[c].next_sibling){
+		uint8_t rec[20];
+		uint64_t size = tree->nodes[c].c_size;
+		int k;
+		memcpy(rec, tree->nodes[c].c_id, 4);
+		for(k = 0; k < 8; k++){
+			rec[4 + k] = (size >> (8*k)) & 0xFF;
+			rec[12 + k] = (hashes[c] >> (8*k)) & 0xFF;
+		}
+		hash_update(&st, rec, sizeof(rec));
+	}
+	return hash_digest(&st);
+}
+
+#if RIFF_THREADS
+struct hash_job {
+	riff_handle *rh;
+	const struct riff_tree *tree;
+	int algo;
+	uint64_t *hashes;
+	pthread_mutex_t lock;
+	int32_t next;  //next node to take
+	int err;
+};
+
+/*****************************************************************************/
+//hash a range via fp_map or else fp_readAt, no handle state is touched
+//buf: read buffer of RIFF_HASH_BUFFER_SIZE bytes, allocated on first use
+int hash_rangeAt(riff_handle *rh, size_t pos, size_t size, int algo, uint8_t **buf, uint64_t *hash){
+	const void *p = rh->fp_map ? rh->fp_map(rh, pos, size) : NULL;
+	if(p != NULL){
+		*hash = riff_hashBuffer(algo, p, size);
+		return RIFF_ERROR_NONE;
+	}
+	if(rh->fp_readAt == NULL)
+		return RIFF_ERROR_EOF;
+	if(*buf == NULL  &&  (*buf = malloc(RIFF_HASH_BUFFER_SIZE)) == NULL)
+		return RIFF_ERROR_MEMORY;
+
+	struct hash_state st;
+	hash_init(&st, algo);
+	while(size > 0){
+		size_t n = size < RIFF_HASH_BUFFER_SIZE ? size : RIFF_HASH_BUFFER_SIZE;
+		if(rh->fp_readAt(rh, *buf, n, pos) != n)
+			return RIFF_ERROR_EOF;
+		hash_update(&st, *buf, n);
+		pos += n;
+		size -= n;
+	}
+	*hash = hash_digest(&st);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//hashing thread, takes batches of nodes until all are done
+void *hash_worker(void *arg){
+	struct hash_job *job = (struct hash_job *)arg;
+	uint8_t *buf = NULL;
+	while(1){
+		pthread_mutex_lock(&job->lock);
+		int32_t start = job->next;
+		job->next += RIFF_HASH_BATCH;
+		int err = job->err;
+		pthread_mutex_unlock(&job->lock);
+
+		if(start >= job->tree->count  ||  err != RIFF_ERROR_NONE)
+			break;
+
+		int32_t end = start + RIFF_HASH_BATCH;
+		if(end > job->tree->count)
+			end = job->tree->count;
+		int32_t i = start;
+		while(i < end  &&  err == RIFF_ERROR_NONE){
+			if(hash_isList(job->tree, i)){
+				i++;
+				continue;
+			}
+			const struct riff_treeNode *node = job->tree->nodes + i;
+			size_t pos = node->c_pos_start + RIFF_CHUNK_DATA_OFFSET;
+			
+			//following chunks that fit into the read buffer along with this one are read at once, small chunks would cost a call each
+			size_t span = node->c_size;
+			int32_t j = i + 1;
+			while(job->rh->fp_map == NULL  &&  j < end){
+				const struct riff_treeNode *nj = job->tree->nodes + j;
+				size_t e = nj->c_pos_start + RIFF_CHUNK_DATA_OFFSET + nj->c_size;
+				if(nj->c_pos_start < pos  ||  e - pos > RIFF_HASH_BUFFER_SIZE)
+					break;
+				if(!hash_isList(job->tree, j))
+					span = e - pos;
+				j++;
+			}
+			if(j == i + 1){
+				err = hash_rangeAt(job->rh, pos, node->c_size, job->algo, &buf, job->hashes + i);
+				i++;
+				continue;
+			}
+			if(buf == NULL  &&  (buf = malloc(RIFF_HASH_BUFFER_SIZE)) == NULL)
+				err = RIFF_ERROR_MEMORY;
+			else if(job->rh->fp_readAt(job->rh, buf, span, pos) != span)
+				err = RIFF_ERROR_EOF;
+			for(; i < j  &&  err == RIFF_ERROR_NONE; i++){
+				node = job->tree->nodes + i;
+				if(!hash_isList(job->tree, i))
+					job->hashes[i] = riff_hashBuffer(job->algo, buf + (node->c_pos_start + RIFF_CHUNK_DATA_OFFSET - pos), node->c_size);
+			}
+		}
+		if(err != RIFF_ERROR_NONE){
+			pthread_mutex_lock(&job->lock);
+			job->err = err;
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+	}
+	free(buf);
+	return NULL;
+}
+#endif
+
+
+/*****************************************************************************/
+//description: see header file
+uint64_t riff_hashBuffer(int algo, const void *data, size_t size){
+	struct hash_state st;
+	crc32c_init();
+	hash_init(&st, algo);
+	hash_update(&st, data, size);
+	return hash_digest(&st);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_hashChunk(riff_handle *rh, int algo, uint64_t *hash){
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	crc32c_init();
+
+	uint8_t *buf = NULL;
+	if(rh->fp_map == NULL  &&  (buf = malloc(RIFF_HASH_BUFFER_SIZE)) == NULL)
+		return RIFF_ERROR_MEMORY;
+
+	int r = riff_hashRange(rh, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET, rh->c_size, algo, buf, hash);
+	free(buf);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+
+	//position at end of chunk data
+	return riff_seekInChunk(rh, rh->c_size);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_hashTree(riff_handle *rh, const struct riff_tree *tree, int algo, int threads, uint64_t *hashes){
+	if(rh == NULL  ||  tree == NULL  ||  tree->count == 0  ||  hashes == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	crc32c_init();
+
+	int r = RIFF_ERROR_NONE;
+	int32_t i;
+
+	//hash data of all chunks without subchunks
+#if RIFF_THREADS
+	if((rh->fp_map != NULL  ||  rh->fp_readAt != NULL)  &&  threads > 1){
+		struct hash_job job = {.rh = rh, .tree = tree, .algo = algo, .hashes = hashes};
+		pthread_t *th = malloc(threads * sizeof(pthread_t));
+		if(th == NULL)
+			return RIFF_ERROR_MEMORY;
+		pthread_mutex_init(&job.lock, NULL);
+		int started;
+		for(started = 0; started < threads; started++)
+			if(pthread_create(th + started, NULL, hash_worker, &job) != 0)
+				break;
+		if(started == 0) //no thread could be started, do it ourselves
+			hash_worker(&job);
+		for(i = 0; i < started; i++)
+			pthread_join(th[i], NULL);
+		pthread_mutex_destroy(&job.lock);
+		free(th);
+		r = job.err;
+	}
+	else
+#endif
+	{
+		uint8_t *buf = malloc(RIFF_HASH_BUFFER_SIZE);
+		if(buf == NULL)
+			return RIFF_ERROR_MEMORY;
+		for(i = 0; i < tree->count  &&  r == RIFF_ERROR_NONE; i++)
+			if(!hash_isList(tree, i))
+				r = riff_hashRange(rh, tree->nodes[i].c_pos_start + RIFF_CHUNK_DATA_OFFSET, tree->nodes[i].c_size, algo, buf, hashes + i);
+		free(buf);
+	}
+
+	//combine lists bottom up, subchunks always come after their list
+	if(r == RIFF_ERROR_NONE)
+		for(i = tree->count - 1; i >= 0; i--)
+			if(hash_isList(tree, i))
+				hashes[i] = hash_list(tree, i, algo, hashes);
+
+	int rr = riff_rewind(rh);
+	return r != RIFF_ERROR_NONE ? r : rr;
+}
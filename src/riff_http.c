@@ -0,0 +1,465 @@
+// HTTP backend: reads via Range requests over a keep-alive connection
+//
+// The file is fetched in blocks that are kept in a small LRU cache, so the 8 and 12 byte header reads of a traversal
+// are served from a few larger requests. Consecutive missing blocks are fetched with a single request,
+// sequential misses double the amount of blocks fetched ahead.
+//
+// Plain HTTP/1.1 only (no TLS, no chunked transfer encoding), the server must answer range requests with 206.
+// Compiles to stubs returning RIFF_ERROR_INVALID_HANDLE on systems without BSD sockets.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //getaddrinfo()
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#define RIFF_SOCKETS 1
+#endif
+
+
+#if RIFF_SOCKETS
+
+#if RIFF_THREADS
+#include <pthread.h>
+#define HTTP_LOCK(h) pthread_mutex_lock(&(h)->lock)
+#define HTTP_UNLOCK(h) pthread_mutex_unlock(&(h)->lock)
+#else
+#define HTTP_LOCK(h)
+#define HTTP_UNLOCK(h)
+#endif
+
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  //not on macOS, SIGPIPE must be ignored by the application there
+#endif
+
+#define HTTP_HEADER_MAX	8192  //response header limit
+#define HTTP_TIMEOUT	30    //socket send/receive timeout in seconds
+
+
+//cached block
+struct http_slot {
+	uint8_t *data;
+	size_t block;
+	size_t n;        //valid bytes, less than the block size at the end of the file
+	unsigned tick;   //last use, the oldest slot is reused
+	int used;
+};
+
+struct riff_http {
+#if RIFF_THREADS
+	pthread_mutex_t lock;
+#endif
+	char *host;       //for getaddrinfo()
+	char *port;
+	char *authority;  //host[:port] as in the URL, for the Host header
+	char *path;
+	int sock;         //-1 if not connected
+
+	uint8_t buf[HTTP_HEADER_MAX];  //received bytes not consumed yet
+	size_t buf_n;
+
+	size_t size;      //file size
+	size_t block;     //block size
+	struct http_slot *slots;
+	int nslots;
+	unsigned tick;
+	size_t next;      //block after the last fetch, a miss there counts as sequential
+	size_t ahead;     //blocks to fetch on the next sequential miss
+};
+
+
+/*****************************************************************************/
+void http_disconnect(struct riff_http *h){
+	if(h->sock >= 0)
+		close(h->sock);
+	h->sock = -1;
+	h->buf_n = 0;
+}
+
+/*****************************************************************************/
+int http_connect(struct riff_http *h){
+	struct addrinfo hints, *res, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(h->host, h->port, &hints, &res) != 0)
+		return RIFF_ERROR_ACCESS;
+
+	for(ai = res; ai != NULL; ai = ai->ai_next){
+		int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(s < 0)
+			continue;
+		if(connect(s, ai->ai_addr, ai->ai_addrlen) == 0){
+			int one = 1;
+			struct timeval tv = {HTTP_TIMEOUT, 0};
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //requests are small and latency bound
+			setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+			h->sock = s;
+			h->buf_n = 0;
+			break;
+		}
+		close(s);
+	}
+	freeaddrinfo(res);
+	return h->sock >= 0 ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+}
+
+/*****************************************************************************/
+//receive body bytes, buffered bytes first
+int http_recv(struct riff_http *h, uint8_t *ptr, size_t size){
+	size_t n = h->buf_n < size ? h->buf_n : size;
+	memcpy(ptr, h->buf, n);
+	memmove(h->buf, h->buf + n, h->buf_n - n);
+	h->buf_n -= n;
+	while(n < size){
+		ssize_t r = recv(h->sock, ptr + n, size - n, 0);
+		if(r <= 0)
+			return RIFF_ERROR_EOF;
+		n += r;
+	}
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//find header value in the response header block, NULL if not present
+const char *http_header(const char *head, const char *name){
+	size_t len = strlen(name);
+	const char *p = strstr(head, "\r\n");
+	while(p != NULL  &&  p[2] != '\r'){
+		p += 2;
+		if(strncasecmp(p, name, len) == 0  &&  p[len] == ':'){
+			p += len + 1;
+			while(*p == ' '  ||  *p == '\t')
+				p++;
+			return p;
+		}
+		p = strstr(p, "\r\n");
+	}
+	return NULL;
+}
+
+/*****************************************************************************/
+//send range request and read the response header
+//on success the body of length *len starting at *first follows on the socket, *total receives the file size
+int http_request(struct riff_http *h, size_t first, size_t last, size_t *start, size_t *len, size_t *total, int *keep){
+	char req[1024 + HTTP_HEADER_MAX];
+	int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%zu-%zu\r\nUser-Agent: libriff\r\nConnection: keep-alive\r\n\r\n", h->path, h->authority, first, last);
+	if(n < 0  ||  (size_t)n >= sizeof(req))
+		return RIFF_ERROR_INVALID_HANDLE;
+
+	size_t sent = 0;
+	while(sent < (size_t)n){
+		ssize_t r = send(h->sock, req + sent, n - sent, MSG_NOSIGNAL);
+		if(r <= 0)
+			return RIFF_ERROR_ACCESS;
+		sent += r;
+	}
+
+	//read up to the end of the header block
+	char *end;
+	while(1){
+		h->buf[h->buf_n < HTTP_HEADER_MAX ? h->buf_n : HTTP_HEADER_MAX - 1] = 0;
+		if((end = strstr((char *)h->buf, "\r\n\r\n")) != NULL)
+			break;
+		if(h->buf_n >= HTTP_HEADER_MAX - 1)
+			return RIFF_ERROR_ACCESS; //header too large
+		ssize_t r = recv(h->sock, h->buf + h->buf_n, HTTP_HEADER_MAX - 1 - h->buf_n, 0);
+		if(r <= 0)
+			return RIFF_ERROR_ACCESS;
+		h->buf_n += r;
+	}
+	end[2] = 0; //terminate after the last header line
+	size_t hlen = end + 4 - (char *)h->buf;
+
+	const char *head = (const char *)h->buf;
+	int status = 0;
+	if(strncmp(head, "HTTP/1.", 7) != 0  ||  sscanf(head + 8, " %d", &status) != 1)
+		return RIFF_ERROR_ACCESS;
+	const char *v;
+	*keep = (v = http_header(head, "Connection")) == NULL  ||  strncasecmp(v, "close", 5) != 0;
+	if(status == 416)
+		return RIFF_ERROR_EOF; //range beyond the end
+	if(status != 206  ||  http_header(head, "Transfer-Encoding") != NULL)
+		return RIFF_ERROR_ACCESS; //ranges or transfer encoding not supported
+
+	unsigned long long a, b, t, l;
+	if((v = http_header(head, "Content-Range")) == NULL  ||  sscanf(v, "bytes %llu-%llu/%llu", &a, &b, &t) != 3)
+		return RIFF_ERROR_ACCESS;
+	if((v = http_header(head, "Content-Length")) == NULL  ||  sscanf(v, "%llu", &l) != 1  ||  l != b - a + 1  ||  b < a)
+		return RIFF_ERROR_ACCESS;
+	*start = a;
+	*len = l;
+	*total = t;
+
+	//header consumed, the rest is body
+	memmove(h->buf, h->buf + hlen, h->buf_n - hlen);
+	h->buf_n -= hlen;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//take least recently used slot for a block, must be locked
+struct http_slot *http_slot(struct riff_http *h){
+	struct http_slot *s = h->slots;
+	int i;
+	for(i = 1; i < h->nslots  &&  s->used; i++)
+		if(!h->slots[i].used  ||  h->slots[i].tick < s->tick)
+			s = h->slots + i;
+	s->used = 0;
+	return s;
+}
+
+/*****************************************************************************/
+//find cached block, must be locked
+struct http_slot *http_find(struct riff_http *h, size_t block){
+	int i;
+	for(i = 0; i < h->nslots; i++)
+		if(h->slots[i].used  &&  h->slots[i].block == block)
+			return h->slots + i;
+	return NULL;
+}
+
+/*****************************************************************************/
+//fetch count blocks starting at block with one request, the connection is reopened once if the server dropped it
+int http_fetch(struct riff_http *h, size_t block, size_t count){
+	size_t first = block * h->block;
+	size_t last = (block + count) * h->block - 1;
+	if(h->size > 0  &&  last >= h->size)
+		last = h->size - 1;
+
+	size_t start, len, total;
+	int keep = 1, r = RIFF_ERROR_ACCESS, attempt;
+	for(attempt = 0; attempt < 2; attempt++){
+		int reused = h->sock >= 0;
+		if(!reused  &&  (r = http_connect(h)) != RIFF_ERROR_NONE)
+			return r;
+		r = http_request(h, first, last, &start, &len, &total, &keep);
+		if(r == RIFF_ERROR_NONE)
+			break;
+		http_disconnect(h);
+		if(!reused  ||  r == RIFF_ERROR_EOF)
+			return r;
+	}
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	if(start != first  ||  len > last - first + 1){
+		http_disconnect(h);
+		return RIFF_ERROR_ACCESS;
+	}
+	h->size = total;
+
+	//body goes straight into the slots
+	size_t i;
+	for(i = 0; i * h->block < len; i++){
+		struct http_slot *s = http_slot(h);
+		size_t n = len - i * h->block < h->block ? len - i * h->block : h->block;
+		if((r = http_recv(h, s->data, n)) != RIFF_ERROR_NONE){
+			http_disconnect(h);
+			return r;
+		}
+		s->block = block + i;
+		s->n = n;
+		s->tick = ++h->tick;
+		s->used = 1;
+	}
+	if(!keep)
+		http_disconnect(h);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+void http_free(struct riff_http *h){
+	int i;
+	http_disconnect(h);
+	if(h->slots != NULL){
+		for(i = 0; i < h->nslots; i++)
+			free(h->slots[i].data);
+		free(h->slots);
+	}
+	free(h->host);
+	free(h->port);
+	free(h->authority);
+	free(h->path);
+	free(h);
+}
+
+/*****************************************************************************/
+//split "http://host[:port][/path]", IPv6 hosts in brackets
+int http_parseUrl(struct riff_http *h, const char *url){
+	if(strncasecmp(url, "http://", 7) != 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	const char *a = url + 7;
+	const char *p = strchr(a, '/');
+	if(p == NULL)
+		p = a + strlen(a);
+	if(p == a)
+		return RIFF_ERROR_INVALID_HANDLE;
+
+	const char *hend, *port = NULL;
+	if(*a == '['){
+		const char *b = memchr(a, ']', p - a);
+		if(b == NULL)
+			return RIFF_ERROR_INVALID_HANDLE;
+		hend = b + 1;
+		if(hend < p  &&  *hend == ':')
+			port = hend + 1;
+		h->host = strndup(a + 1, b - a - 1);
+	}
+	else {
+		const char *c = memchr(a, ':', p - a);
+		hend = c != NULL ? c : p;
+		if(c != NULL)
+			port = c + 1;
+		h->host = strndup(a, hend - a);
+	}
+	h->port = port != NULL ? strndup(port, p - port) : strdup("80");
+	h->authority = strndup(a, p - a);
+	h->path = strdup(*p ? p : "/");
+	if(h->host == NULL  ||  h->port == NULL  ||  h->authority == NULL  ||  h->path == NULL)
+		return RIFF_ERROR_MEMORY;
+	return RIFF_ERROR_NONE;
+}
+
+
+//** HTTP backend **
+
+
+/*****************************************************************************/
+size_t readAt_http(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	struct riff_http *h = (struct riff_http *)rh->fh;
+	size_t done = 0;
+	HTTP_LOCK(h);
+	while(done < size  &&  pos < h->size){
+		size_t b = pos / h->block;
+		struct http_slot *s = http_find(h, b);
+		if(s == NULL){
+			//fetch the run of missing blocks up to the end of the read, more ahead if reading sequentially
+			size_t want = (pos + (size - done) - 1) / h->block - b + 1;
+			h->ahead = b == h->next ? h->ahead * 2 : 1;
+			if(h->ahead > (size_t)h->nslots / 2)
+				h->ahead = h->nslots / 2;
+			if(want < h->ahead)
+				want = h->ahead;
+			if(want > (size_t)h->nslots / 2)
+				want = h->nslots / 2;
+			size_t count = 1;
+			while(count < want  &&  http_find(h, b + count) == NULL)
+				count++;
+			if(http_fetch(h, b, count) != RIFF_ERROR_NONE  ||  (s = http_find(h, b)) == NULL)
+				break; //short read, reported by the caller
+			h->next = b + count;
+		}
+		s->tick = ++h->tick;
+		size_t off = pos - b * h->block;
+		if(off >= s->n)
+			break;
+		size_t n = s->n - off;
+		if(n > size - done)
+			n = size - done;
+		memcpy((uint8_t *)ptr + done, s->data + off, n);
+		done += n;
+		pos += n;
+	}
+	HTTP_UNLOCK(h);
+	return done;
+}
+
+/*****************************************************************************/
+size_t read_http(riff_handle *rh, void *ptr, size_t size){
+	return readAt_http(rh, ptr, size, rh->pos);
+}
+
+/*****************************************************************************/
+size_t seek_http(riff_handle *rh, size_t pos){
+	(void)rh;
+	return pos; //every read passes its position
+}
+
+/*****************************************************************************/
+void close_http(riff_handle *rh){
+	struct riff_http *h = (struct riff_http *)rh->fh;
+#if RIFF_THREADS
+	pthread_mutex_destroy(&h->lock);
+#endif
+	http_free(h);
+	rh->fh = NULL;
+}
+
+#endif
+
+
+/*****************************************************************************/
+//description: see header file
+int riff_open_http(riff_handle *rh, const char *url, size_t block, int cache){
+#if RIFF_SOCKETS
+	if(rh == NULL  ||  url == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	riff_handleClose(rh);
+	if(block == 0)
+		block = RIFF_HTTP_BLOCK_SIZE;
+	if(cache < 2)
+		cache = RIFF_HTTP_CACHE_BLOCKS;
+
+	struct riff_http *h = calloc(1, sizeof(struct riff_http));
+	if(h == NULL)
+		return RIFF_ERROR_MEMORY;
+	h->sock = -1;
+	h->block = block;
+	h->ahead = 1;
+	int r = http_parseUrl(h, url);
+	if(r != RIFF_ERROR_NONE){
+		http_free(h);
+		return r;
+	}
+	h->nslots = cache;
+	h->slots = calloc(cache, sizeof(struct http_slot));
+	int i;
+	for(i = 0; h->slots != NULL  &&  i < cache; i++)
+		if((h->slots[i].data = malloc(block)) == NULL)
+			break;
+	if(h->slots == NULL  ||  i < cache){
+		http_free(h);
+		return RIFF_ERROR_MEMORY;
+	}
+
+	//first block, also tells the file size
+	if((r = http_fetch(h, 0, 1)) != RIFF_ERROR_NONE){
+		http_free(h);
+		return r;
+	}
+	h->next = 1;
+#if RIFF_THREADS
+	pthread_mutex_init(&h->lock, NULL);
+#endif
+
+	rh->fh = h;
+	rh->size = h->size;
+	rh->pos_start = 0;
+	rh->pos = 0;
+
+	rh->fp_read = &read_http;
+	rh->fp_seek = &seek_http;
+	rh->fp_readAt = &readAt_http;
+	rh->fp_close = &close_http;
+
+	return riff_readHeader(rh);
+#else
+	(void)url; (void)block; (void)cache;
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
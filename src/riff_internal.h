@@ -0,0 +1,74 @@
+/*
+libriff
+
+Author/copyright: Markus Wolf, alexmush
+License: zlib (https://opensource.org/licenses/Zlib)
+
+
+Internal functions shared between the libriff translation units, not part of the public API.
+*/
+
+#ifndef _RIFF_INTERNAL_H_
+#define _RIFF_INTERNAL_H_
+
+#include "riff.h"
+
+//read via FP and update I/O statistics
+//payload: 0 if header bytes are read, 1 if chunk data is read
+size_t riff_ioRead(riff_handle *rh, void *ptr, size_t size, int payload);
+
+//seek via FP and update I/O statistics
+size_t riff_ioSeek(riff_handle *rh, size_t pos);
+
+//record diagnostic, returns the error code
+int riff_report(riff_handle *rh, int code, int kind, size_t pos, const char *id, size_t expected, size_t actual);
+
+//read chunk header at the current position
+int riff_readChunkHeader(riff_handle *rh);
+
+//set up current chunk from header bytes read at rh->pos, n: amount of bytes read
+int riff_parseChunkHeader(riff_handle *rh, const char *buf, size_t n);
+
+//forget the memoized metadata of all levels, needed when the file structure changes
+void riff_levelForget(riff_handle *rh);
+
+//free the breadcrumbs of all levels
+void riff_levelFreeCrumbs(riff_handle *rh);
+
+//pass pointer to 32 bit LE value and convert, return in native byte order
+uint32_t convUInt32LE(const void *p);
+
+//check 4 ID bytes for printable ASCII (0x20 - 0x7e), all bytes at once
+//returns 1 if valid
+int riff_fourccValid(const void *id);
+
+#define RIFF_HASH_BUFFER_SIZE (1 << 16)  //read buffer for streamed hashing
+
+//hash size bytes at absolute stream position pos, updates the position
+//buf: read buffer of RIFF_HASH_BUFFER_SIZE bytes, only used if the data can't be mapped via fp_map
+int riff_hashRange(riff_handle *rh, size_t pos, size_t size, int algo, uint8_t *buf, uint64_t *hash);
+
+//build CRC-32C tables, must be called before riff_hashRange() and before any threads are started
+void crc32c_init(void);
+
+//write size bytes at absolute stream position pos, updates the writer position
+int riff_writeAt(riff_writer *rw, size_t pos, const void *ptr, size_t size);
+
+#define RIFF_ADVISE_WINDOW (1 << 23)  //prefetch/drop granularity in RIFF_ACCESS_STREAM mode
+
+//posix_fadvise() on a file descriptor, RIFF_ERROR_ACCESS if not supported
+int riff_adviseFd(int fd, int advice, size_t pos, size_t size);
+
+//pread() loop on a file descriptor, returns the amount of bytes read
+size_t riff_readAtFd(int fd, void *ptr, size_t size, size_t pos);
+
+//pwrite() loop on a file descriptor, returns the amount of bytes written
+size_t riff_writeAtFd(int fd, const void *ptr, size_t size, size_t pos);
+
+//prefetch hooks, only called if riff_handle::prefetch is set
+//next chunk header at posnew from the queue, stream is positioned at its data afterwards
+int riff_prefetchNext(riff_handle *rh, size_t posnew, size_t listend);
+//serve read from the queued data of the current chunk, returns the amount of bytes copied
+size_t riff_prefetchRead(riff_handle *rh, void *to, size_t size);
+
+#endif // _RIFF_INTERNAL_H_
@@ -0,0 +1,339 @@
+// Prefetching traversal: a background thread reads ahead the chunk headers of the current list level
+//
+// The thread reads via riff_handle::fp_readAt only, so the stream position of the handle is never touched.
+// riff_seekNextChunk() consumes the queue in order, a request for any other position restarts the thread there.
+// Every list level the traversal is in keeps its own queue, so descending into a list and returning doesn't discard
+// the read-ahead of the parent level. The thread fills the innermost level first, then the ones above it.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if RIFF_THREADS
+#include <pthread.h>
+
+
+#define PREFETCH_LEVELS 16  //list levels with their own queue, deeper ones restart the innermost queue
+
+
+struct prefetch_level {
+	uint8_t *ring;      //depth entries of entry_size bytes, allocated on first use
+	size_t *ring_pos;   //position of each queued chunk
+	size_t *ring_n;     //bytes read for each queued chunk
+	int head;
+	int count;
+
+	size_t next;      //position of the next chunk to read ahead
+	size_t listend;   //end of the list level
+	int idle;         //end of level reached or read failed
+};
+
+struct riff_prefetch {
+	riff_handle *rh;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond_work;   //thread waits for room in a queue or a restart
+	pthread_cond_t cond_ready;  //consumer waits for a queued chunk
+
+	int depth;
+	size_t bytes;       //data bytes per chunk
+	size_t entry_size;  //header + data bytes
+	struct prefetch_level level[PREFETCH_LEVELS];
+	int top;            //innermost level, the one of the consumer
+	uint8_t *buf;       //read buffer of the thread
+	unsigned gen;       //incremented when a queue is restarted or dropped, reads of older generations are dropped
+	int stop;
+
+	//current chunk, taken from the queue
+	uint8_t *cur;
+	size_t cur_pos;
+	size_t cur_n;     //valid data bytes
+};
+
+
+/*****************************************************************************/
+//allocate the queue of a level if not done yet and restart it at pos, returns RIFF error code
+int prefetch_reset(struct riff_prefetch *pf, struct prefetch_level *lv, size_t pos, size_t listend){
+	if(lv->ring == NULL){
+		lv->ring = malloc(pf->depth * pf->entry_size);
+		lv->ring_pos = malloc(pf->depth * sizeof(size_t));
+		lv->ring_n = malloc(pf->depth * sizeof(size_t));
+		if(lv->ring == NULL  ||  lv->ring_pos == NULL  ||  lv->ring_n == NULL){
+			free(lv->ring);
+			free(lv->ring_pos);
+			free(lv->ring_n);
+			lv->ring = NULL;
+			lv->ring_pos = lv->ring_n = NULL;
+			return RIFF_ERROR_MEMORY;
+		}
+	}
+	lv->head = 0;
+	lv->count = 0;
+	lv->next = pos;
+	lv->listend = listend;
+	lv->idle = 0;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//innermost level that needs reading ahead, -1 if none
+int prefetch_work(struct riff_prefetch *pf){
+	int l;
+	for(l = pf->top; l >= 0; l--)
+		if(!pf->level[l].idle  &&  pf->level[l].count < pf->depth)
+			return l;
+	return -1;
+}
+
+/*****************************************************************************/
+//queue of the level ending at listend, returns to a parent level, enters a sublevel or restarts
+struct prefetch_level *prefetch_level(struct riff_prefetch *pf, size_t posnew, size_t listend){
+	int l;
+	for(l = pf->top; l >= 0; l--){
+		if(pf->level[l].listend == listend){
+			if(l < pf->top)
+				pf->gen++; //sublevels are left
+			pf->top = l;
+			return pf->level + l;
+		}
+	}
+	//entered a list within the innermost level, the queues above are kept
+	struct prefetch_level *lv = pf->level + pf->top;
+	if(pf->top + 1 < PREFETCH_LEVELS  &&  posnew < lv->listend  &&  listend <= lv->listend
+		&&  prefetch_reset(pf, lv + 1, posnew, listend) == RIFF_ERROR_NONE){
+		pf->top++;
+		return lv + 1;
+	}
+	//somewhere else
+	pf->gen++;
+	pf->top = 0;
+	prefetch_reset(pf, pf->level, posnew, listend); //level 0 is always allocated
+	return pf->level;
+}
+
+/*****************************************************************************/
+void *prefetch_thread(void *arg){
+	struct riff_prefetch *pf = (struct riff_prefetch *)arg;
+	riff_handle *rh = pf->rh;
+	uint8_t *buf = pf->buf;
+	int l;
+
+	pthread_mutex_lock(&pf->lock);
+	for(;;){
+		while(!pf->stop  &&  (l = prefetch_work(pf)) < 0)
+			pthread_cond_wait(&pf->cond_work, &pf->lock);
+		if(pf->stop)
+			break;
+
+		struct prefetch_level *lv = pf->level + l;
+		size_t pos = lv->next;
+		unsigned gen = pf->gen;
+		if(pos + RIFF_CHUNK_DATA_OFFSET > lv->listend){
+			lv->idle = 1;
+			pthread_cond_signal(&pf->cond_ready);
+			continue;
+		}
+		size_t size = pf->entry_size;
+		if(size > lv->listend - pos)
+			size = lv->listend - pos;
+
+		pthread_mutex_unlock(&pf->lock);
+		size_t n = rh->fp_readAt(rh, buf, size, pos);
+		pthread_mutex_lock(&pf->lock);
+
+		if(gen != pf->gen)
+			continue; //restarted or left meanwhile
+
+		int slot = (lv->head + lv->count) % pf->depth;
+		memcpy(lv->ring + slot * pf->entry_size, buf, n);
+		lv->ring_pos[slot] = pos;
+		lv->ring_n[slot] = n;
+		lv->count++;
+		if(n < RIFF_CHUNK_DATA_OFFSET)
+			lv->idle = 1; //the consumer reports the short read
+		else {
+			size_t c_size = convUInt32LE(buf + 4);
+			lv->next = pos + RIFF_CHUNK_DATA_OFFSET + c_size + (c_size & 1);
+		}
+		pthread_cond_signal(&pf->cond_ready);
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+/*****************************************************************************/
+//free all resources, thread must not be running
+void prefetch_free(struct riff_prefetch *pf){
+	int l;
+	for(l = 0; l < PREFETCH_LEVELS; l++){
+		free(pf->level[l].ring);
+		free(pf->level[l].ring_pos);
+		free(pf->level[l].ring_n);
+	}
+	free(pf->cur);
+	free(pf->buf);
+	free(pf);
+}
+
+
+/*****************************************************************************/
+//description: see riff_internal.h
+int riff_prefetchNext(riff_handle *rh, size_t posnew, size_t listend){
+	struct riff_prefetch *pf = rh->prefetch;
+	struct prefetch_level *lv;
+
+	pthread_mutex_lock(&pf->lock);
+	for(;;){
+		lv = prefetch_level(pf, posnew, listend);
+		if(lv->count > 0  &&  lv->ring_pos[lv->head] == posnew)
+			break;
+		if(lv->count == 0  &&  !lv->idle  &&  lv->next == posnew){
+			pthread_cond_signal(&pf->cond_work); //the level may just have been entered
+			pthread_cond_wait(&pf->cond_ready, &pf->lock); //on its way
+			continue;
+		}
+		//somewhere else in the level, restart there
+		pf->gen++;
+		prefetch_reset(pf, lv, posnew, listend);
+		pthread_cond_signal(&pf->cond_work);
+	}
+	size_t n = lv->ring_n[lv->head];
+	memcpy(pf->cur, lv->ring + lv->head * pf->entry_size, n);
+	lv->head = (lv->head + 1) % pf->depth;
+	lv->count--;
+	pthread_cond_signal(&pf->cond_work);
+	pthread_mutex_unlock(&pf->lock);
+
+	//data bytes are counted when they are served
+	size_t h = n < RIFF_CHUNK_DATA_OFFSET ? n : RIFF_CHUNK_DATA_OFFSET;
+	rh->io.bytes_read += h;
+	rh->io.bytes_header += h;
+	riff_ioSeek(rh, posnew + RIFF_CHUNK_DATA_OFFSET);
+
+	int r = riff_parseChunkHeader(rh, (const char *)pf->cur, h);
+	pf->cur_pos = posnew;
+	pf->cur_n = 0;
+	if(n > RIFF_CHUNK_DATA_OFFSET)
+		pf->cur_n = n - RIFF_CHUNK_DATA_OFFSET < rh->c_size ? n - RIFF_CHUNK_DATA_OFFSET : rh->c_size;
+	return r;
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_prefetchRead(riff_handle *rh, void *to, size_t size){
+	struct riff_prefetch *pf = rh->prefetch;
+	if(pf->cur_pos != rh->c_pos_start  ||  rh->c_pos >= pf->cur_n)
+		return 0;
+
+	size_t n = pf->cur_n - rh->c_pos;
+	if(n > size)
+		n = size;
+	memcpy(to, pf->cur + RIFF_CHUNK_DATA_OFFSET + rh->c_pos, n);
+	rh->pos += n;
+	rh->c_pos += n;
+	rh->io.bytes_read += n;
+	rh->io.bytes_payload += n;
+	riff_ioSeek(rh, rh->pos); //keep the stream in sync for the following reads
+	return n;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_prefetchStart(riff_handle *rh, int depth, size_t bytes){
+	if(rh == NULL  ||  depth <= 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	if(rh->fp_readAt == NULL)
+		return RIFF_ERROR_ACCESS;
+	riff_prefetchStop(rh);
+
+	struct riff_prefetch *pf = calloc(1, sizeof(struct riff_prefetch));
+	if(pf == NULL)
+		return RIFF_ERROR_MEMORY;
+	pf->rh = rh;
+	pf->depth = depth;
+	pf->bytes = bytes;
+	pf->entry_size = RIFF_CHUNK_DATA_OFFSET + bytes;
+	pf->cur = malloc(pf->entry_size);
+	pf->buf = malloc(pf->entry_size);
+
+	//start right after the current chunk
+	size_t listend;
+	if(rh->ls_level > 0)
+		listend = rh->ls[rh->ls_level - 1].c_pos_start + RIFF_CHUNK_DATA_OFFSET + rh->ls[rh->ls_level - 1].c_size;
+	else
+		listend = rh->pos_start + RIFF_CHUNK_DATA_OFFSET + rh->h_size;
+	if(pf->cur == NULL  ||  pf->buf == NULL  ||  prefetch_reset(pf, pf->level, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET + rh->c_size + rh->pad, listend) != RIFF_ERROR_NONE){
+		prefetch_free(pf);
+		return RIFF_ERROR_MEMORY;
+	}
+	pf->cur_pos = (size_t)-1;
+
+	pthread_mutex_init(&pf->lock, NULL);
+	pthread_cond_init(&pf->cond_work, NULL);
+	pthread_cond_init(&pf->cond_ready, NULL);
+	if(pthread_create(&pf->thread, NULL, prefetch_thread, pf) != 0){
+		pthread_mutex_destroy(&pf->lock);
+		pthread_cond_destroy(&pf->cond_work);
+		pthread_cond_destroy(&pf->cond_ready);
+		prefetch_free(pf);
+		return RIFF_ERROR_ACCESS;
+	}
+	rh->prefetch = pf;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_prefetchStop(riff_handle *rh){
+	if(rh == NULL  ||  rh->prefetch == NULL)
+		return;
+	struct riff_prefetch *pf = rh->prefetch;
+
+	pthread_mutex_lock(&pf->lock);
+	pf->stop = 1;
+	pthread_cond_signal(&pf->cond_work);
+	pthread_mutex_unlock(&pf->lock);
+	pthread_join(pf->thread, NULL);
+
+	pthread_mutex_destroy(&pf->lock);
+	pthread_cond_destroy(&pf->cond_work);
+	pthread_cond_destroy(&pf->cond_ready);
+	prefetch_free(pf);
+	rh->prefetch = NULL;
+}
+
+#else
+
+/*****************************************************************************/
+//description: see riff_internal.h
+int riff_prefetchNext(riff_handle *rh, size_t posnew, size_t listend){
+	(void)posnew; (void)listend;
+	return RIFF_ERROR_INVALID_HANDLE; //never started
+}
+
+/*****************************************************************************/
+//description: see riff_internal.h
+size_t riff_prefetchRead(riff_handle *rh, void *to, size_t size){
+	(void)rh; (void)to; (void)size;
+	return 0;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_prefetchStart(riff_handle *rh, int depth, size_t bytes){
+	(void)depth; (void)bytes;
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	return RIFF_ERROR_ACCESS; //built without threads
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_prefetchStop(riff_handle *rh){
+	(void)rh;
+}
+
+#endif
@@ -0,0 +1,179 @@
+// Bulk header scanner for RIFF files that are completely in memory
+//
+// Walks the chunk headers straight from the buffer without a riff_handle, so there are no I/O callbacks,
+// no level stack and no diagnostics per chunk. The list levels are kept in a small local stack instead.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+
+#define SCAN_LEVELS 64  //list levels on the local stack, deeper files allocate
+
+
+//open list level
+struct scan_level {
+	size_t end;      //end of the list data without pad byte
+	size_t next;     //position after the list chunk including pad byte
+	int32_t node;    //node of the list chunk
+	int32_t prev;    //last node added to the level
+};
+
+
+/*****************************************************************************/
+//add node if there is room, link it to its parent and previous sibling
+//the count grows in any case, nodes beyond cap are only counted
+void scan_add(struct riff_treeNode *nodes, int32_t cap, int32_t n, int32_t parent, int32_t prev, size_t pos, size_t size, const uint8_t *id){
+	if(n >= cap)
+		return;
+	struct riff_treeNode *node = nodes + n;
+	node->c_pos_start = pos;
+	node->c_size = size;
+	memcpy(node->c_id, id, 4);
+	node->c_id[4] = 0;
+	memset(node->c_type, 0, sizeof(node->c_type));
+	node->parent = parent;
+	node->first_child = RIFF_TREE_NONE;
+	node->next_sibling = RIFF_TREE_NONE;
+	node->depth = 0;
+	if(parent != RIFF_TREE_NONE  &&  parent < cap){
+		node->depth = nodes[parent].depth + 1;
+		if(prev == RIFF_TREE_NONE)
+			nodes[parent].first_child = n;
+	}
+	if(prev != RIFF_TREE_NONE  &&  prev < cap)
+		nodes[prev].next_sibling = n;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_scanBuffer(const void *ptr, size_t len, struct riff_treeNode *nodes, int32_t cap, int32_t *count){
+	if(ptr == NULL  ||  count == NULL  ||  (nodes == NULL  &&  cap > 0))
+		return RIFF_ERROR_INVALID_HANDLE;
+	const uint8_t *buf = (const uint8_t *)ptr;
+	*count = 0;
+
+	//RIFF header
+	if(len < RIFF_HEADER_SIZE)
+		return RIFF_ERROR_EOF;
+	if(memcmp(buf, "RIFF", 4) != 0  &&  memcmp(buf, "BW64", 4) != 0)
+		return RIFF_ERROR_ILLID;
+	size_t h_size = convUInt32LE(buf + 4);
+	if(h_size == 0xFFFFFFFF  &&  len >= RIFF_HEADER_SIZE + RIFF_CHUNK_DATA_OFFSET + 8  &&  memcmp(buf + RIFF_HEADER_SIZE, "ds64", 4) == 0){
+		//64 bit size of BW64/RF64 files, see riff_readHeader()
+		if(convUInt32LE(buf + RIFF_HEADER_SIZE + 4) < 8)
+			return RIFF_ERROR_ICSIZE;
+		const uint8_t *ds = buf + RIFF_HEADER_SIZE + RIFF_CHUNK_DATA_OFFSET;
+		h_size = ((size_t)convUInt32LE(ds + 4) << 32) | convUInt32LE(ds);
+	}
+	int32_t n = 0;
+	scan_add(nodes, cap, n, RIFF_TREE_NONE, RIFF_TREE_NONE, 0, h_size, buf);
+	if(cap > 0)
+		memcpy(nodes->c_type, buf + 8, 4);
+	n++;
+
+	struct scan_level stack_local[SCAN_LEVELS];
+	struct scan_level *stack = stack_local;
+	int levels = SCAN_LEVELS;
+	int level = 0;
+	stack[0].end = RIFF_CHUNK_DATA_OFFSET + h_size;
+	stack[0].next = stack[0].end;
+	stack[0].node = 0;
+	stack[0].prev = RIFF_TREE_NONE;
+
+	size_t pos = RIFF_HEADER_SIZE;
+	int r = RIFF_ERROR_NONE;
+	int excess = 0;   //bytes at a list end that are too few for a chunk
+	int first = 1;    //first chunk of a level, read even if it doesn't fit, like riff_seekLevelSub()
+
+	while(1){
+		struct scan_level *ls = stack + level;
+
+		//end of level, continue behind the list in the parent level
+		if(!first  &&  ls->end < pos + RIFF_CHUNK_DATA_OFFSET){
+			if(ls->end > pos)
+				excess = 1;
+			if(level == 0)
+				break;
+			pos = ls->next;
+			level--;
+			stack[level].prev = ls->node;
+			continue;
+		}
+
+		//chunk header
+		if(pos + RIFF_CHUNK_DATA_OFFSET > len){
+			r = RIFF_ERROR_EOF;
+			break;
+		}
+		size_t cpos = pos;
+		const uint8_t *h = buf + cpos;
+		if(!riff_fourccValid(h)){
+			r = RIFF_ERROR_ILLID;
+			break;
+		}
+		size_t c_size = convUInt32LE(h + 4);
+		size_t cposend = cpos + RIFF_CHUNK_DATA_OFFSET + c_size + (c_size & 1);
+		if(cposend > ls->end){
+			r = RIFF_ERROR_ICSIZE;
+			break;
+		}
+		if(cposend > len){
+			r = RIFF_ERROR_EOF;
+			break;
+		}
+
+		int32_t c = n++;
+		scan_add(nodes, cap, c, ls->node, ls->prev, cpos, c_size, h);
+		ls->prev = c;
+		first = 0;
+		pos = cposend;
+
+		if(memcmp(h, "LIST", 4) != 0  &&  memcmp(h, "RIFF", 4) != 0  &&  memcmp(h, "BW64", 4) != 0)
+			continue;
+
+		//descend into list
+		if(c_size < 4){
+			r = RIFF_ERROR_ICSIZE;
+			break;
+		}
+		if(!riff_fourccValid(h + RIFF_CHUNK_DATA_OFFSET)){
+			r = RIFF_ERROR_ILLID;
+			break;
+		}
+		if(c < cap)
+			memcpy(nodes[c].c_type, h + RIFF_CHUNK_DATA_OFFSET, 4);
+		if(c_size == 4)
+			continue; //empty list
+
+		if(level + 1 >= levels){
+			struct scan_level *snew = malloc(levels * 2 * sizeof(struct scan_level));
+			if(snew == NULL){
+				r = RIFF_ERROR_MEMORY;
+				break;
+			}
+			memcpy(snew, stack, levels * sizeof(struct scan_level));
+			if(stack != stack_local)
+				free(stack);
+			stack = snew;
+			levels *= 2;
+		}
+		level++;
+		stack[level].end = cpos + RIFF_CHUNK_DATA_OFFSET + c_size;
+		stack[level].next = cposend;
+		stack[level].node = c;
+		stack[level].prev = RIFF_TREE_NONE;
+		pos = cpos + RIFF_CHUNK_DATA_OFFSET + 4;
+		first = 1;
+	}
+
+	if(stack != stack_local)
+		free(stack);
+	*count = n;
+	if(r == RIFF_ERROR_NONE  &&  excess)
+		r = RIFF_ERROR_EXDAT;
+	return r;
+}
@@ -0,0 +1,316 @@
+// Buffered file descriptor sink for riff_writer
+//
+// Data goes through an aligned buffer whose file position is always a multiple of the alignment, so every write
+// is a whole number of blocks at an aligned offset (as O_DIRECT requires). Only the last partial block is written
+// padded and stays in the buffer to be written again when it is complete.
+// Size fields of ended chunks lie behind the buffer, they are patched in place (read-modify-write of a block with O_DIRECT).
+//
+// Compiles to a stub returning RIFF_ERROR_INVALID_HANDLE on systems without file descriptors.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //O_DIRECT, fallocate(), sync_file_range()
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define RIFF_FD 1
+#endif
+
+
+#if RIFF_FD
+
+//sink state, riff_writer::fh
+struct riff_sink {
+	int fd;
+	int fl;            //file status flags before O_DIRECT was set
+	int direct;        //O_DIRECT is set
+	uint8_t *buf;      //write buffer
+	size_t size;       //buffer size, multiple of align
+	size_t align;
+	size_t start;      //file position of buf[0], multiple of align
+	size_t fill;       //valid bytes in buf
+	size_t cur;        //write position
+	size_t end;        //end of the written data
+	size_t prealloc;   //preallocation extent, 0 if off
+	size_t alloc_end;  //end of the preallocated range
+	size_t fsize;      //file size when the sink was opened
+	size_t window;     //writeback window, 0 if off
+	size_t synced;     //data before this position was handed to writeback
+	size_t written;    //data before this position was written to the file
+	uint8_t *block;    //scratch block for patches with O_DIRECT
+};
+
+
+/*****************************************************************************/
+//preallocate the file up to at least pos in whole extents, the file size stays unchanged
+void sink_prealloc(struct riff_sink *s, size_t pos){
+#if defined(__linux__)
+	while(s->prealloc > 0  &&  s->alloc_end < pos){
+		if(fallocate(s->fd, FALLOC_FL_KEEP_SIZE, s->alloc_end, s->prealloc) != 0){
+			s->prealloc = 0; //not supported by the file system, don't try again
+			return;
+		}
+		s->alloc_end += s->prealloc;
+	}
+#else
+	(void)s; (void)pos;
+#endif
+}
+
+/*****************************************************************************/
+//start writeback of complete windows, wait for the window before and drop it from the page cache
+void sink_sync(struct riff_sink *s){
+#if defined(__linux__)
+	while(s->window > 0  &&  s->written - s->synced >= s->window){
+		sync_file_range(s->fd, s->synced, s->window, SYNC_FILE_RANGE_WRITE);
+		if(s->synced >= s->window){
+			size_t prev = s->synced - s->window;
+			sync_file_range(s->fd, prev, s->window, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			riff_adviseFd(s->fd, RIFF_ADVISE_DONTNEED, prev, s->window);
+		}
+		s->synced += s->window;
+	}
+#else
+	(void)s;
+#endif
+}
+
+/*****************************************************************************/
+//write the buffer, the last partial block is padded and kept at the buffer start
+int sink_flush(struct riff_sink *s){
+	if(s->fill == 0)
+		return RIFF_ERROR_NONE;
+	size_t len = s->fill;
+	if(s->direct){
+		len = (len + s->align - 1) & ~(s->align - 1);
+		memset(s->buf + s->fill, 0, len - s->fill);
+	}
+	sink_prealloc(s, s->start + len);
+	if(riff_writeAtFd(s->fd, s->buf, len, s->start) != len)
+		return RIFF_ERROR_ACCESS;
+
+	size_t k = s->fill & ~(s->align - 1);
+	if(s->start + k > s->written)
+		s->written = s->start + k;
+	memmove(s->buf, s->buf + k, s->fill - k);
+	s->start += k;
+	s->fill -= k;
+	sink_sync(s);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//continue buffering at pos outside of the buffer, e.g. behind data written by the kernel
+int sink_rebase(struct riff_sink *s, size_t pos){
+	int r = sink_flush(s);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	s->start = pos & ~(s->align - 1);
+	s->fill = pos - s->start;
+	if(s->fill > 0){
+		//existing start of the block, it is written again with the buffer
+		size_t n = riff_readAtFd(s->fd, s->buf, s->align, s->start);
+		if(n < s->fill)
+			return RIFF_ERROR_ACCESS;
+	}
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//write data behind the buffer
+int sink_patch(struct riff_sink *s, size_t pos, const uint8_t *ptr, size_t size){
+	if(!s->direct)
+		return riff_writeAtFd(s->fd, ptr, size, pos) == size ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+
+	//whole blocks only
+	while(size > 0){
+		size_t bpos = pos & ~(s->align - 1);
+		size_t off = pos - bpos;
+		size_t n = s->align - off < size ? s->align - off : size;
+		size_t got = riff_readAtFd(s->fd, s->block, s->align, bpos);
+		if(got < off + n)
+			return RIFF_ERROR_ACCESS;
+		memset(s->block + got, 0, s->align - got);
+		memcpy(s->block + off, ptr, n);
+		if(riff_writeAtFd(s->fd, s->block, s->align, bpos) != s->align)
+			return RIFF_ERROR_ACCESS;
+		pos += n;
+		ptr += n;
+		size -= n;
+	}
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//cut off padding of the last block and release preallocated space behind the data
+void sink_trim(struct riff_sink *s){
+	struct stat st;
+	if(fstat(s->fd, &st) != 0)
+		return;
+	size_t fsize = st.st_size;
+	//never cut data that was in the file before, only padding of the last block or the file end itself
+	if(s->end >= s->fsize  &&  fsize >= s->end  &&  fsize - s->end < s->align  &&  (s->direct  ||  s->alloc_end > s->fsize))
+		if(ftruncate(s->fd, s->end) != 0)
+			return;
+}
+
+
+/*****************************************************************************/
+size_t write_sink(riff_writer *rw, const void *ptr, size_t size){
+	struct riff_sink *s = (struct riff_sink *)rw->fh;
+	const uint8_t *p = (const uint8_t *)ptr;
+	size_t done = 0;
+	while(done < size){
+		size_t n;
+		if(s->cur < s->start){
+			//size field of an ended chunk
+			n = s->start - s->cur < size - done ? s->start - s->cur : size - done;
+			if(sink_patch(s, s->cur, p + done, n) != RIFF_ERROR_NONE)
+				break;
+		}
+		else {
+			if(s->cur > s->start + s->fill  &&  sink_rebase(s, s->cur) != RIFF_ERROR_NONE)
+				break;
+			size_t off = s->cur - s->start;
+			n = s->size - off < size - done ? s->size - off : size - done;
+			memcpy(s->buf + off, p + done, n);
+			if(off + n > s->fill)
+				s->fill = off + n;
+			if(s->fill == s->size  &&  sink_flush(s) != RIFF_ERROR_NONE)
+				break;
+		}
+		done += n;
+		s->cur += n;
+		if(s->cur > s->end)
+			s->end = s->cur;
+	}
+	return done;
+}
+
+/*****************************************************************************/
+size_t wseek_sink(riff_writer *rw, size_t pos){
+	struct riff_sink *s = (struct riff_sink *)rw->fh;
+	s->cur = pos;
+	if(pos > s->end)
+		s->end = pos; //behind data written by the kernel, see copy_offload()
+	return pos;
+}
+
+/*****************************************************************************/
+int wfd_sink(riff_writer *rw){
+	struct riff_sink *s = (struct riff_sink *)rw->fh;
+	if(sink_flush(s) != RIFF_ERROR_NONE)
+		return -1;
+	//the kernel writes at the position, the padding of the kept block must not be written over it again
+	if(s->direct){
+		s->start = (s->cur + s->align - 1) & ~(s->align - 1);
+		s->fill = 0;
+	}
+	return s->fd;
+}
+
+/*****************************************************************************/
+int flush_sink(riff_writer *rw){
+	struct riff_sink *s = (struct riff_sink *)rw->fh;
+	int r = sink_flush(s);
+	sink_trim(s);
+	return r;
+}
+
+/*****************************************************************************/
+void close_sink(riff_writer *rw){
+	struct riff_sink *s = (struct riff_sink *)rw->fh;
+	flush_sink(rw);
+	if(s->direct)
+		fcntl(s->fd, F_SETFL, s->fl);
+	lseek(s->fd, rw->pos, SEEK_SET);
+	free(s->buf);
+	free(s->block);
+	free(s);
+	rw->fh = NULL;
+	rw->fp_write = NULL;
+}
+
+#endif
+
+/*****************************************************************************/
+//description: see header file
+int riff_writer_open_sink(riff_writer *rw, int fd, const struct riff_sinkConfig *cfg){
+#if RIFF_FD
+	if(rw == NULL  ||  fd < 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	struct riff_sinkConfig def = {RIFF_SINK_BUFFER_SIZE, RIFF_SINK_ALIGN, RIFF_SINK_PREALLOC, RIFF_SINK_SYNC_WINDOW, 0};
+	if(cfg == NULL)
+		cfg = &def;
+	size_t align = cfg->align > 0 ? cfg->align : RIFF_SINK_ALIGN;
+	if((align & (align - 1)) != 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	if(pos < 0)
+		return RIFF_ERROR_ACCESS;
+
+	struct riff_sink *s = calloc(1, sizeof(struct riff_sink));
+	if(s == NULL)
+		return RIFF_ERROR_MEMORY;
+	s->fd = fd;
+	s->align = align;
+	s->size = cfg->buffer_size > 0 ? cfg->buffer_size : RIFF_SINK_BUFFER_SIZE;
+	s->size = (s->size + align - 1) & ~(align - 1);
+	s->prealloc = cfg->prealloc;
+	s->window = cfg->sync_window;
+	if(posix_memalign((void **)&s->buf, align, s->size) != 0){
+		free(s);
+		return RIFF_ERROR_MEMORY;
+	}
+
+#if defined(__linux__)
+	if(cfg->flags & RIFF_SINK_DIRECT){
+		s->fl = fcntl(fd, F_GETFL);
+		if(posix_memalign((void **)&s->block, align, align) != 0){
+			free(s->buf);
+			free(s);
+			return RIFF_ERROR_MEMORY;
+		}
+		s->direct = s->fl >= 0  &&  fcntl(fd, F_SETFL, s->fl | O_DIRECT) == 0;
+		s->window = 0; //nothing in the page cache
+	}
+#endif
+
+	//existing data of the first block is kept
+	struct stat st;
+	s->fsize = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+	s->alloc_end = s->fsize;
+	s->end = pos;
+	s->cur = pos;
+	s->written = s->synced = pos & ~(align - 1);
+	if(sink_rebase(s, pos) != RIFF_ERROR_NONE){
+		if(s->direct)
+			fcntl(fd, F_SETFL, s->fl);
+		free(s->buf);
+		free(s->block);
+		free(s);
+		return RIFF_ERROR_ACCESS;
+	}
+
+	rw->fh = s;
+	rw->pos = pos;
+	rw->fp_write = &write_sink;
+	rw->fp_seek = &wseek_sink;
+	rw->fp_fd = &wfd_sink;
+	rw->fp_flush = &flush_sink;
+	rw->fp_close = &close_sink;
+	return RIFF_ERROR_NONE;
+#else
+	(void)rw; (void)fd; (void)cfg;
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
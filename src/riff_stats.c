@@ -0,0 +1,175 @@
+// Per-ID chunk statistics of a whole file, collected in one walk
+//
+// Entries are looked up by ID in an open addressing hash index, so a chunk costs a header read and a probe.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+
+#define STATS_ENTRIES 32  //initial entry array size, the index has twice as many slots
+
+
+/*****************************************************************************/
+//index slot of an ID
+size_t stats_slot(const struct riff_stats *stats, const char *id, int list){
+	uint32_t k = convUInt32LE(id);
+	uint64_t h = ((uint64_t)k * 2 + list) * 0x9E3779B97F4A7C15ULL; //Fibonacci hashing
+	return (size_t)(h >> 32) & (stats->index_size - 1);
+}
+
+/*****************************************************************************/
+//rebuild index with double size, entries are kept
+int stats_grow(struct riff_stats *stats){
+	int32_t capnew = stats->capacity > 0 ? stats->capacity * 2 : STATS_ENTRIES;
+	struct riff_statsEntry *enew = realloc(stats->entries, capnew * sizeof(struct riff_statsEntry));
+	if(enew == NULL)
+		return RIFF_ERROR_MEMORY;
+	stats->entries = enew;
+	stats->capacity = capnew;
+
+	int32_t *inew = malloc(capnew * 2 * sizeof(int32_t));
+	if(inew == NULL)
+		return RIFF_ERROR_MEMORY;
+	free(stats->index);
+	stats->index = inew;
+	stats->index_size = capnew * 2;
+	memset(inew, 0xFF, stats->index_size * sizeof(int32_t)); //-1: empty
+
+	int32_t i;
+	for(i = 0; i < stats->count; i++){
+		size_t s = stats_slot(stats, stats->entries[i].id, stats->entries[i].list);
+		while(inew[s] >= 0)
+			s = (s + 1) & (stats->index_size - 1);
+		inew[s] = i;
+	}
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//count a chunk of an ID or a list of a type
+int stats_add(struct riff_stats *stats, const char *id, int list, size_t size, int32_t depth){
+	size_t s = stats_slot(stats, id, list);
+	struct riff_statsEntry *e = NULL;
+	int32_t i;
+	while((i = stats->index[s]) >= 0){
+		if(stats->entries[i].list == list  &&  memcmp(stats->entries[i].id, id, 4) == 0){
+			e = stats->entries + i;
+			break;
+		}
+		s = (s + 1) & (stats->index_size - 1);
+	}
+
+	if(e == NULL){
+		//new ID, keep the index at most half full
+		if(stats->count >= stats->capacity){
+			if(stats_grow(stats) != RIFF_ERROR_NONE)
+				return RIFF_ERROR_MEMORY;
+			return stats_add(stats, id, list, size, depth);
+		}
+		i = stats->count++;
+		stats->index[s] = i;
+		e = stats->entries + i;
+		memset(e, 0, sizeof(struct riff_statsEntry));
+		memcpy(e->id, id, 4);
+		e->list = list;
+		e->min = size;
+	}
+
+	e->count++;
+	e->total += size;
+	if(size < e->min)
+		e->min = size;
+	if(size > e->max)
+		e->max = size;
+	if(depth > e->max_depth)
+		e->max_depth = depth;
+	int b = 0;
+	while(b < RIFF_STATS_BUCKETS - 1  &&  (size >> b) != 0)
+		b++;
+	e->histogram[b]++;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_collectStats(riff_handle *rh, struct riff_stats *stats){
+	if(rh == NULL  ||  stats == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+
+	stats->count = 0;
+	stats->chunks = 0;
+	stats->max_depth = 0;
+	if(stats->index == NULL){
+		if(stats_grow(stats) != RIFF_ERROR_NONE)
+			return RIFF_ERROR_MEMORY;
+	}
+	else
+		memset(stats->index, 0xFF, stats->index_size * sizeof(int32_t));
+
+	int r = riff_rewind(rh);
+	if(r >= RIFF_ERROR_CRITICAL)
+		return r;
+
+	//same walk as riff_parseTree()
+	while(1){
+		int32_t depth = rh->ls_level + 1;
+		if(stats_add(stats, rh->c_id, 0, rh->c_size, depth) != RIFF_ERROR_NONE)
+			return RIFF_ERROR_MEMORY;
+		stats->chunks++;
+		if(depth > stats->max_depth)
+			stats->max_depth = depth;
+
+		//descend into lists
+		if(memcmp(rh->c_id, "LIST", 4) == 0  ||  memcmp(rh->c_id, "RIFF", 4) == 0  ||  memcmp(rh->c_id, "BW64", 4) == 0){
+			int level = rh->ls_level;
+			r = riff_seekLevelSub(rh);
+			if(rh->ls_level > level  &&  stats_add(stats, rh->ls[level].c_type, 1, rh->ls[level].c_size, depth) != RIFF_ERROR_NONE)
+				return RIFF_ERROR_MEMORY;
+			if(r == RIFF_ERROR_NONE)
+				continue;
+			//an empty list has no first chunk to read, anything else is an error
+			if(rh->ls_level == level  ||  rh->ls[level].c_size > 4)
+				return r;
+			riff_levelParent(rh);
+		}
+
+		//seek to the next chunk, go up a level for every finished list
+		while((r = riff_seekNextChunk(rh)) != RIFF_ERROR_NONE){
+			if(r >= RIFF_ERROR_CRITICAL)
+				return r;
+			if(rh->ls_level == 0)
+				return RIFF_ERROR_NONE;
+			riff_levelParent(rh);
+		}
+	}
+}
+
+/*****************************************************************************/
+//description: see header file
+const struct riff_statsEntry *riff_statsFind(const struct riff_stats *stats, const char *id, int list){
+	if(stats == NULL  ||  id == NULL  ||  stats->index == NULL)
+		return NULL;
+	list = list != 0;
+	size_t s = stats_slot(stats, id, list);
+	int32_t i;
+	while((i = stats->index[s]) >= 0){
+		if(stats->entries[i].list == list  &&  memcmp(stats->entries[i].id, id, 4) == 0)
+			return stats->entries + i;
+		s = (s + 1) & (stats->index_size - 1);
+	}
+	return NULL;
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_statsFree(struct riff_stats *stats){
+	if(stats == NULL)
+		return;
+	free(stats->entries);
+	free(stats->index);
+	memset(stats, 0, sizeof(struct riff_stats));
+}
@@ -0,0 +1,504 @@
+// Writing RIFF files and copying chunks from a riff_handle to a riff_writer
+//
+// The writer keeps a stack of open chunks, their size fields are patched when they are ended.
+// Chunk copies stay inside the kernel if both sides are files, see copy_offload().
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //copy_file_range()
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define RIFF_FD 1
+#endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+
+#define RIFF_WRITER_LEVEL_ALLOC 16  //number of stack elements allocated per step
+#define RIFF_COPY_BUFFER_SIZE (1 << 20)  //buffer size for copies through user space
+
+#define checkValidRiffWriter(rw) if (rw == NULL  ||  rw->fp_write == NULL) return RIFF_ERROR_INVALID_HANDLE
+
+
+//** FILE **
+
+
+/*****************************************************************************/
+size_t write_file(riff_writer *rw, const void *ptr, size_t size){
+	return fwrite(ptr, 1, size, (FILE*)(rw->fh));
+}
+
+/*****************************************************************************/
+size_t wseek_file(riff_writer *rw, size_t pos){
+	fseek((FILE*)(rw->fh), pos, SEEK_SET);
+	return pos;
+}
+
+#if RIFF_FD
+/*****************************************************************************/
+int wfd_file(riff_writer *rw){
+	fflush((FILE*)(rw->fh)); //data written by the kernel must go after buffered data
+	return fileno((FILE*)(rw->fh));
+}
+#endif
+
+/*****************************************************************************/
+//description: see header file
+int riff_writer_open_file(riff_writer *rw, FILE *f){
+	if(rw == NULL  ||  f == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	rw->fh = f;
+	rw->pos = ftell(f);
+
+	rw->fp_write = &write_file;
+	rw->fp_seek = &wseek_file;
+#if RIFF_FD
+	rw->fp_fd = &wfd_file;
+#endif
+	return RIFF_ERROR_NONE;
+}
+
+
+//** file descriptor **
+
+
+#if RIFF_FD
+/*****************************************************************************/
+size_t write_fd(riff_writer *rw, const void *ptr, size_t size){
+	int fd = (int)(intptr_t)rw->fh;
+	size_t done = 0;
+	while(done < size){
+		ssize_t n = write(fd, (const uint8_t *)ptr + done, size - done);
+		if(n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+/*****************************************************************************/
+size_t wseek_fd(riff_writer *rw, size_t pos){
+	lseek((int)(intptr_t)rw->fh, pos, SEEK_SET);
+	return pos;
+}
+
+/*****************************************************************************/
+int wfd_fd(riff_writer *rw){
+	return (int)(intptr_t)rw->fh;
+}
+#endif
+
+/*****************************************************************************/
+//description: see header file
+int riff_writer_open_fd(riff_writer *rw, int fd){
+#if RIFF_FD
+	if(rw == NULL  ||  fd < 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	if(pos < 0)
+		return RIFF_ERROR_ACCESS;
+	rw->fh = (void *)(intptr_t)fd;
+	rw->pos = pos;
+
+	rw->fp_write = &write_fd;
+	rw->fp_seek = &wseek_fd;
+	rw->fp_fd = &wfd_fd;
+	return RIFF_ERROR_NONE;
+#else
+	return RIFF_ERROR_INVALID_HANDLE;
+#endif
+}
+
+
+
+// **** internal ****
+
+
+
+/*****************************************************************************/
+//write via FP, keep track of position
+int writer_write(riff_writer *rw, const void *ptr, size_t size){
+	size_t n = rw->fp_write(rw, ptr, size);
+	rw->pos += n;
+	rw->bytes_written += n;
+	return n == size ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+}
+
+/*****************************************************************************/
+//write at absolute position
+int riff_writeAt(riff_writer *rw, size_t pos, const void *ptr, size_t size){
+	rw->fp_seek(rw, pos);
+	rw->pos = pos;
+	return writer_write(rw, ptr, size);
+}
+
+/*****************************************************************************/
+//write chunk header
+int writer_header(riff_writer *rw, const char *id, size_t size){
+	uint8_t buf[8];
+	memcpy(buf, id, 4);
+	buf[4] = size & 0xFF;
+	buf[5] = (size >> 8) & 0xFF;
+	buf[6] = (size >> 16) & 0xFF;
+	buf[7] = (size >> 24) & 0xFF;
+	return writer_write(rw, buf, 8);
+}
+
+/*****************************************************************************/
+//write pad byte if size is odd
+int writer_pad(riff_writer *rw, size_t size){
+	if(size & 1)
+		return writer_write(rw, "", 1);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//push open chunk to stack
+int writer_push(riff_writer *rw, const char *id){
+	if(rw->ls_level >= (int)rw->ls_size){
+		size_t sizenew = rw->ls_size + RIFF_WRITER_LEVEL_ALLOC;
+		struct riff_writerStackE *lsnew = realloc(rw->ls, sizenew * sizeof(struct riff_writerStackE));
+		if(lsnew == NULL)
+			return RIFF_ERROR_MEMORY;
+		rw->ls = lsnew;
+		rw->ls_size = sizenew;
+	}
+	struct riff_writerStackE *ls = rw->ls + rw->ls_level;
+	ls->c_pos_start = rw->pos;
+	memcpy(ls->c_id, id, 4);
+	ls->c_id[4] = 0;
+	rw->ls_level++;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//write the current sizes of all open chunks, innermost first, so the file is valid up to the position
+int writer_commit(riff_writer *rw){
+	int r = RIFF_ERROR_NONE;
+	size_t end = rw->pos;
+	//buffered data must be in the file before the sizes covering it
+	if(rw->ls_level > 0  &&  rw->fp_fd != NULL  &&  rw->fp_fd(rw) < 0)
+		r = RIFF_ERROR_ACCESS;
+
+	//an odd size would need a pad byte in every parent, the last data byte is left for the next commit instead
+	size_t committed = end;
+	if(rw->ls_level > 0)
+		committed -= (end - rw->ls[0].c_pos_start) & 1;
+	//a list without subchunks isn't readable, the commit ends before the outermost empty one
+	int i, level = rw->ls_level;
+	for(i = 0; i < rw->ls_level; i++){
+		struct riff_writerStackE *ls = rw->ls + i;
+		if(committed == ls->c_pos_start + RIFF_CHUNK_DATA_OFFSET + 4  &&  (memcmp(ls->c_id, "LIST", 4) == 0
+			||  memcmp(ls->c_id, "RIFF", 4) == 0  ||  memcmp(ls->c_id, "BW64", 4) == 0)){
+			committed = ls->c_pos_start;
+			level = i;
+			break;
+		}
+	}
+	for(i = level - 1; i >= 0  &&  r == RIFF_ERROR_NONE; i--){
+		struct riff_writerStackE *ls = rw->ls + i;
+		size_t size = committed - (ls->c_pos_start + RIFF_CHUNK_DATA_OFFSET);
+		if(size > 0xFFFFFFFF){
+			r = RIFF_ERROR_ICSIZE;
+			break;
+		}
+		uint8_t buf[4];
+		buf[0] = size & 0xFF;
+		buf[1] = (size >> 8) & 0xFF;
+		buf[2] = (size >> 16) & 0xFF;
+		buf[3] = (size >> 24) & 0xFF;
+		//not counted in riff_writer::bytes_written, not new data
+		rw->fp_seek(rw, ls->c_pos_start + 4);
+		if(rw->fp_write(rw, buf, 4) != 4)
+			r = RIFF_ERROR_ACCESS;
+	}
+	rw->fp_seek(rw, end);
+	rw->pos = end;
+	//sizes patched in a buffer are written, too
+	if(rw->ls_level > 0  &&  rw->fp_fd != NULL  &&  rw->fp_fd(rw) < 0  &&  r == RIFF_ERROR_NONE)
+		r = RIFF_ERROR_ACCESS;
+
+	rw->commit_pos = committed;
+	rw->commit_time = riff_clockNs();
+	if(r == RIFF_ERROR_NONE)
+		rw->commits++;
+	return r;
+}
+
+/*****************************************************************************/
+//commit if an interval of riff_writerSetCommit() has passed, returns r if there is nothing else to report
+int writer_tick(riff_writer *rw, int r){
+	if(r != RIFF_ERROR_NONE  ||  (rw->commit_bytes == 0  &&  rw->commit_ns == 0))
+		return r;
+	if((rw->commit_bytes > 0  &&  rw->pos >= rw->commit_pos + rw->commit_bytes)
+		||  (rw->commit_ns > 0  &&  riff_clockNs() - rw->commit_time >= rw->commit_ns))
+		return writer_commit(rw);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//copy stream data inside the kernel, returns the amount of bytes copied
+//may copy less than requested (or nothing), the caller copies the rest through user space
+size_t copy_offload(riff_handle *rh, size_t pos, size_t size, riff_writer *rw){
+#if defined(__linux__)
+	int in = rh->fp_fd != NULL ? rh->fp_fd(rh) : -1;
+	int out = rw->fp_fd != NULL ? rw->fp_fd(rw) : -1;
+	if(in < 0  ||  out < 0)
+		return 0;
+
+	loff_t off_in = pos, off_out = rw->pos;
+	size_t done = 0;
+	while(done < size){
+		ssize_t n = copy_file_range(in, &off_in, out, &off_out, size - done, 0);
+		if(n <= 0)
+			break; //e.g. EXDEV or ENOSYS on older kernels
+		done += n;
+	}
+	//sendfile() writes at the current offset of the output
+	if(done < size  &&  lseek(out, off_out, SEEK_SET) == (off_t)off_out){
+		off_t off = off_in;
+		while(done < size){
+			ssize_t n = sendfile(out, in, &off, size - done);
+			if(n <= 0)
+				break;
+			done += n;
+		}
+	}
+
+	rw->pos += done;
+	rw->bytes_written += done;
+	rw->bytes_offloaded += done;
+	rw->fp_seek(rw, rw->pos); //sync the output stream with the new end
+	return done;
+#else
+	(void)rh; (void)pos; (void)size; (void)rw;
+	return 0;
+#endif
+}
+
+/*****************************************************************************/
+//copy stream data of the reader to the writer
+int copy_range(riff_handle *rh, size_t pos, size_t size, riff_writer *rw){
+	size_t n = copy_offload(rh, pos, size, rw);
+	pos += n;
+	size -= n;
+	if(size == 0)
+		return RIFF_ERROR_NONE;
+
+	//directly from memory
+	const void *p = rh->fp_map != NULL ? rh->fp_map(rh, pos, size) : NULL;
+	if(p != NULL)
+		return writer_write(rw, p, size);
+
+	uint8_t *buf = malloc(size < RIFF_COPY_BUFFER_SIZE ? size : RIFF_COPY_BUFFER_SIZE);
+	if(buf == NULL)
+		return RIFF_ERROR_MEMORY;
+	int r = RIFF_ERROR_NONE;
+	rh->pos = pos;
+	riff_ioSeek(rh, pos);
+	while(size > 0){
+		size_t len = size < RIFF_COPY_BUFFER_SIZE ? size : RIFF_COPY_BUFFER_SIZE;
+		n = riff_ioRead(rh, buf, len, 1);
+		rh->pos += n;
+		if(n != len){
+			r = RIFF_ERROR_EOF;
+			break;
+		}
+		if((r = writer_write(rw, buf, len)) != RIFF_ERROR_NONE)
+			break;
+		size -= len;
+	}
+	free(buf);
+	return r;
+}
+
+
+//**** user access ****
+
+
+/*****************************************************************************/
+//description: see header file
+riff_writer *riff_writerAllocate(){
+	return calloc(1, sizeof(riff_writer));
+}
+
+/*****************************************************************************/
+//description: see header file
+void riff_writerFree(riff_writer *rw){
+	if(rw == NULL)
+		return;
+	//release output resources of the open function
+	if(rw->fp_close != NULL)
+		rw->fp_close(rw);
+	free(rw->ls);
+	free(rw);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeChunkStart(riff_writer *rw, const char *id){
+	checkValidRiffWriter(rw);
+	int r = writer_push(rw, id);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	return writer_tick(rw, writer_header(rw, id, 0)); //size is patched by riff_writeChunkEnd()
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeListStart(riff_writer *rw, const char *id, const char *type){
+	checkValidRiffWriter(rw);
+	int r = writer_push(rw, id);
+	if(r != RIFF_ERROR_NONE)
+		return r;
+	if((r = writer_header(rw, id, 0)) != RIFF_ERROR_NONE)
+		return r;
+	return writer_tick(rw, writer_write(rw, type, 4)); //no commit before the type is written
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeData(riff_writer *rw, const void *ptr, size_t size){
+	checkValidRiffWriter(rw);
+	return writer_tick(rw, writer_write(rw, ptr, size));
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeChunkEnd(riff_writer *rw){
+	checkValidRiffWriter(rw);
+	if(rw->ls_level <= 0)
+		return RIFF_ERROR_EOCL;
+
+	struct riff_writerStackE *ls = rw->ls + (rw->ls_level - 1);
+	size_t size = rw->pos - (ls->c_pos_start + RIFF_CHUNK_DATA_OFFSET);
+	if(size > 0xFFFFFFFF)
+		return RIFF_ERROR_ICSIZE;
+
+	//patch size field, return to the end
+	size_t end = rw->pos;
+	rw->fp_seek(rw, ls->c_pos_start);
+	rw->pos = ls->c_pos_start;
+	int r = writer_header(rw, ls->c_id, size);
+	rw->bytes_written -= 8; //not new data
+	rw->fp_seek(rw, end);
+	rw->pos = end;
+	if(r != RIFF_ERROR_NONE)
+		return r;
+
+	rw->ls_level--;
+	r = writer_pad(rw, size);
+	//a committed chunk now ends behind the committed sizes of its parents, they must follow at once
+	if(r == RIFF_ERROR_NONE  &&  (rw->commit_bytes > 0  ||  rw->commit_ns > 0)  &&  ls->c_pos_start < rw->commit_pos)
+		return writer_commit(rw);
+	return writer_tick(rw, r);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeChunk(riff_writer *rw, const char *id, const void *ptr, size_t size){
+	checkValidRiffWriter(rw);
+	if(size > 0xFFFFFFFF)
+		return RIFF_ERROR_ICSIZE;
+	int r;
+	if((r = writer_header(rw, id, size)) != RIFF_ERROR_NONE)
+		return r;
+	if((r = writer_write(rw, ptr, size)) != RIFF_ERROR_NONE)
+		return r;
+	return writer_tick(rw, writer_pad(rw, size));
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeFinish(riff_writer *rw){
+	checkValidRiffWriter(rw);
+	int r;
+	while(rw->ls_level > 0)
+		if((r = riff_writeChunkEnd(rw)) != RIFF_ERROR_NONE)
+			return r;
+	if(rw->fp_flush != NULL)
+		return rw->fp_flush(rw);
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writerSetCommit(riff_writer *rw, size_t bytes, uint32_t ms){
+	checkValidRiffWriter(rw);
+	rw->commit_bytes = bytes;
+	rw->commit_ns = (uint64_t)ms * 1000000;
+	rw->commit_pos = rw->pos;
+	rw->commit_time = riff_clockNs();
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_writeCommit(riff_writer *rw){
+	checkValidRiffWriter(rw);
+	return writer_commit(rw);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_copyChunk(riff_handle *rh, riff_writer *rw){
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	checkValidRiffWriter(rw);
+
+	int r;
+	if((r = writer_header(rw, rh->c_id, rh->c_size)) != RIFF_ERROR_NONE)
+		return r;
+	if((r = copy_range(rh, rh->c_pos_start + RIFF_CHUNK_DATA_OFFSET, rh->c_size, rw)) != RIFF_ERROR_NONE)
+		return r;
+	if((r = writer_tick(rw, writer_pad(rw, rh->c_size))) != RIFF_ERROR_NONE)
+		return r;
+	return riff_seekInChunk(rh, rh->c_size);
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_copySubtree(riff_handle *rh, riff_writer *rw, int (*filter)(riff_handle *rh, void *user), void *user){
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	checkValidRiffWriter(rw);
+
+	int list = memcmp(rh->c_id, "LIST", 4) == 0  ||  memcmp(rh->c_id, "RIFF", 4) == 0  ||  memcmp(rh->c_id, "BW64", 4) == 0;
+	if(filter == NULL  ||  !list  ||  rh->c_size < 4)
+		return riff_copyChunk(rh, rw);
+
+	//read type, empty lists have no subchunks to enter
+	char type[4];
+	int r;
+	riff_seekChunkStart(rh);
+	if(riff_readInChunk(rh, type, 4) != 4)
+		return RIFF_ERROR_EOF;
+	if((r = riff_writeListStart(rw, rh->c_id, type)) != RIFF_ERROR_NONE)
+		return r;
+
+	if(rh->c_size > 4){
+		r = riff_seekLevelSub(rh);
+		while(r == RIFF_ERROR_NONE){
+			if(filter(rh, user)  &&  (r = riff_copySubtree(rh, rw, filter, user)) != RIFF_ERROR_NONE)
+				return r;
+			r = riff_seekNextChunk(rh);
+		}
+		if(r >= RIFF_ERROR_CRITICAL)
+			return r;
+		riff_levelParent(rh);
+	}
+
+	if((r = riff_writeChunkEnd(rw)) != RIFF_ERROR_NONE)
+		return r;
+	return riff_seekInChunk(rh, rh->c_size);
+}
@@ -0,0 +1,467 @@
+// Seekable zstd archives: read backend and compressor
+//
+// Uses the zstd seekable format: independent zstd frames, followed by a skippable frame with a seek table
+// of the compressed and decompressed size of every frame (plus optional checksums), so a position maps to a frame directly.
+// The reader decompresses only the frames it touches and keeps the last few in a small cache.
+// The compressor puts frame boundaries at chunk edges, chunks larger than a frame are split.
+//
+// Only built with zstd if RIFF_ZSTD is defined (CMake option RIFF_ZSTD), stubs return RIFF_ERROR_ACCESS otherwise.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+#include "riff_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/stat.h>
+#define RIFF_FD 1
+#endif
+
+#if RIFF_ZSTD  &&  RIFF_FD
+#include <zstd.h>
+
+#if RIFF_THREADS
+#include <pthread.h>
+#define ZSTD_LOCK(z) pthread_mutex_lock(&(z)->lock)
+#define ZSTD_UNLOCK(z) pthread_mutex_unlock(&(z)->lock)
+#else
+#define ZSTD_LOCK(z)
+#define ZSTD_UNLOCK(z)
+#endif
+
+
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A5E  //skippable frame holding the seek table
+#define ZSTD_SEEKABLE_MAGIC		0x8F92EAB1  //last 4 bytes of the seek table footer
+#define ZSTD_FOOTER_SIZE		9           //frame count, descriptor, magic
+#define ZSTD_CHECKSUM_FLAG		0x80        //descriptor: entries contain checksums
+#define ZSTD_MAX_FRAME_SIZE		0x40000000  //decompressed frame size limit of the format is 4 GiB, we stay well below
+
+
+//decompressed frame in the cache
+struct zstd_slot {
+	uint8_t *data;
+	uint32_t frame;
+	unsigned tick;   //last use, the oldest slot is reused
+	int used;
+};
+
+struct riff_zstd {
+#if RIFF_THREADS
+	pthread_mutex_t lock;
+#endif
+	int fd;
+	size_t base;       //start of the archive in the file
+	uint32_t frames;
+	uint64_t *cpos;    //compressed start of each frame relative to base, frames + 1 entries
+	uint64_t *dpos;    //decompressed start of each frame, frames + 1 entries
+	uint32_t *check;   //lower 32 bits of XXH64 of each frame, NULL if the archive has no checksums
+	size_t max_csize;
+	size_t max_dsize;
+	uint8_t *cbuf;     //compressed frame
+	ZSTD_DCtx *dctx;
+	struct zstd_slot *slots;
+	int nslots;
+	unsigned tick;
+};
+
+
+/*****************************************************************************/
+void zstd_le32(uint8_t *p, uint32_t v){
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************/
+void zstd_free(struct riff_zstd *z){
+	int i;
+	if(z->slots != NULL){
+		for(i = 0; i < z->nslots; i++)
+			free(z->slots[i].data);
+		free(z->slots);
+	}
+	if(z->dctx != NULL)
+		ZSTD_freeDCtx(z->dctx);
+	free(z->cbuf);
+	free(z->cpos);
+	free(z->dpos);
+	free(z->check);
+	free(z);
+}
+
+/*****************************************************************************/
+//find frame containing decompressed position pos, pos must be below the total size
+uint32_t zstd_frameAt(const struct riff_zstd *z, size_t pos){
+	uint32_t lo = 0, hi = z->frames - 1;
+	while(lo < hi){
+		uint32_t mid = lo + (hi - lo + 1) / 2;
+		if(z->dpos[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/*****************************************************************************/
+//get decompressed frame from the cache or decompress it into the least recently used slot, must be locked
+//returns NULL if the frame can't be read or is corrupt
+const uint8_t *zstd_frame(struct riff_zstd *z, uint32_t f){
+	struct zstd_slot *s = NULL;
+	int i;
+	for(i = 0; i < z->nslots; i++){
+		if(z->slots[i].used  &&  z->slots[i].frame == f){
+			z->slots[i].tick = ++z->tick;
+			return z->slots[i].data;
+		}
+		if(s == NULL  ||  !z->slots[i].used  ||  (s->used  &&  z->slots[i].tick < s->tick))
+			s = z->slots + i;
+	}
+
+	if(s->data == NULL  &&  (s->data = malloc(z->max_dsize)) == NULL)
+		return NULL;
+	s->used = 0;
+	size_t csize = z->cpos[f + 1] - z->cpos[f];
+	size_t dsize = z->dpos[f + 1] - z->dpos[f];
+	if(riff_readAtFd(z->fd, z->cbuf, csize, z->base + z->cpos[f]) != csize)
+		return NULL;
+	size_t n = ZSTD_decompressDCtx(z->dctx, s->data, dsize, z->cbuf, csize);
+	if(ZSTD_isError(n)  ||  n != dsize)
+		return NULL;
+	if(z->check != NULL  &&  (uint32_t)riff_hashBuffer(RIFF_HASH_XXH64, s->data, dsize) != z->check[f])
+		return NULL;
+	s->frame = f;
+	s->tick = ++z->tick;
+	s->used = 1;
+	return s->data;
+}
+
+
+//** archive backend **
+
+
+/*****************************************************************************/
+size_t readAt_zstd(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	struct riff_zstd *z = (struct riff_zstd *)rh->fh;
+	size_t done = 0;
+	ZSTD_LOCK(z);
+	while(done < size  &&  pos < z->dpos[z->frames]){
+		uint32_t f = zstd_frameAt(z, pos);
+		const uint8_t *data = zstd_frame(z, f);
+		if(data == NULL)
+			break; //short read, reported by the caller
+		size_t off = pos - z->dpos[f];
+		size_t n = z->dpos[f + 1] - pos;
+		if(n > size - done)
+			n = size - done;
+		memcpy((uint8_t *)ptr + done, data + off, n);
+		done += n;
+		pos += n;
+	}
+	ZSTD_UNLOCK(z);
+	return done;
+}
+
+/*****************************************************************************/
+size_t read_zstd(riff_handle *rh, void *ptr, size_t size){
+	return readAt_zstd(rh, ptr, size, rh->pos);
+}
+
+/*****************************************************************************/
+size_t seek_zstd(riff_handle *rh, size_t pos){
+	(void)rh;
+	return pos; //every read passes its position
+}
+
+/*****************************************************************************/
+void close_zstd(riff_handle *rh){
+	struct riff_zstd *z = (struct riff_zstd *)rh->fh;
+#if RIFF_THREADS
+	pthread_mutex_destroy(&z->lock);
+#endif
+	zstd_free(z);
+	rh->fh = NULL;
+}
+
+/*****************************************************************************/
+//read the seek table at the end of the file
+int zstd_readTable(struct riff_zstd *z){
+	struct stat st;
+	if(fstat(z->fd, &st) != 0)
+		return RIFF_ERROR_ACCESS;
+	size_t end = st.st_size;
+	if(end < z->base + 8 + ZSTD_FOOTER_SIZE)
+		return RIFF_ERROR_EOF;
+
+	uint8_t foot[ZSTD_FOOTER_SIZE];
+	if(riff_readAtFd(z->fd, foot, ZSTD_FOOTER_SIZE, end - ZSTD_FOOTER_SIZE) != ZSTD_FOOTER_SIZE)
+		return RIFF_ERROR_EOF;
+	if(convUInt32LE(foot + 5) != ZSTD_SEEKABLE_MAGIC  ||  (foot[4] & 0x7F) != 0)
+		return RIFF_ERROR_ILLID; //not a seekable archive or reserved bits set
+	z->frames = convUInt32LE(foot);
+	size_t esize = (foot[4] & ZSTD_CHECKSUM_FLAG) ? 12 : 8;
+	if(z->frames == 0  ||  z->frames > (end - z->base) / esize)
+		return RIFF_ERROR_ICSIZE;
+	size_t tsize = z->frames * esize;
+	if(z->base + 8 + tsize + ZSTD_FOOTER_SIZE > end)
+		return RIFF_ERROR_ICSIZE;
+	size_t tpos = end - ZSTD_FOOTER_SIZE - tsize; //entries start
+
+	uint8_t head[8];
+	if(riff_readAtFd(z->fd, head, 8, tpos - 8) != 8)
+		return RIFF_ERROR_EOF;
+	if(convUInt32LE(head) != ZSTD_SKIPPABLE_MAGIC  ||  convUInt32LE(head + 4) != tsize + ZSTD_FOOTER_SIZE)
+		return RIFF_ERROR_ILLID;
+
+	uint8_t *table = malloc(tsize);
+	z->cpos = malloc((z->frames + 1) * sizeof(uint64_t));
+	z->dpos = malloc((z->frames + 1) * sizeof(uint64_t));
+	if(esize == 12)
+		z->check = malloc(z->frames * sizeof(uint32_t));
+	if(table == NULL  ||  z->cpos == NULL  ||  z->dpos == NULL  ||  (esize == 12  &&  z->check == NULL)){
+		free(table);
+		return RIFF_ERROR_MEMORY;
+	}
+	if(riff_readAtFd(z->fd, table, tsize, tpos) != tsize){
+		free(table);
+		return RIFF_ERROR_EOF;
+	}
+
+	z->cpos[0] = 0;
+	z->dpos[0] = 0;
+	uint32_t i;
+	for(i = 0; i < z->frames; i++){
+		const uint8_t *e = table + i * esize;
+		size_t csize = convUInt32LE(e);
+		size_t dsize = convUInt32LE(e + 4);
+		if(esize == 12)
+			z->check[i] = convUInt32LE(e + 8);
+		z->cpos[i + 1] = z->cpos[i] + csize;
+		z->dpos[i + 1] = z->dpos[i] + dsize;
+		if(csize > z->max_csize)
+			z->max_csize = csize;
+		if(dsize > z->max_dsize)
+			z->max_dsize = dsize;
+	}
+	free(table);
+
+	//frames must end where the seek table starts
+	if(z->base + z->cpos[z->frames] != tpos - 8  ||  z->max_dsize == 0)
+		return RIFF_ERROR_ICSIZE;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_open_zstd(riff_handle *rh, int fd, int cache){
+	if(rh == NULL  ||  fd < 0)
+		return RIFF_ERROR_INVALID_HANDLE;
+	riff_handleClose(rh);
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	if(pos < 0)
+		return RIFF_ERROR_ACCESS;
+	if(cache <= 0)
+		cache = RIFF_ZSTD_CACHE_FRAMES;
+
+	struct riff_zstd *z = calloc(1, sizeof(struct riff_zstd));
+	if(z == NULL)
+		return RIFF_ERROR_MEMORY;
+	z->fd = fd;
+	z->base = pos;
+	int r = zstd_readTable(z);
+	if(r != RIFF_ERROR_NONE){
+		zstd_free(z);
+		return r;
+	}
+	z->nslots = cache;
+	z->slots = calloc(cache, sizeof(struct zstd_slot)); //frame data is allocated on first use
+	z->cbuf = malloc(z->max_csize);
+	z->dctx = ZSTD_createDCtx();
+	if(z->slots == NULL  ||  z->cbuf == NULL  ||  z->dctx == NULL){
+		zstd_free(z);
+		return RIFF_ERROR_MEMORY;
+	}
+#if RIFF_THREADS
+	pthread_mutex_init(&z->lock, NULL);
+#endif
+
+	rh->fh = z;
+	rh->size = z->dpos[z->frames];
+	rh->pos_start = 0;
+	rh->pos = 0;
+
+	rh->fp_read = &read_zstd;
+	rh->fp_seek = &seek_zstd;
+	rh->fp_readAt = &readAt_zstd;
+	rh->fp_close = &close_zstd;
+
+	return riff_readHeader(rh);
+}
+
+
+//** compressor **
+
+
+/*****************************************************************************/
+//read source bytes at absolute position pos
+size_t zstd_readSource(riff_handle *rh, void *ptr, size_t size, size_t pos){
+	if(rh->fp_readAt != NULL){
+		size_t n = rh->fp_readAt(rh, ptr, size, pos);
+		rh->io.reads++;
+		rh->io.bytes_read += n;
+		rh->io.bytes_payload += n;
+		return n;
+	}
+	rh->pos = pos;
+	riff_ioSeek(rh, pos);
+	size_t n = riff_ioRead(rh, ptr, size, 1);
+	rh->pos += n;
+	return n;
+}
+
+//compressor state
+struct zstd_out {
+	riff_handle *rh;
+	riff_writer *rw;
+	ZSTD_CCtx *cctx;
+	int level;
+	uint8_t *src;
+	uint8_t *dst;
+	size_t dst_size;
+	uint8_t *table;     //seek table entries
+	size_t table_size;  //allocated entries
+	uint32_t frames;
+};
+
+/*****************************************************************************/
+//compress source range [start, end) relative to the RIFF start into one frame
+int zstd_writeFrame(struct zstd_out *o, size_t start, size_t end){
+	size_t size = end - start;
+	if(zstd_readSource(o->rh, o->src, size, o->rh->pos_start + start) != size)
+		return riff_report(o->rh, RIFF_ERROR_EOF, RIFF_DIAG_CHUNK_DATA_SHORT, o->rh->pos_start + start, NULL, size, 0);
+	size_t n = ZSTD_compressCCtx(o->cctx, o->dst, o->dst_size, o->src, size, o->level);
+	if(ZSTD_isError(n))
+		return RIFF_ERROR_MEMORY;
+
+	if(o->frames == o->table_size){
+		size_t sizenew = o->table_size * 2 + 64;
+		uint8_t *tnew = realloc(o->table, sizenew * 12);
+		if(tnew == NULL)
+			return RIFF_ERROR_MEMORY;
+		o->table = tnew;
+		o->table_size = sizenew;
+	}
+	uint8_t *e = o->table + o->frames * 12;
+	zstd_le32(e, n);
+	zstd_le32(e + 4, size);
+	zstd_le32(e + 8, (uint32_t)riff_hashBuffer(RIFF_HASH_XXH64, o->src, size));
+	o->frames++;
+	return riff_writeAt(o->rw, o->rw->pos, o->dst, n);
+}
+
+/*****************************************************************************/
+//cut frames at chunk edges up to boundary b, frames are cut inside a chunk only if it doesn't fit into one frame
+//start: begin of the current frame, edge: last chunk edge seen after start
+int zstd_cut(struct zstd_out *o, size_t frame_size, size_t *start, size_t *edge, size_t b){
+	int r;
+	while(b - *start > frame_size){
+		size_t cut = *edge > *start ? *edge : *start + frame_size;
+		if((r = zstd_writeFrame(o, *start, cut)) != RIFF_ERROR_NONE)
+			return r;
+		*start = cut;
+	}
+	*edge = b;
+	return RIFF_ERROR_NONE;
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_zstdCompress(riff_handle *rh, riff_writer *rw, int level, size_t frame_size){
+	if(rh == NULL  ||  rw == NULL  ||  rw->fp_write == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	if(frame_size == 0)
+		frame_size = RIFF_ZSTD_FRAME_SIZE;
+	if(frame_size > ZSTD_MAX_FRAME_SIZE)
+		frame_size = ZSTD_MAX_FRAME_SIZE;
+
+	//chunk edges
+	struct riff_tree tree = {0};
+	int r = riff_parseTree(rh, &tree);
+	if(r != RIFF_ERROR_NONE){
+		riff_treeFree(&tree);
+		return r;
+	}
+
+	struct zstd_out o;
+	memset(&o, 0, sizeof(o));
+	o.rh = rh;
+	o.rw = rw;
+	o.level = level;
+	o.cctx = ZSTD_createCCtx();
+	o.src = malloc(frame_size);
+	o.dst_size = ZSTD_compressBound(frame_size);
+	o.dst = malloc(o.dst_size);
+	if(o.cctx == NULL  ||  o.src == NULL  ||  o.dst == NULL)
+		r = RIFF_ERROR_MEMORY;
+
+	//tree nodes are in file order, node 0 is the RIFF header at 0
+	size_t start = 0, edge = 0;
+	int32_t i;
+	for(i = 1; i < tree.count  &&  r == RIFF_ERROR_NONE; i++)
+		r = zstd_cut(&o, frame_size, &start, &edge, tree.nodes[i].c_pos_start - rh->pos_start);
+	size_t end = RIFF_CHUNK_DATA_OFFSET + rh->h_size;
+	if(r == RIFF_ERROR_NONE)
+		r = zstd_cut(&o, frame_size, &start, &edge, end);
+	if(r == RIFF_ERROR_NONE  &&  end > start)
+		r = zstd_writeFrame(&o, start, end);
+
+	//seek table in a skippable frame
+	if(r == RIFF_ERROR_NONE){
+		uint8_t buf[ZSTD_FOOTER_SIZE];
+		size_t tsize = o.frames * 12;
+		zstd_le32(buf, ZSTD_SKIPPABLE_MAGIC);
+		zstd_le32(buf + 4, tsize + ZSTD_FOOTER_SIZE);
+		r = riff_writeAt(rw, rw->pos, buf, 8);
+		if(r == RIFF_ERROR_NONE  &&  tsize > 0)
+			r = riff_writeAt(rw, rw->pos, o.table, tsize);
+		zstd_le32(buf, o.frames);
+		buf[4] = ZSTD_CHECKSUM_FLAG;
+		zstd_le32(buf + 5, ZSTD_SEEKABLE_MAGIC);
+		if(r == RIFF_ERROR_NONE)
+			r = riff_writeAt(rw, rw->pos, buf, ZSTD_FOOTER_SIZE);
+	}
+
+	if(o.cctx != NULL)
+		ZSTD_freeCCtx(o.cctx);
+	free(o.src);
+	free(o.dst);
+	free(o.table);
+	riff_treeFree(&tree);
+	return r;
+}
+
+#else
+
+/*****************************************************************************/
+//description: see header file
+int riff_open_zstd(riff_handle *rh, int fd, int cache){
+	(void)fd; (void)cache;
+	if(rh == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	return RIFF_ERROR_ACCESS; //built without zstd
+}
+
+/*****************************************************************************/
+//description: see header file
+int riff_zstdCompress(riff_handle *rh, riff_writer *rw, int level, size_t frame_size){
+	(void)level; (void)frame_size;
+	if(rh == NULL  ||  rw == NULL)
+		return RIFF_ERROR_INVALID_HANDLE;
+	return RIFF_ERROR_ACCESS; //built without zstd
+}
+
+#endif
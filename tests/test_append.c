@@ -0,0 +1,193 @@
+// Test of the appender with several producer threads
+//
+// Every thread appends its own numbered chunks to one list, some written by riff_appendChunk() and some reserved by riff_appendReserve()
+// and written by the thread itself. The file must validate, and every chunk must be there exactly once with its own data.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "riff.h"
+
+
+#define THREADS 8
+#define CHUNKS 3000     //chunks per thread
+#define MAX_SIZE 64
+
+
+struct producer {
+	struct riff_appender *ap;
+	int fd;
+	int t;
+	int err;
+	pthread_t thread;
+};
+
+
+/*****************************************************************************/
+//size of chunk i of thread t, odd sizes get a pad byte
+size_t chunk_size(int t, int i){
+	return 4 + (i * 7 + t) % (MAX_SIZE - 4);
+}
+
+/*****************************************************************************/
+//data of chunk i of thread t, starts with the index
+void chunk_data(int t, int i, uint8_t *buf){
+	size_t k, size = chunk_size(t, i);
+	buf[0] = i & 0xFF;
+	buf[1] = (i >> 8) & 0xFF;
+	buf[2] = (i >> 16) & 0xFF;
+	buf[3] = (i >> 24) & 0xFF;
+	for(k = 4; k < size; k++)
+		buf[k] = (uint8_t)(t * 31 + i + k);
+}
+
+/*****************************************************************************/
+void *produce(void *arg){
+	struct producer *p = (struct producer *)arg;
+	uint8_t buf[MAX_SIZE];
+	char id[5];
+	int i;
+	snprintf(id, sizeof(id), "t%03d", p->t);
+	for(i = 0; i < CHUNKS  &&  p->err == RIFF_ERROR_NONE; i++){
+		size_t size = chunk_size(p->t, i);
+		chunk_data(p->t, i, buf);
+		if(i % 4 == 3){
+			size_t pos;
+			p->err = riff_appendReserve(p->ap, id, size, &pos);
+			if(p->err == RIFF_ERROR_NONE  &&  pwrite(p->fd, buf, size, pos) != (ssize_t)size)
+				p->err = RIFF_ERROR_ACCESS;
+		}
+		else
+			p->err = riff_appendChunk(p->ap, id, buf, size);
+	}
+	return NULL;
+}
+
+
+/*****************************************************************************/
+//check every chunk of the list, returns the amount of wrong or missing chunks
+int check(riff_handle *rh){
+	static uint8_t seen[THREADS][CHUNKS];
+	uint8_t buf[MAX_SIZE], want[MAX_SIZE];
+	int bad = 0, t, i, r;
+	do {
+		if(sscanf(rh->c_id, "t%03d", &t) != 1  ||  t < 0  ||  t >= THREADS  ||  rh->c_size < 4  ||  rh->c_size > MAX_SIZE
+			||  riff_readInChunk(rh, buf, rh->c_size) != rh->c_size){
+			printf("unexpected chunk %s(%zu) at %zu\n", rh->c_id, rh->c_size, rh->c_pos_start);
+			bad++;
+			continue;
+		}
+		i = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
+		if(i < 0  ||  i >= CHUNKS  ||  seen[t][i]  ||  rh->c_size != chunk_size(t, i)){
+			printf("unexpected chunk %s(%zu) at %zu, index %d\n", rh->c_id, rh->c_size, rh->c_pos_start, i);
+			bad++;
+			continue;
+		}
+		chunk_data(t, i, want);
+		if(memcmp(buf, want, rh->c_size) != 0){
+			printf("data of chunk %s at %zu differs\n", rh->c_id, rh->c_pos_start);
+			bad++;
+		}
+		seen[t][i] = 1;
+	} while((r = riff_seekNextChunk(rh)) == RIFF_ERROR_NONE);
+	if(r >= RIFF_ERROR_CRITICAL){
+		printf("walk failed at %zu: %s\n", rh->pos, riff_errorToString(r));
+		bad++;
+	}
+
+	for(t = 0; t < THREADS; t++)
+		for(i = 0; i < CHUNKS; i++)
+			if(!seen[t][i])
+				bad++;
+	return bad;
+}
+
+
+int main(void){
+	char tmp[] = "/tmp/test_append_XXXXXX";
+	struct producer p[THREADS];
+	struct riff_appender *ap = NULL;
+	int t, failed = 0;
+	int fd = mkstemp(tmp);
+	if(fd < 0){
+		printf("FAILED: temporary file\n");
+		return 1;
+	}
+	unlink(tmp);
+
+	//header, a chunk before and after the list of appended chunks
+	riff_writer *rw = riff_writerAllocate();
+	int r = riff_writer_open_fd(rw, fd);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeListStart(rw, "RIFF", "TEST");
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunk(rw, "head", "abc", 3);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeListStart(rw, "LIST", "many");
+	if(r == RIFF_ERROR_NONE)
+		r = riff_appenderOpen(rw, &ap);
+
+	int started = 0;
+	for(t = 0; t < THREADS  &&  r == RIFF_ERROR_NONE; t++){
+		p[t].ap = ap;
+		p[t].fd = fd;
+		p[t].t = t;
+		p[t].err = RIFF_ERROR_NONE;
+		if(pthread_create(&p[t].thread, NULL, produce, p + t) != 0)
+			r = RIFF_ERROR_ACCESS;
+		else
+			started++;
+	}
+	for(t = 0; t < started; t++){
+		pthread_join(p[t].thread, NULL);
+		if(p[t].err != RIFF_ERROR_NONE  &&  r == RIFF_ERROR_NONE)
+			r = p[t].err;
+	}
+
+	int rc = riff_appenderClose(ap);
+	if(r == RIFF_ERROR_NONE)
+		r = rc;
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunkEnd(rw);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunk(rw, "tail", "de", 2);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeFinish(rw);
+	riff_writerFree(rw);
+	printf("append: %s\n", riff_errorToString(r));
+	if(r != RIFF_ERROR_NONE){
+		printf("FAILED: appending from %d threads\n", THREADS);
+		close(fd);
+		return 1;
+	}
+
+	riff_handle *rh = riff_handleAllocate();
+	lseek(fd, 0, SEEK_SET);
+	r = riff_open_fd(rh, fd, 0);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_fileValidate(rh);
+	printf("validate: %s\n", riff_errorToString(r));
+	if(r != RIFF_ERROR_NONE){
+		printf("FAILED: file structure\n");
+		failed = 1;
+	}
+
+	int bad = -1;
+	if(riff_seekPath(rh, "LIST:many") == RIFF_ERROR_NONE  &&  riff_seekLevelSub(rh) == RIFF_ERROR_NONE)
+		bad = check(rh);
+	printf("chunks: %d wrong or missing of %d\n", bad, THREADS * CHUNKS);
+	if(bad != 0){
+		printf("FAILED: appended chunks\n");
+		failed = 1;
+	}
+
+	riff_handleFree(rh);
+	close(fd);
+	return failed;
+}
@@ -0,0 +1,93 @@
+// Test of RIFFFile::walkAsync() on a wide and a deep tree
+//
+// The InlineExecutor never suspends, the walk must still run in constant stack space (also without optimization).
+//
+
+
+#include <cstdio>
+#include <future>
+
+#include "riff.hpp"
+
+
+#define WIDE_CHUNKS 200000  //data chunks in one list
+#define DEEP_LISTS 64       //nested lists
+
+
+//consumer coroutine, starts right away and frees itself at the end
+struct Task {
+    struct promise_type {
+        Task get_return_object () {return {};};
+        std::suspend_never initial_suspend () noexcept {return {};};
+        std::suspend_never final_suspend () noexcept {return {};};
+        void return_void () {};
+        void unhandled_exception () {std::terminate();};
+    };
+};
+
+Task walk(RIFF::RIFFFile & file, RIFF::Executor & ex, std::promise<size_t> & result){
+    size_t n = 0;
+    auto gen = file.walkAsync(ex);
+    while (co_await gen.next())
+        n++;
+    result.set_value(n);
+}
+
+size_t count(RIFF::RIFFFile & file, RIFF::Executor & ex){
+    std::promise<size_t> result;
+    auto future = result.get_future();
+    walk(file, ex, result);
+    return future.get();
+}
+
+int main(){
+    std::FILE *f = std::tmpfile();
+    if (f == nullptr) {
+        std::printf("tmpfile failed\n");
+        return 1;
+    }
+
+    riff_writer *rw = riff_writerAllocate();
+    riff_writer_open_file(rw, f);
+    riff_writeListStart(rw, "RIFF", "TEST");
+    riff_writeListStart(rw, "LIST", "wide");
+    for (int i = 0; i < WIDE_CHUNKS; i++)
+        riff_writeChunk(rw, "data", &i, 1);
+    riff_writeChunkEnd(rw);
+    for (int i = 0; i < DEEP_LISTS; i++)
+        riff_writeListStart(rw, "LIST", "deep");
+    riff_writeChunk(rw, "leaf", "leaf", 4);
+    for (int i = 0; i < DEEP_LISTS; i++)
+        riff_writeChunkEnd(rw);
+    riff_writeChunkEnd(rw);
+    int r = riff_writeFinish(rw);
+    riff_writerFree(rw);
+    if (r != RIFF_ERROR_NONE) {
+        std::printf("writing failed: %s\n", riff_errorToString(r));
+        return 1;
+    }
+
+    size_t size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    RIFF::RIFFFile file;
+    if (file.openCFILE(*f, size) != RIFF_ERROR_NONE) {
+        std::printf("opening failed\n");
+        return 1;
+    }
+
+    size_t expected = 1 + WIDE_CHUNKS + DEEP_LISTS + 1; //the file header is not a node
+    int failed = 0;
+
+    RIFF::InlineExecutor inl;
+    size_t n = count(file, inl);
+    std::printf("InlineExecutor: %zu of %zu nodes\n", n, expected);
+    failed |= n != expected;
+
+    RIFF::ThreadExecutor th;
+    n = count(file, th);
+    std::printf("ThreadExecutor: %zu of %zu nodes\n", n, expected);
+    failed |= n != expected;
+
+    std::fclose(f);
+    return failed;
+}
@@ -0,0 +1,111 @@
+// Test of commit mode: the file cut off at any commit must be a valid RIFF file
+//
+// A recording with nested lists, complete chunks and a growing open chunk of odd sized parts is written with a small commit interval.
+// After every commit the file is cut at riff_writer::commit_pos, as if the program died right then, and opened with that size.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "riff.h"
+
+
+#define COMMIT_BYTES 64
+#define RECORDS 200
+
+
+int fd;
+uint8_t *snapshot;
+
+
+/*****************************************************************************/
+//open the file cut at the last commit, returns 1 on failure
+int check_commit(riff_writer *rw){
+	size_t size = rw->commit_pos;
+	snapshot = realloc(snapshot, size);
+	if(snapshot == NULL  ||  pread(fd, snapshot, size, 0) != (ssize_t)size){
+		printf("FAILED: reading %zu bytes\n", size);
+		return 1;
+	}
+	riff_handle *rh = riff_handleAllocate();
+	int r = riff_open_mem(rh, snapshot, size);
+	int rv = r == RIFF_ERROR_NONE ? riff_fileValidate(rh) : r;
+	riff_handleFree(rh);
+	if(r != RIFF_ERROR_NONE  ||  rv != RIFF_ERROR_NONE){
+		printf("FAILED: commit %zu at %zu: open %s, validate %s\n", rw->commits, size, riff_errorToString(r), riff_errorToString(rv));
+		return 1;
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+//check a new commit if there was one, returns 1 on failure
+int step(riff_writer *rw, int r, size_t *commits){
+	if(r != RIFF_ERROR_NONE){
+		printf("FAILED: writing at %zu: %s\n", rw->pos, riff_errorToString(r));
+		return 1;
+	}
+	if(rw->commits == *commits)
+		return 0;
+	*commits = rw->commits;
+	return check_commit(rw);
+}
+
+
+int main(void){
+	char tmp[] = "/tmp/test_commit_XXXXXX";
+	uint8_t data[64];
+	size_t commits = 0;
+	int i, failed = 0;
+	fd = mkstemp(tmp);
+	if(fd < 0){
+		printf("FAILED: temporary file\n");
+		return 1;
+	}
+	unlink(tmp);
+	memset(data, 0x5A, sizeof(data));
+
+	riff_writer *rw = riff_writerAllocate();
+	int r = riff_writer_open_fd(rw, fd);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writerSetCommit(rw, COMMIT_BYTES, 0);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeListStart(rw, "RIFF", "TEST");
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunk(rw, "head", data, 5);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeListStart(rw, "LIST", "recd");
+	failed |= step(rw, r, &commits);
+
+	//records of odd and even sizes, every tenth a list with a growing chunk written in odd parts
+	for(i = 0; i < RECORDS  &&  !failed; i++){
+		if(i % 10 == 9){
+			r = riff_writeListStart(rw, "LIST", "part");
+			failed |= step(rw, r, &commits);
+			r = riff_writeChunkStart(rw, "strm");
+			int k;
+			for(k = 0; k < 20  &&  !failed; k++)
+				failed |= step(rw, riff_writeData(rw, data, 1 + k * 3 % 17), &commits);
+			failed |= step(rw, riff_writeChunkEnd(rw), &commits);
+			failed |= step(rw, riff_writeChunkEnd(rw), &commits);
+		}
+		else
+			failed |= step(rw, riff_writeChunk(rw, "rec ", data, i % 33), &commits);
+	}
+	if(!failed)
+		failed |= step(rw, riff_writeFinish(rw), &commits);
+	printf("%zu commits, %zu bytes\n", commits, rw->pos);
+	if(commits < 10){
+		printf("FAILED: too few commits\n");
+		failed = 1;
+	}
+
+	riff_writerFree(rw);
+	free(snapshot);
+	close(fd);
+	return failed;
+}
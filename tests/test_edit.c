@@ -0,0 +1,182 @@
+// Test of riff_editChunk() on a temporary file
+//
+// Every case builds a small file, edits one chunk and compares the resulting layout of the whole file,
+// so it's visible how the size change was absorbed: by a JUNK chunk, by growing the file or not at all.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "riff.h"
+
+
+#define MAX_FILE 256
+
+
+/*****************************************************************************/
+void put32(uint8_t *p, size_t v){
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************/
+//append a chunk with size bytes of fill, returns the new end
+size_t put_chunk(uint8_t *file, size_t pos, const char *id, size_t size, uint8_t fill){
+	memcpy(file + pos, id, 4);
+	put32(file + pos + 4, size);
+	memset(file + pos + 8, fill, size + (size & 1));
+	if(size & 1)
+		file[pos + 8 + size] = 0;
+	return pos + 8 + size + (size & 1);
+}
+
+/*****************************************************************************/
+//start a list, its size is set by list_end()
+size_t list_start(uint8_t *file, size_t pos, const char *id, const char *type){
+	memcpy(file + pos, id, 4);
+	memcpy(file + pos + 8, type, 4);
+	return pos + 12;
+}
+
+/*****************************************************************************/
+void list_end(uint8_t *file, size_t list, size_t end){
+	put32(file + list + 4, end - list - 8);
+}
+
+
+/*****************************************************************************/
+//append the layout of the current level and its sublevels, e.g. "INAM(2) JUNK(10)"
+int layout_level(riff_handle *rh, char *out, size_t cap){
+	int r;
+	while(1){
+		size_t n = strlen(out);
+		snprintf(out + n, cap - n, "%s%s(%zu)", out[n - 1] != '[' ? " " : "", rh->c_id, rh->c_size);
+		if(memcmp(rh->c_id, "LIST", 4) == 0  &&  riff_seekLevelSub(rh) == RIFF_ERROR_NONE){
+			n = strlen(out);
+			snprintf(out + n, cap - n, "[");
+			if((r = layout_level(rh, out, cap)) != RIFF_ERROR_NONE)
+				return r;
+			n = strlen(out);
+			snprintf(out + n, cap - n, "]");
+			riff_levelParent(rh);
+		}
+		r = riff_seekNextChunk(rh);
+		if(r != RIFF_ERROR_NONE)
+			return r >= RIFF_ERROR_CRITICAL ? r : RIFF_ERROR_NONE;
+	}
+}
+
+/*****************************************************************************/
+//layout of the whole file with the header size, returns RIFF error code of opening and validating
+int layout(int fd, char *out, size_t cap){
+	out[0] = 0;
+	lseek(fd, 0, SEEK_SET);
+	riff_handle *rh = riff_handleAllocate();
+	int r = riff_open_fd(rh, fd, 0);
+	if(r == RIFF_ERROR_NONE){
+		snprintf(out, cap, "%s(%zu)", rh->h_id, rh->h_size);
+		r = layout_level(rh, out, cap);
+	}
+	if(r == RIFF_ERROR_NONE)
+		r = riff_fileValidate(rh);
+	riff_handleFree(rh);
+	return r;
+}
+
+
+/*****************************************************************************/
+//write file, edit the chunk at path to size bytes and compare the error and the layout afterwards, returns 1 on failure
+int run(const char *name, const uint8_t *file, size_t file_size, const char *path, size_t size, int error, const char *expected){
+	char tmp[] = "/tmp/test_edit_XXXXXX";
+	char got[1024] = "";
+	uint8_t data[MAX_FILE];
+	int fd = mkstemp(tmp);
+	if(fd < 0){
+		printf("FAILED: %s: temporary file\n", name);
+		return 1;
+	}
+	unlink(tmp);
+	memset(data, 'x', size);
+
+	riff_handle *rh = riff_handleAllocate();
+	riff_writer *rw = riff_writerAllocate();
+	int r = write(fd, file, file_size) == (ssize_t)file_size ? RIFF_ERROR_NONE : RIFF_ERROR_ACCESS;
+	lseek(fd, 0, SEEK_SET);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_open_fd(rh, fd, 0);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writer_open_fd(rw, fd);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_seekPath(rh, path);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_editChunk(rh, rw, data, size);
+	riff_writerFree(rw);
+	riff_handleFree(rh);
+	int rl = layout(fd, got, sizeof(got));
+	close(fd);
+
+	printf("%s: %s, %s\n", name, riff_errorToString(r), got);
+	if(r != error  ||  rl != RIFF_ERROR_NONE  ||  strcmp(got, expected) != 0){
+		printf("FAILED: %s, expected %s, %s\n", name, riff_errorToString(error), expected);
+		return 1;
+	}
+	return 0;
+}
+
+
+int main(void){
+	uint8_t file[MAX_FILE];
+	size_t pos, list;
+	int failed = 0;
+
+	//RIFF header, fmt chunk, INFO list with INAM, optionally JUNK, and ISFT
+	#define INFO_FILE(junk) \
+		memset(file, 0, sizeof(file)); \
+		pos = list_start(file, 0, "RIFF", "TEST"); \
+		pos = put_chunk(file, pos, "fmt ", 4, 1); \
+		list = pos; \
+		pos = list_start(file, pos, "LIST", "INFO"); \
+		pos = put_chunk(file, pos, "INAM", 10, 2); \
+		if(junk >= 0) \
+			pos = put_chunk(file, pos, "JUNK", junk, 0); \
+		pos = put_chunk(file, pos, "ISFT", 4, 3); \
+		list_end(file, list, pos); \
+		list_end(file, 0, pos);
+
+	INFO_FILE(2);
+	failed |= run("same size", file, pos, "LIST:INFO/INAM", 10, RIFF_ERROR_NONE, "RIFF(68) fmt (4) LIST(44)[INAM(10) JUNK(2) ISFT(4)]");
+	//the freed bytes and the following JUNK become one JUNK chunk
+	failed |= run("shrink", file, pos, "LIST:INFO/INAM", 2, RIFF_ERROR_NONE, "RIFF(68) fmt (4) LIST(44)[INAM(2) JUNK(10) ISFT(4)]");
+	//odd size, the pad byte stays part of the chunk
+	failed |= run("shrink odd", file, pos, "LIST:INFO/INAM", 3, RIFF_ERROR_NONE, "RIFF(68) fmt (4) LIST(44)[INAM(3) JUNK(8) ISFT(4)]");
+
+	INFO_FILE(-1);
+	//too little room for a JUNK header and nothing to merge with
+	failed |= run("shrink without room", file, pos, "LIST:INFO/INAM", 6, RIFF_ERROR_ICSIZE, "RIFF(58) fmt (4) LIST(34)[INAM(10) ISFT(4)]");
+	failed |= run("shrink to empty JUNK", file, pos, "LIST:INFO/INAM", 2, RIFF_ERROR_NONE, "RIFF(58) fmt (4) LIST(34)[INAM(2) JUNK(0) ISFT(4)]");
+
+	INFO_FILE(12);
+	failed |= run("grow into JUNK", file, pos, "LIST:INFO/INAM", 20, RIFF_ERROR_NONE, "RIFF(78) fmt (4) LIST(54)[INAM(20) JUNK(2) ISFT(4)]");
+	failed |= run("grow into all of JUNK", file, pos, "LIST:INFO/INAM", 30, RIFF_ERROR_NONE, "RIFF(78) fmt (4) LIST(54)[INAM(30) ISFT(4)]");
+
+	//the last chunk of the file grows, so do its list and the header
+	failed |= run("grow at EOF", file, pos, "LIST:INFO/ISFT", 9, RIFF_ERROR_NONE, "RIFF(84) fmt (4) LIST(60)[INAM(10) JUNK(12) ISFT(9)]");
+
+	//BW64 with the real sizes in the ds64 chunk
+	memset(file, 0, sizeof(file));
+	pos = list_start(file, 0, "BW64", "WAVE");
+	put32(file + 4, 0xFFFFFFFF);
+	pos = put_chunk(file, pos, "ds64", 28, 0);
+	pos = put_chunk(file, pos, "data", 16, 4);
+	put32(file + 20, pos - 8); //riffSize, low 32 bits
+	failed |= run("grow ds64 at EOF", file, pos, "data", 40, RIFF_ERROR_NONE, "BW64(88) ds64(28) data(40)");
+	failed |= run("shrink ds64", file, pos, "data", 4, RIFF_ERROR_NONE, "BW64(64) ds64(28) data(4) JUNK(4)");
+
+	return failed;
+}
@@ -0,0 +1,293 @@
+// Test of riff_open_http() against an in-process HTTP server on the loopback interface
+//
+// The server counts requests and connections, so the test can check that reads are coalesced into few requests,
+// that a dropped keep-alive connection is reopened, and that a server ignoring ranges is refused.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "riff.h"
+
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  //not on macOS
+#endif
+
+#define BLOCK 4096      //block size of the client
+#define CACHE 64        //cached blocks of the client
+#define CHUNKS 2000     //small chunks at level 1
+#define SUBCHUNKS 500   //small chunks in a LIST
+#define BIG 100000      //size of the large chunk, spans many blocks
+
+
+enum {
+	SERVE_RANGES,   //206 with keep-alive
+	SERVE_DROP,     //206, but the connection is closed after every response without telling the client
+	SERVE_FULL      //200 with the whole file, ranges are ignored
+};
+
+struct server {
+	int mode;
+	int sock;
+	int port;
+	volatile int stop;
+	const uint8_t *file;
+	size_t size;
+	int requests;
+	int connections;
+	size_t max_range;  //largest range requested
+	pthread_t thread;
+};
+
+
+uint8_t *file;
+size_t file_size;
+
+
+/*****************************************************************************/
+void put32(uint8_t *p, size_t v){
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************/
+//append a chunk with data derived from its position, returns the new end
+size_t put_chunk(size_t pos, const char *id, size_t size){
+	memcpy(file + pos, id, 4);
+	put32(file + pos + 4, size);
+	size_t i;
+	for(i = 0; i < size; i++)
+		file[pos + 8 + i] = (uint8_t)((pos + i) * 31 >> 3);
+	pos += 8 + size;
+	if(size & 1)
+		file[pos++] = 0;
+	return pos;
+}
+
+/*****************************************************************************/
+//RIFF file with many small chunks, a list and a large chunk
+void make_file(void){
+	file = calloc(1, 12 + CHUNKS * 16 + 12 + SUBCHUNKS * 12 + 8 + BIG);
+	size_t pos = 12, i;
+	for(i = 0; i < CHUNKS; i++)
+		pos = put_chunk(pos, "data", i % 7);
+	size_t list = pos;
+	memcpy(file + list, "LIST", 4);
+	memcpy(file + list + 8, "sub ", 4);
+	pos += 12;
+	for(i = 0; i < SUBCHUNKS; i++)
+		pos = put_chunk(pos, "item", 3);
+	put32(file + list + 4, pos - list - 8);
+	pos = put_chunk(pos, "big ", BIG);
+	memcpy(file, "RIFF", 4);
+	put32(file + 4, pos - 8);
+	memcpy(file + 8, "TEST", 4);
+	file_size = pos;
+}
+
+
+/*****************************************************************************/
+int send_all(int s, const void *ptr, size_t size){
+	size_t n = 0;
+	while(n < size){
+		ssize_t r = send(s, (const uint8_t *)ptr + n, size - n, MSG_NOSIGNAL);
+		if(r <= 0)
+			return -1;
+		n += r;
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+//answer requests on one connection until the client closes it
+void serve_connection(struct server *srv, int c){
+	char req[4096];
+	size_t n = 0;
+	while(1){
+		char *end;
+		req[n] = 0;
+		while((end = strstr(req, "\r\n\r\n")) == NULL){
+			ssize_t r = recv(c, req + n, sizeof(req) - 1 - n, 0);
+			if(r <= 0)
+				return;
+			n += r;
+			req[n] = 0;
+		}
+		size_t hlen = end + 4 - req;
+		srv->requests++;
+
+		unsigned long long first = 0, last = srv->size - 1;
+		const char *range = strstr(req, "Range: bytes=");
+		if(range != NULL)
+			sscanf(range, "Range: bytes=%llu-%llu", &first, &last);
+		if(last >= srv->size)
+			last = srv->size - 1;
+		if(last - first + 1 > srv->max_range)
+			srv->max_range = last - first + 1;
+
+		char head[512];
+		int k;
+		if(srv->mode == SERVE_FULL){
+			first = 0;
+			last = srv->size - 1;
+			k = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", srv->size);
+		}
+		else
+			k = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %llu-%llu/%zu\r\nContent-Length: %llu\r\n\r\n", first, last, srv->size, last - first + 1);
+		if(send_all(c, head, k) != 0  ||  send_all(c, srv->file + first, last - first + 1) != 0)
+			return;
+		if(srv->mode == SERVE_DROP)
+			return;
+
+		memmove(req, req + hlen, n - hlen);
+		n -= hlen;
+	}
+}
+
+/*****************************************************************************/
+void *serve(void *arg){
+	struct server *srv = (struct server *)arg;
+	while(1){
+		int c = accept(srv->sock, NULL, NULL);
+		if(c < 0  ||  srv->stop){
+			if(c >= 0)
+				close(c);
+			break;
+		}
+		srv->connections++;
+		serve_connection(srv, c);
+		close(c);
+	}
+	return NULL;
+}
+
+/*****************************************************************************/
+int server_start(struct server *srv, int mode){
+	memset(srv, 0, sizeof(struct server));
+	srv->mode = mode;
+	srv->file = file;
+	srv->size = file_size;
+	struct sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(a);
+	srv->sock = socket(AF_INET, SOCK_STREAM, 0);
+	if(srv->sock < 0  ||  bind(srv->sock, (struct sockaddr *)&a, sizeof(a)) != 0  ||  listen(srv->sock, 4) != 0
+		||  getsockname(srv->sock, (struct sockaddr *)&a, &len) != 0)
+		return -1;
+	srv->port = ntohs(a.sin_port);
+	return pthread_create(&srv->thread, NULL, serve, srv);
+}
+
+/*****************************************************************************/
+//wake up accept() with a last connection, then join
+void server_stop(struct server *srv){
+	srv->stop = 1;
+	struct sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	a.sin_port = htons(srv->port);
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if(s >= 0){
+		connect(s, (struct sockaddr *)&a, sizeof(a));
+		close(s);
+	}
+	pthread_join(srv->thread, NULL);
+	close(srv->sock);
+}
+
+
+/*****************************************************************************/
+//walk the whole tree and compare the data of every chunk, returns the amount of chunks or -1
+int walk(riff_handle *rh){
+	static uint8_t buf[BIG];
+	int n = 0, r;
+	while(1){
+		n++;
+		if(memcmp(rh->c_id, "LIST", 4) == 0){
+			if(riff_seekLevelSub(rh) == RIFF_ERROR_NONE)
+				continue;
+		}
+		else if(rh->c_size > sizeof(buf)  ||  riff_readInChunk(rh, buf, rh->c_size) != rh->c_size
+			||  memcmp(buf, file + rh->c_pos_start + 8, rh->c_size) != 0){
+			printf("data of chunk at %zu differs\n", rh->c_pos_start);
+			return -1;
+		}
+		while((r = riff_seekNextChunk(rh)) != RIFF_ERROR_NONE){
+			if(r >= RIFF_ERROR_CRITICAL){
+				printf("walk failed at %zu: %s\n", rh->pos, riff_errorToString(r));
+				return -1;
+			}
+			if(rh->ls_level == 0)
+				return n;
+			riff_levelParent(rh);
+		}
+	}
+}
+
+/*****************************************************************************/
+//open the file from a server in the given mode and walk it, returns the open error
+int run(struct server *srv, int mode, int *chunks){
+	char url[64];
+	*chunks = -1;
+	if(server_start(srv, mode) != 0){
+		printf("server failed\n");
+		return -1;
+	}
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d/test.riff", srv->port);
+	riff_handle *rh = riff_handleAllocate();
+	int r = riff_open_http(rh, url, BLOCK, CACHE);
+	if(r == RIFF_ERROR_NONE)
+		*chunks = walk(rh);
+	riff_handleFree(rh); //closes the connection, the server waits for that
+	server_stop(srv);
+	return r;
+}
+
+
+int main(void){
+	struct server srv;
+	int chunks, r, failed = 0;
+	int expected = CHUNKS + 1 + SUBCHUNKS + 1;
+	make_file();
+
+	//header reads of the traversal are served from blocks fetched with few requests, runs of missing blocks with one each
+	r = run(&srv, SERVE_RANGES, &chunks);
+	printf("ranges: %s, %d of %d chunks, %d requests, %d connections, largest range %zu\n", riff_errorToString(r), chunks, expected, srv.requests, srv.connections, srv.max_range);
+	if(r != RIFF_ERROR_NONE  ||  chunks != expected  ||  srv.connections != 1  ||  srv.requests > (int)(file_size / BLOCK / 4)  ||  srv.max_range < 8 * BLOCK){
+		printf("FAILED: range coalescing\n");
+		failed = 1;
+	}
+
+	//every request after the first finds the connection dropped and reconnects
+	r = run(&srv, SERVE_DROP, &chunks);
+	printf("drop: %s, %d of %d chunks, %d requests, %d connections\n", riff_errorToString(r), chunks, expected, srv.requests, srv.connections);
+	if(r != RIFF_ERROR_NONE  ||  chunks != expected  ||  srv.connections < srv.requests  ||  srv.requests < 2){
+		printf("FAILED: keep-alive drop and reconnect\n");
+		failed = 1;
+	}
+
+	//a server without range support is refused right away
+	r = run(&srv, SERVE_FULL, &chunks);
+	printf("no ranges: %s, %d requests\n", riff_errorToString(r), srv.requests);
+	if(r != RIFF_ERROR_ACCESS  ||  srv.requests != 1){
+		printf("FAILED: 200 instead of 206\n");
+		failed = 1;
+	}
+
+	free(file);
+	return failed;
+}
@@ -0,0 +1,188 @@
+// Test of riff_writer_open_sink() with RIFF_SINK_DIRECT starting at an unaligned file position
+//
+// Existing data before the start shares the first block with the RIFF data, a small buffer makes the sink flush often and
+// patch size fields of ended chunks behind the buffer. Afterwards the existing data must be unchanged, the file must end
+// right behind the RIFF data without padding, and the RIFF data must validate and read back.
+//
+// File systems that refuse O_DIRECT fall back to buffered writes, the test checks the same then.
+//
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE //O_DIRECT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "riff.h"
+
+
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+#define PREFIX 1234     //existing data before the RIFF data, not a multiple of the alignment
+#define ALIGN 4096
+#define BUFFER 8192     //sink buffer, two blocks
+#define CHUNKS 300
+#define BIG 20000       //larger than the buffer
+
+
+uint8_t data[BIG];
+
+
+/*****************************************************************************/
+//size of chunk i, odd sizes get a pad byte
+size_t chunk_size(int i){
+	return (i * 37) % 301;
+}
+
+/*****************************************************************************/
+//data of chunk i, a slice of data[] starting at i
+const uint8_t *chunk_data(int i){
+	return data + i;
+}
+
+
+/*****************************************************************************/
+//write the RIFF data, returns RIFF error code
+int write_riff(riff_writer *rw){
+	int r = riff_writeListStart(rw, "RIFF", "TEST");
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunk(rw, "head", data, 3);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeListStart(rw, "LIST", "recd");
+	int i;
+	for(i = 0; i < CHUNKS  &&  r == RIFF_ERROR_NONE; i++)
+		r = riff_writeChunk(rw, "rec ", chunk_data(i), chunk_size(i));
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunkEnd(rw);
+	//chunk of unknown size written in parts, its size field is patched far behind the buffer
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunkStart(rw, "big ");
+	for(i = 0; i < BIG  &&  r == RIFF_ERROR_NONE; i += 999)
+		r = riff_writeData(rw, data + i, BIG - i < 999 ? BIG - i : 999);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunkEnd(rw);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeChunk(rw, "tail", data, 5);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_writeFinish(rw);
+	return r;
+}
+
+/*****************************************************************************/
+//compare the data of the chunk with what was written, returns 1 if it differs
+int check_chunk(riff_handle *rh, const uint8_t *want, size_t size){
+	static uint8_t buf[BIG];
+	if(rh->c_size != size  ||  riff_readInChunk(rh, buf, size) != size  ||  memcmp(buf, want, size) != 0){
+		printf("chunk %s(%zu) at %zu differs\n", rh->c_id, rh->c_size, rh->c_pos_start);
+		return 1;
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+//read the RIFF data back, returns the amount of wrong chunks or -1
+int check_riff(riff_handle *rh){
+	int bad = 0, i;
+	if(riff_seekPath(rh, "head") != RIFF_ERROR_NONE)
+		return -1;
+	bad += check_chunk(rh, data, 3);
+	if(riff_seekPath(rh, "LIST:recd") != RIFF_ERROR_NONE  ||  riff_seekLevelSub(rh) != RIFF_ERROR_NONE)
+		return -1;
+	for(i = 0; i < CHUNKS; i++){
+		bad += check_chunk(rh, chunk_data(i), chunk_size(i));
+		if(i + 1 < CHUNKS  &&  riff_seekNextChunk(rh) != RIFF_ERROR_NONE)
+			return -1;
+	}
+	if(riff_seekPath(rh, "big ") != RIFF_ERROR_NONE)
+		return -1;
+	bad += check_chunk(rh, data, BIG);
+	if(riff_seekPath(rh, "tail") != RIFF_ERROR_NONE)
+		return -1;
+	bad += check_chunk(rh, data, 5);
+	return bad;
+}
+
+
+int main(void){
+	char tmp[] = "/tmp/test_sink_XXXXXX";
+	uint8_t prefix[PREFIX], got[PREFIX];
+	int i, failed = 0;
+	int fd = mkstemp(tmp);
+	if(fd < 0){
+		printf("FAILED: temporary file\n");
+		return 1;
+	}
+	unlink(tmp);
+	for(i = 0; i < BIG; i++)
+		data[i] = (uint8_t)(i * 7 + (i >> 8));
+	for(i = 0; i < PREFIX; i++)
+		prefix[i] = (uint8_t)(0xA5 ^ i);
+	if(write(fd, prefix, PREFIX) != PREFIX){
+		printf("FAILED: writing the prefix\n");
+		close(fd);
+		return 1;
+	}
+
+	struct riff_sinkConfig cfg = {BUFFER, ALIGN, 0, 0, RIFF_SINK_DIRECT};
+	int fl = fcntl(fd, F_GETFL);
+	riff_writer *rw = riff_writerAllocate();
+	int r = riff_writer_open_sink(rw, fd, &cfg);
+	int direct = (fcntl(fd, F_GETFL) & O_DIRECT) != 0  &&  O_DIRECT != 0;
+	if(r == RIFF_ERROR_NONE)
+		r = write_riff(rw);
+	size_t end = rw->pos;
+	riff_writerFree(rw);
+	printf("write: %s, O_DIRECT %s, %zu bytes\n", riff_errorToString(r), direct ? "on" : "refused", end - PREFIX);
+	if(r != RIFF_ERROR_NONE){
+		printf("FAILED: writing through the sink\n");
+		close(fd);
+		return 1;
+	}
+
+	//the sink restores the file status flags and leaves the offset at the end
+	if(fcntl(fd, F_GETFL) != fl  ||  lseek(fd, 0, SEEK_CUR) != (off_t)end){
+		printf("FAILED: file status flags or offset not restored\n");
+		failed = 1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0  ||  (size_t)st.st_size != end){
+		printf("FAILED: file size %zu, expected %zu\n", (size_t)st.st_size, end);
+		failed = 1;
+	}
+	if(pread(fd, got, PREFIX, 0) != PREFIX  ||  memcmp(got, prefix, PREFIX) != 0){
+		printf("FAILED: data before the start was changed\n");
+		failed = 1;
+	}
+
+	riff_handle *rh = riff_handleAllocate();
+	lseek(fd, PREFIX, SEEK_SET);
+	r = riff_open_fd(rh, fd, 0);
+	if(r == RIFF_ERROR_NONE)
+		r = riff_fileValidate(rh);
+	printf("validate: %s\n", riff_errorToString(r));
+	if(r != RIFF_ERROR_NONE){
+		printf("FAILED: file structure\n");
+		failed = 1;
+	}
+	else {
+		int bad = check_riff(rh);
+		printf("chunks: %d wrong\n", bad);
+		if(bad != 0){
+			printf("FAILED: chunk data\n");
+			failed = 1;
+		}
+	}
+
+	riff_handleFree(rh);
+	close(fd);
+	return failed;
+}
@@ -0,0 +1,430 @@
+// riffdump: print or export the chunk tree of a RIFF file
+//
+// riffdump [-f text|json|cbor] [-H xxh64|crc32c] [-j threads] [-o outfile] file
+//
+// The tree is read with riff_parseTree() and written from the flat node array, nothing recurses.
+// Output goes through a large buffer with hand-written number formatting, so millions of chunks take seconds.
+// Exits with 2 if the file can't be read or has no chunk at all, JSON and CBOR are null then.
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "riff.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define RIFF_FD 1
+#endif
+
+
+#define OUT_BUFFER_SIZE (1 << 16)
+
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1
+#define FORMAT_CBOR 2
+
+
+//buffered output
+struct out {
+	FILE *f;
+	size_t n;
+	int error;
+	char buf[OUT_BUFFER_SIZE];
+};
+
+/*****************************************************************************/
+void out_flush(struct out *o){
+	if(o->n > 0  &&  fwrite(o->buf, 1, o->n, o->f) != o->n)
+		o->error = 1;
+	o->n = 0;
+}
+
+/*****************************************************************************/
+void out_bytes(struct out *o, const void *p, size_t n){
+	if(o->n + n > OUT_BUFFER_SIZE){
+		out_flush(o);
+		if(n > OUT_BUFFER_SIZE){
+			if(fwrite(p, 1, n, o->f) != n)
+				o->error = 1;
+			return;
+		}
+	}
+	memcpy(o->buf + o->n, p, n);
+	o->n += n;
+}
+
+/*****************************************************************************/
+void out_char(struct out *o, char c){
+	if(o->n == OUT_BUFFER_SIZE)
+		out_flush(o);
+	o->buf[o->n++] = c;
+}
+
+/*****************************************************************************/
+void out_str(struct out *o, const char *s){
+	out_bytes(o, s, strlen(s));
+}
+
+/*****************************************************************************/
+void out_uint(struct out *o, uint64_t v){
+	char tmp[20];
+	int i = sizeof(tmp);
+	do {
+		tmp[--i] = '0' + v % 10;
+		v /= 10;
+	} while(v > 0);
+	out_bytes(o, tmp + i, sizeof(tmp) - i);
+}
+
+/*****************************************************************************/
+void out_hex64(struct out *o, uint64_t v){
+	static const char digits[] = "0123456789abcdef";
+	char tmp[16];
+	int i;
+	for(i = 15; i >= 0; i--, v >>= 4)
+		tmp[i] = digits[v & 0xF];
+	out_bytes(o, tmp, 16);
+}
+
+/*****************************************************************************/
+//FOURCC as text, non-printable bytes escaped for JSON if json is set
+void out_id(struct out *o, const char *id, int json){
+	int i;
+	for(i = 0; i < 4; i++){
+		uint8_t c = (uint8_t)id[i];
+		if(json  &&  (c < 0x20  ||  c > 0x7e  ||  c == '"'  ||  c == '\\')){
+			static const char digits[] = "0123456789abcdef";
+			char esc[6] = {'\\', 'u', '0', '0', digits[c >> 4], digits[c & 0xF]};
+			out_bytes(o, esc, 6);
+		}
+		else if(!json  &&  (c < 0x20  ||  c > 0x7e))
+			out_char(o, '?');
+		else
+			out_char(o, c);
+	}
+}
+
+/*****************************************************************************/
+//CBOR head: major type and argument, shortest encoding
+void cbor_head(struct out *o, int major, uint64_t v){
+	uint8_t b[9];
+	int n, i;
+	if(v < 24){
+		b[0] = (major << 5) | v;
+		n = 0;
+	}
+	else if(v <= 0xFF){
+		b[0] = (major << 5) | 24;
+		n = 1;
+	}
+	else if(v <= 0xFFFF){
+		b[0] = (major << 5) | 25;
+		n = 2;
+	}
+	else if(v <= 0xFFFFFFFF){
+		b[0] = (major << 5) | 26;
+		n = 4;
+	}
+	else {
+		b[0] = (major << 5) | 27;
+		n = 8;
+	}
+	for(i = 0; i < n; i++)
+		b[1 + i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+	out_bytes(o, b, 1 + n);
+}
+
+/*****************************************************************************/
+void cbor_text(struct out *o, const char *s, size_t n){
+	cbor_head(o, 3, n);
+	out_bytes(o, s, n);
+}
+
+/*****************************************************************************/
+//FOURCC as text string, as byte string if it isn't printable ASCII (CBOR text must be UTF-8)
+void cbor_id(struct out *o, const char *id){
+	int i, printable = 1;
+	for(i = 0; i < 4; i++)
+		if(id[i] < 0x20  ||  id[i] > 0x7e)
+			printable = 0;
+	cbor_head(o, printable ? 3 : 2, 4);
+	out_bytes(o, id, 4);
+}
+
+
+/*****************************************************************************/
+void dump_text(struct out *o, const struct riff_tree *tree, const uint64_t *hashes, const char *algo){
+	int32_t i;
+	for(i = 0; i < tree->count; i++){
+		const struct riff_treeNode *node = tree->nodes + i;
+		int32_t d;
+		for(d = 0; d < node->depth; d++)
+			out_bytes(o, "  ", 2);
+		out_id(o, node->c_id, 0);
+		if(node->c_type[0] != 0){
+			out_char(o, ':');
+			out_id(o, node->c_type, 0);
+		}
+		out_str(o, " @");
+		out_uint(o, node->c_pos_start);
+		out_str(o, " size ");
+		out_uint(o, node->c_size);
+		if(hashes != NULL){
+			out_char(o, ' ');
+			out_str(o, algo);
+			out_char(o, '=');
+			out_hex64(o, hashes[i]);
+		}
+		out_char(o, '\n');
+	}
+}
+
+/*****************************************************************************/
+//nodes are in file order, the depth change between neighbors tells which objects to close
+void dump_json(struct out *o, const struct riff_tree *tree, const uint64_t *hashes, const char *algo){
+	int32_t i, d;
+	if(tree->count == 0){
+		out_str(o, "null\n");
+		return;
+	}
+	for(i = 0; i < tree->count; i++){
+		const struct riff_treeNode *node = tree->nodes + i;
+		if(i > 0){
+			const struct riff_treeNode *prev = node - 1;
+			for(d = prev->depth; d > node->depth; d--)
+				out_str(o, "]}");
+			if(node->depth <= prev->depth)
+				out_char(o, ',');
+		}
+		out_str(o, "{\"id\":\"");
+		out_id(o, node->c_id, 1);
+		out_char(o, '"');
+		if(node->c_type[0] != 0){
+			out_str(o, ",\"type\":\"");
+			out_id(o, node->c_type, 1);
+			out_char(o, '"');
+		}
+		out_str(o, ",\"pos\":");
+		out_uint(o, node->c_pos_start);
+		out_str(o, ",\"size\":");
+		out_uint(o, node->c_size);
+		if(hashes != NULL){
+			out_str(o, ",\"");
+			out_str(o, algo);
+			out_str(o, "\":\"");
+			out_hex64(o, hashes[i]);
+			out_char(o, '"');
+		}
+		if(node->first_child != RIFF_TREE_NONE)
+			out_str(o, ",\"children\":[");
+		else
+			out_char(o, '}');
+	}
+	for(d = tree->nodes[tree->count - 1].depth; d > 0; d--)
+		out_str(o, "]}");
+	out_char(o, '\n');
+}
+
+/*****************************************************************************/
+//every node is a map, children are indefinite length arrays
+void dump_cbor(struct out *o, const struct riff_tree *tree, const uint64_t *hashes, const char *algo){
+	int32_t i, d;
+	if(tree->count == 0){
+		cbor_head(o, 7, 22); //null
+		return;
+	}
+	for(i = 0; i < tree->count; i++){
+		const struct riff_treeNode *node = tree->nodes + i;
+		if(i > 0)
+			for(d = node[-1].depth; d > node->depth; d--)
+				out_char(o, (char)0xFF);
+
+		int haschildren = node->first_child != RIFF_TREE_NONE;
+		cbor_head(o, 5, 3 + (node->c_type[0] != 0) + (hashes != NULL) + haschildren);
+		cbor_text(o, "id", 2);
+		cbor_id(o, node->c_id);
+		if(node->c_type[0] != 0){
+			cbor_text(o, "type", 4);
+			cbor_id(o, node->c_type);
+		}
+		cbor_text(o, "pos", 3);
+		cbor_head(o, 0, node->c_pos_start);
+		cbor_text(o, "size", 4);
+		cbor_head(o, 0, node->c_size);
+		if(hashes != NULL){
+			cbor_text(o, algo, strlen(algo));
+			cbor_head(o, 0, hashes[i]);
+		}
+		if(haschildren){
+			cbor_text(o, "children", 8);
+			out_char(o, (char)0x9F);
+		}
+	}
+	for(d = tree->nodes[tree->count - 1].depth; d > 0; d--)
+		out_char(o, (char)0xFF);
+}
+
+
+/*****************************************************************************/
+void usage(void){
+	fprintf(stderr,
+		"usage: riffdump [-f text|json|cbor] [-H xxh64|crc32c] [-j threads] [-o outfile] file\n"
+		"  -f  output format, default text\n"
+		"  -H  add the hash of every chunk (Merkle hash for lists)\n"
+		"  -j  threads for hashing, default 1\n"
+		"  -o  write to outfile instead of stdout\n");
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv){
+	int format = FORMAT_TEXT, algo = -1, threads = 1, i;
+	const char *algoname = NULL, *outpath = NULL, *path = NULL;
+
+	for(i = 1; i < argc; i++){
+		const char *a = argv[i];
+		if(a[0] == '-'  &&  a[1] != 0  &&  a[2] == 0  &&  strchr("fHjo", a[1]) != NULL){
+			if(++i >= argc){
+				usage();
+				return 1;
+			}
+			const char *v = argv[i];
+			if(a[1] == 'f'){
+				if(strcmp(v, "text") == 0)
+					format = FORMAT_TEXT;
+				else if(strcmp(v, "json") == 0)
+					format = FORMAT_JSON;
+				else if(strcmp(v, "cbor") == 0)
+					format = FORMAT_CBOR;
+				else {
+					usage();
+					return 1;
+				}
+			}
+			else if(a[1] == 'H'){
+				if(strcmp(v, "xxh64") == 0)
+					algo = RIFF_HASH_XXH64;
+				else if(strcmp(v, "crc32c") == 0)
+					algo = RIFF_HASH_CRC32C;
+				else {
+					usage();
+					return 1;
+				}
+				algoname = v;
+			}
+			else if(a[1] == 'j')
+				threads = atoi(v);
+			else
+				outpath = v;
+		}
+		else if(path == NULL  &&  a[0] != '-')
+			path = a;
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if(path == NULL){
+		usage();
+		return 1;
+	}
+
+	riff_handle *rh = riff_handleAllocate();
+	if(rh == NULL){
+		fprintf(stderr, "riffdump: out of memory\n");
+		return 2;
+	}
+
+	//map the file if possible, the kernel page cache is then the only buffer and hashing runs in parallel
+	int r = RIFF_ERROR_ACCESS;
+	FILE *f = NULL;
+#if RIFF_FD
+	int fd = open(path, O_RDONLY);
+	if(fd >= 0){
+		off_t size = lseek(fd, 0, SEEK_END);
+		lseek(fd, 0, SEEK_SET);
+		r = riff_open_mmap(rh, fd, size);
+		close(fd); //the mapping stays
+	}
+#endif
+	if(r == RIFF_ERROR_ACCESS){
+		f = fopen(path, "rb");
+		if(f == NULL){
+			fprintf(stderr, "riffdump: can't open %s\n", path);
+			riff_handleFree(rh);
+			return 2;
+		}
+		setvbuf(f, NULL, _IOFBF, 1 << 20);
+		fseek(f, 0, SEEK_END);
+		size_t size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		r = riff_open_file(rh, f, size);
+	}
+
+	struct riff_tree tree;
+	memset(&tree, 0, sizeof(struct riff_tree));
+	uint64_t *hashes = NULL;
+	if(r < RIFF_ERROR_CRITICAL){
+		//a broken file still gives the tree up to the error
+		r = riff_parseTree(rh, &tree);
+		if(r < RIFF_ERROR_CRITICAL  &&  algo >= 0){
+			hashes = malloc((tree.count > 0 ? tree.count : 1) * sizeof(uint64_t));
+			if(hashes == NULL)
+				r = RIFF_ERROR_MEMORY;
+			else if((r = riff_hashTree(rh, &tree, algo, threads, hashes)) >= RIFF_ERROR_CRITICAL){
+				free(hashes);
+				hashes = NULL;
+			}
+		}
+	}
+	if(r >= RIFF_ERROR_CRITICAL){
+		char msg[256];
+		const struct riff_diag *d = riff_diagGet(rh, 0);
+		if(d != NULL  &&  d->code == r)
+			riff_diagToString(d, msg, sizeof(msg));
+		else
+			snprintf(msg, sizeof(msg), "%s", riff_errorToString(r));
+		fprintf(stderr, "riffdump: %s: %s\n", path, msg);
+	}
+	else if(tree.count == 0)
+		fprintf(stderr, "riffdump: %s: no chunks\n", path);
+
+	struct out *o = malloc(sizeof(struct out));
+	int ret = r >= RIFF_ERROR_CRITICAL  ||  tree.count == 0 ? 2 : 0;
+	if(o != NULL){
+		o->f = outpath != NULL ? fopen(outpath, "wb") : stdout;
+		o->n = 0;
+		o->error = o->f == NULL;
+		if(o->f != NULL){
+			if(format == FORMAT_JSON)
+				dump_json(o, &tree, hashes, algoname);
+			else if(format == FORMAT_CBOR)
+				dump_cbor(o, &tree, hashes, algoname);
+			else
+				dump_text(o, &tree, hashes, algoname);
+			out_flush(o);
+			if(outpath != NULL  &&  fclose(o->f) != 0)
+				o->error = 1;
+		}
+		if(o->error){
+			fprintf(stderr, "riffdump: write error\n");
+			ret = 2;
+		}
+		free(o);
+	}
+	else
+		ret = 2;
+
+	free(hashes);
+	riff_treeFree(&tree);
+	riff_handleFree(rh);
+	if(f != NULL)
+		fclose(f);
+	return ret;
+}